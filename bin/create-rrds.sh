@@ -54,6 +54,10 @@ if [ ! -f "${ARGENT_RRD}" ] ; then
 		DS:rain_gauge_6h:GAUGE:600:U:U \
 		DS:rain_gauge_24h:GAUGE:600:U:U \
 		DS:rain_gauge_today:GAUGE:600:U:U \
+		DS:wind_dir_stddev_2m:GAUGE:600:U:U \
+		DS:wind_dir_stddev_10m:GAUGE:600:U:U \
+		DS:wind_dir_stddev_60m:GAUGE:600:U:U \
+		DS:wind_dir_unstable:GAUGE:600:U:U \
 		RRA:MIN:0.5:1:120 \
 		RRA:MIN:0.5:2:120 \
 		RRA:MIN:0.5:4:120 \
@@ -78,6 +82,28 @@ if [ ! -f "${ARGENT_RRD}" ] ; then
 		RRA:MAX:0.5:360:8760
 fi
 
+# Adds the data sources that were added to the argent_80422 result after
+# the database was created. rrdtool tune needs rrdtool 1.5 or newer to add
+# a data source.
+add_missing_ds()
+{
+	RRD="${1}"
+	shift
+
+	for DS in "$@" ; do
+		if ! rrdtool info "${RRD}" | grep -q "^ds\[${DS}\]\." ; then
+			echo "Adding ${DS} to ${RRD}"
+			rrdtool tune "${RRD}" DS:"${DS}":GAUGE:600:U:U
+		fi
+	done
+}
+
+add_missing_ds "${ARGENT_RRD}" \
+	wind_dir_stddev_2m \
+	wind_dir_stddev_10m \
+	wind_dir_stddev_60m \
+	wind_dir_unstable
+
 if [ ! -f "${TEMPERATURE_HUMIDTY_RRD}" ] ; then
 	rrdtool create "${TEMPERATURE_HUMIDTY_RRD}" \
 		--start N --step 300 \
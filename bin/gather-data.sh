@@ -19,51 +19,18 @@
 # Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
 # 02110-1301, USA.
 
-YADL_BIN="${1:-}"
-WEB_BASE_DIR="${2:-}"
-ID="${3:-}"
-PASSWORD="${4:-}"
+WEB_BASE_DIR="${1:-}"
+ID="${2:-}"
+PASSWORD="${3:-}"
 
-if [ "${YADL_BIN}" = "" ] || [ "${WEB_BASE_DIR}" = "" ] ; then
-        echo "usage: $0 <path to yadl binary> <path to web/ directory" \
+if [ "${WEB_BASE_DIR}" = "" ] ; then
+        echo "usage: $0 <path to web/ directory" \
 		"[ <weather underground ID> <weather underground password> ]" >&2
         exit 1
 fi
 
-JSON="${WEB_BASE_DIR}"/temperature_humidity.json
-"${YADL_BIN}" --gpio_pin 3 --sensor dht22 --temperature_unit fahrenheit --max_retries 30 \
-	--output rrd --outfile "${WEB_BASE_DIR}"/temperature_humidity.rrd \
-	--output single_json --outfile "${JSON}"
-if [ $? != 0 ] ; then
-	rm -f "${JSON}"
-fi
-
-JSON="${WEB_BASE_DIR}"/bmp180.json
-"${YADL_BIN}" --sensor bmp180 --i2c_address 77 --temperature_unit fahrenheit \
-	--num_samples_per_result 7 --filter median \
-	--sleep_millis_between_samples 1000 \
-	--output rrd --outfile "${WEB_BASE_DIR}"/bmp180.rrd \
-	--output single_json --outfile "${JSON}"
-if [ $? != 0 ] ; then
-	rm -f "${JSON}"
-fi
-
-JSON="${WEB_BASE_DIR}"/battery.json
-"${YADL_BIN}" --sensor analog --adc mcp3008 --spi_channel 0 --analog_channel 3 --adc_millivolts 14000 \
-	--output rrd --outfile "${WEB_BASE_DIR}"/battery.rrd \
-	--output single_json --outfile "${JSON}"
-if [ $? != 0 ] ; then
-	rm -f "${JSON}"
-fi
-
-JSON="${WEB_BASE_DIR}"/booster.json
-"${YADL_BIN}" --sensor analog --adc mcp3008 --spi_channel 0 --analog_channel 2 --adc_millivolts 5000 \
-	--output rrd --outfile "${WEB_BASE_DIR}"/booster.rrd \
-	--output single_json --outfile "${JSON}"
-if [ $? != 0 ] ; then
-	rm -f "${JSON}"
-fi
-
+# The sensors are read by the yadl process started by
+# systemd/weather-station-sensors.service.
 
 # Write system uptime JSON file
 UPTIME_SECS=$(awk '{print $1}' < /proc/uptime)
@@ -20,8 +20,6 @@
  */
 
 #include <stdlib.h>
-#include <mcp3002.h>
-#include <wiringPi.h>
 #include "yadl.h"
 
 #define PIN_BASE 64
@@ -41,7 +39,7 @@ static void mcp3002_analog_init(yadl_config *config)
 	config->logger("mcp3002: Initializing pin base %d for SPI channel %d\n",
 			PIN_BASE, config->spi_channel);
 
-	if (mcp3002Setup(PIN_BASE, config->spi_channel) == -1)
+	if (config->hw->mcp3002_setup(PIN_BASE, config->spi_channel) == -1)
 		exit(1);
 }
 
@@ -49,7 +47,7 @@ static int mcp3002_analog_read(yadl_config *config)
 {
 	int chan = PIN_BASE + config->analog_channel;
 
-	int ret = analogRead(chan);
+	int ret = config->hw->analog_read(chan);
 
 	config->logger("mcp3002: Read value %d from pi base %d and analog channel %d\n",
 			ret, PIN_BASE, config->analog_channel);
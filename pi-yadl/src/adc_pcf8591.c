@@ -20,8 +20,6 @@
  */
 
 #include <stdlib.h>
-#include <pcf8591.h>
-#include <wiringPi.h>
 #include "yadl.h"
 
 #define PIN_BASE 64
@@ -41,7 +39,7 @@ static void pcf8591_analog_init(yadl_config *config)
 	config->logger("pcf8591: Initializing pin base %d for I2C address %d\n",
 			PIN_BASE, config->i2c_address);
 
-	if (pcf8591Setup(PIN_BASE, config->i2c_address) == -1)
+	if (config->hw->pcf8591_setup(PIN_BASE, config->i2c_address) == -1)
 		exit(1);
 }
 
@@ -49,7 +47,7 @@ static int pcf8591_analog_read(yadl_config *config)
 {
 	int chan = PIN_BASE + config->analog_channel;
 
-	int ret = analogRead(chan);
+	int ret = config->hw->analog_read(chan);
 
 	config->logger("pcf8591: Read value %d from pin base %d and analog channel %d\n",
 			ret, PIN_BASE, config->analog_channel);
@@ -0,0 +1,155 @@
+/*
+ * anemometer.c - Wind speed and gusts from the anemometer pulses.
+ *
+ * Copyright (C) 2016-2017 Brian Masney <masneyb@onstation.org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include "anemometer.h"
+#include "memory.h"
+
+void anemometer_init(anemometer *anem, float multiplier, uint64_t now_usecs)
+{
+	anem->multiplier = multiplier;
+	pulse_ring_init(&anem->pulses, ANEMOMETER_RING_SIZE);
+	anem->start_usecs = now_usecs;
+	anem->last_sample_usecs = now_usecs;
+	anem->have_last_pulse = 0;
+	anem->last_pulse_usecs = 0;
+	anem->last_period_usecs = 0;
+	anem->last_num_dropped = 0;
+	anem->recent = yadl_calloc(ANEMOMETER_RING_SIZE, sizeof(uint64_t));
+	anem->recent_head = 0;
+	anem->num_recent = 0;
+}
+
+void anemometer_pulse(anemometer *anem, uint64_t usecs)
+{
+	pulse_ring_push(&anem->pulses, usecs);
+}
+
+/* Drop the pulses that are no longer in the gust interval ending at usecs */
+static void _expire_recent(anemometer *anem, uint64_t usecs)
+{
+	while (anem->num_recent > 0 &&
+	       anem->recent[anem->recent_head] + ANEMOMETER_GUST_USECS <=
+	       usecs) {
+		anem->recent_head = (anem->recent_head + 1) %
+			ANEMOMETER_RING_SIZE;
+		anem->num_recent--;
+	}
+}
+
+static void _add_recent(anemometer *anem, uint64_t usecs)
+{
+	if (anem->num_recent == ANEMOMETER_RING_SIZE) {
+		anem->recent_head = (anem->recent_head + 1) %
+			ANEMOMETER_RING_SIZE;
+		anem->num_recent--;
+	}
+
+	anem->recent[(anem->recent_head + anem->num_recent) %
+		     ANEMOMETER_RING_SIZE] = usecs;
+	anem->num_recent++;
+}
+
+/* Pulses per second when there were too few pulses to count */
+static double _period_frequency(anemometer *anem, uint64_t now_usecs,
+				int num_pulses, uint64_t first_pulse_usecs,
+				uint64_t prev_pulse_usecs, int have_prev_pulse)
+{
+	if (num_pulses > 0 && have_prev_pulse)
+		return num_pulses * 1e6 /
+			(anem->last_pulse_usecs - prev_pulse_usecs);
+	else if (num_pulses > 1)
+		return (num_pulses - 1) * 1e6 /
+			(anem->last_pulse_usecs - first_pulse_usecs);
+	else if (!anem->have_last_pulse || anem->last_period_usecs == 0)
+		return 0.0;
+
+	/*
+	 * No pulse during this sample. The wind is at most as fast as one
+	 * pulse over the time since the last one.
+	 */
+	uint64_t since_last = now_usecs - anem->last_pulse_usecs;
+
+	if (since_last >= ANEMOMETER_TIMEOUT_USECS)
+		return 0.0;
+	else if (since_last < anem->last_period_usecs)
+		return 1e6 / anem->last_period_usecs;
+	return 1e6 / since_last;
+}
+
+int anemometer_sample(anemometer *anem, uint64_t now_usecs, float *speed,
+		      float *gust)
+{
+	int have_prev_pulse = anem->have_last_pulse;
+	uint64_t prev_pulse_usecs = anem->last_pulse_usecs;
+	uint64_t first_pulse_usecs = 0;
+	int num_pulses = 0;
+
+	/* The running mean only goes down between the pulses */
+	_expire_recent(anem, anem->last_sample_usecs);
+	int max_recent = anem->num_recent;
+
+	uint64_t usecs;
+
+	while (pulse_ring_pop(&anem->pulses, &usecs) == 0) {
+		if (num_pulses == 0)
+			first_pulse_usecs = usecs;
+		if (anem->have_last_pulse)
+			anem->last_period_usecs = usecs -
+				anem->last_pulse_usecs;
+
+		anem->last_pulse_usecs = usecs;
+		anem->have_last_pulse = 1;
+		num_pulses++;
+
+		_expire_recent(anem, usecs);
+		_add_recent(anem, usecs);
+		if (anem->num_recent > max_recent)
+			max_recent = anem->num_recent;
+	}
+
+	double frequency;
+
+	if (num_pulses >= ANEMOMETER_COUNT_MIN_PULSES &&
+	    now_usecs > anem->last_sample_usecs)
+		frequency = num_pulses * 1e6 /
+			(now_usecs - anem->last_sample_usecs);
+	else
+		frequency = _period_frequency(anem, now_usecs, num_pulses,
+					      first_pulse_usecs,
+					      prev_pulse_usecs,
+					      have_prev_pulse);
+
+	anem->last_sample_usecs = now_usecs;
+
+	*speed = frequency * anem->multiplier;
+	if (now_usecs - anem->start_usecs < ANEMOMETER_GUST_USECS)
+		*gust = *speed;
+	else
+		*gust = max_recent * 1e6 / ANEMOMETER_GUST_USECS *
+			anem->multiplier;
+
+	uint64_t num_dropped = atomic_load(&anem->pulses.num_dropped);
+	int ret = num_dropped - anem->last_num_dropped;
+
+	anem->last_num_dropped = num_dropped;
+
+	return ret;
+}
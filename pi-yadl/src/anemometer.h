@@ -0,0 +1,70 @@
+/*
+ * anemometer.h - Wind speed and gusts from the anemometer pulses.
+ *
+ * Copyright (C) 2016-2017 Brian Masney <masneyb@onstation.org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include <stdint.h>
+#include "pulse_ring.h"
+
+/* The WMO gust is the highest 3 second running mean of the wind speed */
+#define ANEMOMETER_GUST_USECS		3000000
+
+/*
+ * With this many pulses in a sample the count is accurate enough. Below
+ * it the speed comes from the time between the pulses instead.
+ */
+#define ANEMOMETER_COUNT_MIN_PULSES	10
+
+/* The speed is 0 when there has been no pulse for this long */
+#define ANEMOMETER_TIMEOUT_USECS	5000000
+
+#define ANEMOMETER_RING_SIZE		1024
+
+typedef struct anemometer_tag {
+	/* The speed for one pulse per second */
+	float multiplier;
+
+	pulse_ring pulses;
+
+	uint64_t start_usecs;
+	uint64_t last_sample_usecs;
+	int have_last_pulse;
+	uint64_t last_pulse_usecs;
+	uint64_t last_period_usecs;
+	uint64_t last_num_dropped;
+
+	/* The pulses in the last ANEMOMETER_GUST_USECS, oldest first */
+	uint64_t *recent;
+	int recent_head;
+	int num_recent;
+} anemometer;
+
+void anemometer_init(anemometer *anem, float multiplier, uint64_t now_usecs);
+
+/* Called from the interrupt handler. This never blocks. */
+void anemometer_pulse(anemometer *anem, uint64_t usecs);
+
+/*
+ * Takes the pulses since the last sample and returns the speed over the
+ * sample and the highest 3 second running mean during it. The gust is the
+ * speed until 3 seconds of pulses have been seen. Returns the number of
+ * pulses that were lost because the ring was full.
+ */
+int anemometer_sample(anemometer *anem, uint64_t now_usecs, float *speed,
+		      float *gust);
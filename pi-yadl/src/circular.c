@@ -0,0 +1,110 @@
+/*
+ * circular.c - Statistics for the wind direction.
+ *
+ * Copyright (C) 2016-2017 Brian Masney <masneyb@onstation.org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include <math.h>
+#include "circular.h"
+
+/* sin() and cos() of each vane position, starting at north */
+static const double _position_sin[CIRCULAR_NUM_POSITIONS] = {
+	0.0, 0.38268343236508977, 0.70710678118654752, 0.92387953251128674,
+	1.0, 0.92387953251128674, 0.70710678118654752, 0.38268343236508977,
+	0.0, -0.38268343236508977, -0.70710678118654752, -0.92387953251128674,
+	-1.0, -0.92387953251128674, -0.70710678118654752, -0.38268343236508977
+};
+
+static const double _position_cos[CIRCULAR_NUM_POSITIONS] = {
+	1.0, 0.92387953251128674, 0.70710678118654752, 0.38268343236508977,
+	0.0, -0.38268343236508977, -0.70710678118654752, -0.92387953251128674,
+	-1.0, -0.92387953251128674, -0.70710678118654752, -0.38268343236508977,
+	0.0, 0.38268343236508977, 0.70710678118654752, 0.92387953251128674
+};
+
+int circular_position(float degrees)
+{
+	int position = lroundf(degrees / CIRCULAR_POSITION_DEGREES) %
+		CIRCULAR_NUM_POSITIONS;
+
+	return position < 0 ? position + CIRCULAR_NUM_POSITIONS : position;
+}
+
+void circular_add(circular_sums *sums, int position)
+{
+	sums->sin_sum += _position_sin[position];
+	sums->cos_sum += _position_cos[position];
+	sums->count++;
+}
+
+void circular_remove(circular_sums *sums, int position)
+{
+	sums->sin_sum -= _position_sin[position];
+	sums->cos_sum -= _position_cos[position];
+	sums->count--;
+}
+
+void circular_add_sums(circular_sums *sums, circular_sums *other)
+{
+	sums->sin_sum += other->sin_sum;
+	sums->cos_sum += other->cos_sum;
+	sums->count += other->count;
+}
+
+void circular_remove_sums(circular_sums *sums, circular_sums *other)
+{
+	sums->sin_sum -= other->sin_sum;
+	sums->cos_sum -= other->cos_sum;
+	sums->count -= other->count;
+}
+
+static double _to_degrees(double radians)
+{
+	return radians * 180.0 / M_PI;
+}
+
+float circular_mean(circular_sums *sums)
+{
+	if (sums->count == 0)
+		return NAN;
+
+	double degrees = _to_degrees(atan2(sums->sin_sum, sums->cos_sum));
+
+	if (degrees < 0)
+		degrees += 360.0;
+
+	/* Keep rounding in the output from showing 360 */
+	return degrees >= 359.995 ? 0.0 : degrees;
+}
+
+float circular_stddev(circular_sums *sums)
+{
+	if (sums->count == 0)
+		return NAN;
+
+	double sin_mean = sums->sin_sum / sums->count;
+	double cos_mean = sums->cos_sum / sums->count;
+	double r2 = sin_mean * sin_mean + cos_mean * cos_mean;
+
+	/* Rounding can push this slightly above 1 for identical directions */
+	double epsilon = r2 >= 1.0 ? 0.0 : sqrt(1.0 - r2);
+	double sigma = asin(epsilon) *
+		(1.0 + (2.0 / sqrt(3.0) - 1.0) * epsilon * epsilon * epsilon);
+
+	return _to_degrees(sigma);
+}
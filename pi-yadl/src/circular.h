@@ -0,0 +1,57 @@
+/*
+ * circular.h - Statistics for the wind direction.
+ *
+ * Copyright (C) 2016-2017 Brian Masney <masneyb@onstation.org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/* The wind vane reports one of 16 directions 22.5 degrees apart */
+#define CIRCULAR_NUM_POSITIONS		16
+#define CIRCULAR_POSITION_DEGREES	22.5
+
+/*
+ * Directions can't be averaged like other numbers since 350 and 10 degrees
+ * would average to 180 instead of 0. Each direction is treated as a unit
+ * vector instead, and the sums of the sines and cosines are kept so that
+ * samples can be added and removed as the window slides.
+ */
+typedef struct circular_sums_tag {
+	double sin_sum;
+	double cos_sum;
+	int count;
+} circular_sums;
+
+/* Returns the nearest vane position to the direction in degrees */
+int circular_position(float degrees);
+
+void circular_add(circular_sums *sums, int position);
+
+void circular_remove(circular_sums *sums, int position);
+
+/* Adds or removes all of the directions that were added to other */
+void circular_add_sums(circular_sums *sums, circular_sums *other);
+
+void circular_remove_sums(circular_sums *sums, circular_sums *other);
+
+/* The direction of the vector mean in degrees, from 0 up to 360 */
+float circular_mean(circular_sums *sums);
+
+/*
+ * The directional spread in degrees using the Yamartino method. This is 0
+ * when all of the directions are the same.
+ */
+float circular_stddev(circular_sums *sums);
@@ -1,5 +1,5 @@
 /*
- * float_list.c
+ * dht_decoder.c - Decodes a DHT11 / DHT22 response from its edge times.
  *
  * Copyright (C) 2016-2017 Brian Masney <masneyb@onstation.org>
  *
@@ -19,57 +19,34 @@
  * 02110-1301, USA.
  */
 
-#include <stdlib.h>
-#include "float_list.h"
+#include <string.h>
+#include "dht_decoder.h"
 
-int list_len(float_node *list)
+int dht_decode(const uint64_t *edge_usecs, int num_edges, uint8_t data[5])
 {
-	int ret = 0;
+	memset(data, 0, 5);
 
-	for (float_node *node = list; node != NULL; node = node->next)
-		ret++;
+	/* Skip the response. Each bit starts with the falling edge. */
+	int bit_pos = 0;
 
-	return ret;
-}
-
-float list_sum(float_node *list)
-{
-	float sum = 0.0;
-
-	for (float_node *node = list; node != NULL; node = node->next)
-		sum += node->value;
+	for (; bit_pos < DHT_NUM_BITS; bit_pos++) {
+		int rising = 3 + bit_pos * 2;
 
-	return sum;
-}
-
-float_node *list_last_node(float_node *list)
-{
-	float_node *curval = list;
+		if (rising + 1 >= num_edges)
+			break;
 
-	while (curval->next != NULL)
-		curval = curval->next;
+		uint64_t usecs_high = edge_usecs[rising + 1] -
+			edge_usecs[rising];
 
-	return curval;
-}
-
-float_node *new_list_node(float value)
-{
-	float_node *ret = malloc(sizeof(*ret));
+		data[bit_pos / 8] <<= 1;
+		if (usecs_high > DHT_BIT_ONE_USECS)
+			data[bit_pos / 8] |= 1;
+	}
 
-	ret->value = value;
-	ret->next = NULL;
-	return ret;
+	return bit_pos;
 }
 
-void free_list(float_node *list)
+int dht_checksum_ok(const uint8_t data[5])
 {
-	float_node *val = list;
-
-	while (val != NULL) {
-		float_node *nextval = val->next;
-
-		free(val);
-		val = nextval;
-	}
+	return ((data[0] + data[1] + data[2] + data[3]) & 0xFF) == data[4];
 }
-
@@ -0,0 +1,46 @@
+/*
+ * dht_decoder.h - Decodes a DHT11 / DHT22 response from its edge times.
+ *
+ * Copyright (C) 2016-2017 Brian Masney <masneyb@onstation.org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include <stdint.h>
+
+/*
+ * After the host releases the data line, the sensor pulls it low for 80us
+ * and high for 80us, and then sends 40 bits. Each bit is 50us low followed
+ * by 26-28us high for a 0 or 70us high for a 1. That is the two edges of
+ * the response and two for each bit, plus the falling edge that ends the
+ * last bit.
+ */
+#define DHT_NUM_EDGES		83
+#define DHT_NUM_BITS		40
+
+/* Halfway between the high times of a 0 and a 1 */
+#define DHT_BIT_ONE_USECS	48
+
+/*
+ * Fills in the 5 bytes that the sensor sent from the times of the edges
+ * on the data line. edge_usecs starts with the falling edge where the
+ * sensor starts its response. Returns the number of bits that were
+ * decoded, which is DHT_NUM_BITS when the whole response was captured.
+ */
+int dht_decode(const uint64_t *edge_usecs, int num_edges, uint8_t data[5]);
+
+/* Returns 1 when the last byte is the checksum of the other four */
+int dht_checksum_ok(const uint8_t data[5]);
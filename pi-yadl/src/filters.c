@@ -23,99 +23,303 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include "float_array.h"
 #include "yadl.h"
 
-static float min_filter(float_node *list)
+static void stream_init(filter_state *state)
 {
-	return list->value;
+	state->count = 0;
+	state->sum = 0.0;
+	state->min = FLT_MAX;
+	state->max = -FLT_MAX;
 }
 
-static float max_filter(float_node *list)
+static void stream_push(filter_state *state, float sample)
 {
-	float_node *curval = list;
+	state->count++;
+	state->sum += sample;
+	if (sample < state->min)
+		state->min = sample;
+	if (sample > state->max)
+		state->max = sample;
+}
+
+static float min_filter(float *values, int len)
+{
+	return float_array_min(values, len);
+}
+
+static float min_filter_finalize(filter_state *state)
+{
+	return state->min;
+}
+
+static float max_filter(float *values, int len)
+{
+	return float_array_max(values, len);
+}
 
-	while (curval->next != NULL)
-		curval = curval->next;
-	return curval->value;
+static float max_filter_finalize(filter_state *state)
+{
+	return state->max;
 }
 
 /* Return the difference between the maximum and minimum number */
-static float range_filter(float_node *list)
+static float range_filter(float *values, int len)
 {
-	float min = min_filter(list);
-	float max = max_filter(list);
+	float min = float_array_min(values, len);
+	float max = float_array_max(values, len);
 
 	return max - min;
 }
 
-static float median_filter(float_node *list)
+static float range_filter_finalize(filter_state *state)
 {
-	float_node *curval = list;
+	return state->max - state->min;
+}
 
-	int median_pos = list_len(list) / 2;
+static float median_filter(float *values, int len)
+{
+	return float_array_select(values, len, len / 2);
+}
 
-	for (int i = 0; i < median_pos; i++)
-		curval = curval->next;
-	return curval->value;
+static float mean_filter(float *values, int len)
+{
+	float sum = float_array_sum(values, len);
+
+	return sum / len;
 }
 
-static float mean_filter(float_node *list)
+static float mean_filter_finalize(filter_state *state)
 {
-	float sum = list_sum(list);
+	return state->sum / state->count;
+}
 
-	return sum / list_len(list);
+static float sum_filter(float *values, int len)
+{
+	return float_array_sum(values, len);
+}
+
+static float sum_filter_finalize(filter_state *state)
+{
+	return state->sum;
 }
 
 /* Return the number that occurs the most number of times. Fallback to the
  *  mean if no numbers appear more than once.
  */
-static float mode_filter(float_node *list)
+static float mode_filter(float *values, int len)
 {
-	float cur_number = list->value;
+	float_array_sort(values, len);
+
+	float cur_number = values[0];
 	float cur_count = 0;
 	float max_number = FLT_MIN;
 	float max_count = 0;
 
-	for (float_node *curval = list; curval != NULL; curval = curval->next) {
-		if (cur_number == curval->value) {
+	for (int i = 0; i < len; i++) {
+		if (cur_number == values[i]) {
 			cur_count++;
 			if (cur_count > 1 && cur_count > max_count) {
 				max_number = cur_number;
 				max_count = cur_count;
 			}
 		} else {
-			cur_number = curval->value;
+			cur_number = values[i];
 			cur_count = 1;
 		}
 	}
 
 	/* no mode? */
 	if (max_number == FLT_MIN)
-		return mean_filter(list);
+		return mean_filter(values, len);
 
 	return max_number;
 }
 
-filter get_filter(char *name)
+/*
+ * Approximate median using the P-squared algorithm from Jain and Chlamtac,
+ * "The P2 algorithm for dynamic calculation of quantiles and histograms
+ * without storing observations". Five markers track the minimum, the
+ * 25th, 50th and 75th percentiles and the maximum. The marker heights are
+ * adjusted with a piecewise parabolic prediction as each sample arrives.
+ */
+static const float p2_increments[P2_NUM_MARKERS] = {
+	0.0, 0.25, 0.5, 0.75, 1.0
+};
+
+static void median_approx_init(filter_state *state)
+{
+	stream_init(state);
+
+	for (int i = 0; i < P2_NUM_MARKERS; i++) {
+		/* The desired positions start at 0, 1, 2, 3, 4 for the median */
+		state->p2_positions[i] = i;
+		state->p2_desired[i] = i;
+	}
+}
+
+static float p2_parabolic(filter_state *state, int i, int d)
+{
+	float *q = state->p2_heights;
+	int *n = state->p2_positions;
+
+	return q[i] + (float) d / (n[i + 1] - n[i - 1]) *
+		((n[i] - n[i - 1] + d) * (q[i + 1] - q[i]) / (n[i + 1] - n[i]) +
+		 (n[i + 1] - n[i] - d) * (q[i] - q[i - 1]) / (n[i] - n[i - 1]));
+}
+
+static float p2_linear(filter_state *state, int i, int d)
+{
+	float *q = state->p2_heights;
+	int *n = state->p2_positions;
+
+	return q[i] + d * (q[i + d] - q[i]) / (n[i + d] - n[i]);
+}
+
+static void median_approx_push(filter_state *state, float sample)
+{
+	float *q = state->p2_heights;
+	int *n = state->p2_positions;
+
+	stream_push(state, sample);
+
+	/* The markers are initialized from the first five samples */
+	if (state->count <= P2_NUM_MARKERS) {
+		q[state->count - 1] = sample;
+		if (state->count == P2_NUM_MARKERS)
+			float_array_sort(q, P2_NUM_MARKERS);
+		return;
+	}
+
+	int k;
+
+	if (sample < q[0]) {
+		q[0] = sample;
+		k = 0;
+	} else if (sample >= q[P2_NUM_MARKERS - 1]) {
+		q[P2_NUM_MARKERS - 1] = sample;
+		k = P2_NUM_MARKERS - 2;
+	} else {
+		for (k = 0; k < P2_NUM_MARKERS - 2; k++) {
+			if (sample < q[k + 1])
+				break;
+		}
+	}
+
+	for (int i = k + 1; i < P2_NUM_MARKERS; i++)
+		n[i]++;
+
+	for (int i = 0; i < P2_NUM_MARKERS; i++)
+		state->p2_desired[i] += p2_increments[i];
+
+	/* Move the middle markers if they are off from their desired spot */
+	for (int i = 1; i < P2_NUM_MARKERS - 1; i++) {
+		float offset = state->p2_desired[i] - n[i];
+
+		if ((offset >= 1 && n[i + 1] - n[i] > 1) ||
+		    (offset <= -1 && n[i - 1] - n[i] < -1)) {
+			int d = offset > 0 ? 1 : -1;
+			float height = p2_parabolic(state, i, d);
+
+			if (q[i - 1] < height && height < q[i + 1])
+				q[i] = height;
+			else
+				q[i] = p2_linear(state, i, d);
+
+			n[i] += d;
+		}
+	}
+}
+
+static float median_approx_finalize(filter_state *state)
+{
+	if (state->count >= P2_NUM_MARKERS)
+		return state->p2_heights[P2_NUM_MARKERS / 2];
+
+	/* Not enough samples to seed the markers. Use the exact median. */
+	return median_filter(state->p2_heights, state->count);
+}
+
+static filter min_filter_funcs = {
+	.init = &stream_init,
+	.push = &stream_push,
+	.finalize = &min_filter_finalize,
+	.reduce = &min_filter
+};
+static filter max_filter_funcs = {
+	.init = &stream_init,
+	.push = &stream_push,
+	.finalize = &max_filter_finalize,
+	.reduce = &max_filter
+};
+static filter range_filter_funcs = {
+	.init = &stream_init,
+	.push = &stream_push,
+	.finalize = &range_filter_finalize,
+	.reduce = &range_filter
+};
+static filter mean_filter_funcs = {
+	.init = &stream_init,
+	.push = &stream_push,
+	.finalize = &mean_filter_finalize,
+	.reduce = &mean_filter
+};
+static filter sum_filter_funcs = {
+	.init = &stream_init,
+	.push = &stream_push,
+	.finalize = &sum_filter_finalize,
+	.reduce = &sum_filter
+};
+static filter median_filter_funcs = {
+	.reduce = &median_filter
+};
+static filter median_approx_filter_funcs = {
+	.init = &median_approx_init,
+	.push = &median_approx_push,
+	.finalize = &median_approx_finalize,
+	.reduce = &median_filter
+};
+static filter mode_filter_funcs = {
+	.reduce = &mode_filter
+};
+
+int filter_needs_samples(filter *filter_func, int remove_n_samples_from_ends)
+{
+	/* The outliers can only be removed once all of the samples are known */
+	return filter_func->push == NULL || remove_n_samples_from_ends > 0;
+}
+
+float filter_samples(filter *filter_func, float *values, int len,
+		     int remove_n_samples_from_ends)
+{
+	float *remaining = float_array_trim(values, &len,
+					    remove_n_samples_from_ends);
+
+	return filter_func->reduce(remaining, len);
+}
+
+filter *get_filter(char *name)
 {
 	if (name == NULL)
-		return &median_filter;
+		return &median_filter_funcs;
 	else if (strcmp(name, "min") == 0)
-		return &min_filter;
+		return &min_filter_funcs;
 	else if (strcmp(name, "max") == 0)
-		return &max_filter;
+		return &max_filter_funcs;
 	else if (strcmp(name, "median") == 0)
-		return &median_filter;
+		return &median_filter_funcs;
+	else if (strcmp(name, "median_approx") == 0)
+		return &median_approx_filter_funcs;
 	else if (strcmp(name, "mean") == 0)
-		return &mean_filter;
+		return &mean_filter_funcs;
 	else if (strcmp(name, "range") == 0)
-		return &range_filter;
+		return &range_filter_funcs;
 	else if (strcmp(name, "mode") == 0)
-		return &mode_filter;
+		return &mode_filter_funcs;
 	else if (strcmp(name, "sum") == 0)
-		return &list_sum;
+		return &sum_filter_funcs;
 
 	fprintf(stderr, "Unknown filter '%s'\n", name);
 	return NULL;
 }
-
@@ -0,0 +1,161 @@
+/*
+ * float_array.c
+ *
+ * Copyright (C) 2016-2017 Brian Masney <masneyb@onstation.org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include <stdlib.h>
+#include "float_array.h"
+
+float float_array_sum(float *values, int len)
+{
+	/* Accumulate in double so large sample counts don't lose precision */
+	double sum = 0.0;
+
+	for (int i = 0; i < len; i++)
+		sum += values[i];
+
+	return sum;
+}
+
+float float_array_min(float *values, int len)
+{
+	float min = values[0];
+
+	for (int i = 1; i < len; i++) {
+		if (values[i] < min)
+			min = values[i];
+	}
+
+	return min;
+}
+
+float float_array_max(float *values, int len)
+{
+	float max = values[0];
+
+	for (int i = 1; i < len; i++) {
+		if (values[i] > max)
+			max = values[i];
+	}
+
+	return max;
+}
+
+static int _compare_floats(const void *a, const void *b)
+{
+	float fa = *(const float *) a;
+	float fb = *(const float *) b;
+
+	return (fa > fb) - (fa < fb);
+}
+
+void float_array_sort(float *values, int len)
+{
+	qsort(values, len, sizeof(float), &_compare_floats);
+}
+
+static void _swap(float *values, int a, int b)
+{
+	float tmp = values[a];
+
+	values[a] = values[b];
+	values[b] = tmp;
+}
+
+/*
+ * Hoare partition using the median of the first, middle and last values as
+ * the pivot. On return, values[lo..ret] <= pivot <= values[ret+1..hi].
+ */
+static int _partition(float *values, int lo, int hi)
+{
+	int mid = lo + (hi - lo) / 2;
+
+	if (values[mid] < values[lo])
+		_swap(values, mid, lo);
+	if (values[hi] < values[lo])
+		_swap(values, hi, lo);
+	if (values[hi] < values[mid])
+		_swap(values, hi, mid);
+
+	float pivot = values[mid];
+	int i = lo - 1;
+	int j = hi + 1;
+
+	while (1) {
+		do {
+			i++;
+		} while (values[i] < pivot);
+
+		do {
+			j--;
+		} while (values[j] > pivot);
+
+		if (i >= j)
+			return j;
+
+		_swap(values, i, j);
+	}
+}
+
+/*
+ * Quickselect with a depth limit. If the partitioning degrades, the
+ * remaining range is sorted instead so the worst case is O(n log n).
+ */
+float float_array_select(float *values, int len, int k)
+{
+	int lo = 0;
+	int hi = len - 1;
+	int depth_limit = 0;
+
+	for (int i = len; i > 0; i >>= 1)
+		depth_limit += 2;
+
+	while (lo < hi) {
+		if (depth_limit-- == 0) {
+			float_array_sort(values + lo, hi - lo + 1);
+			break;
+		}
+
+		int pos = _partition(values, lo, hi);
+
+		if (k <= pos)
+			hi = pos;
+		else
+			lo = pos + 1;
+	}
+
+	return values[k];
+}
+
+float *float_array_trim(float *values, int *len, int num_from_ends)
+{
+	if (num_from_ends <= 0)
+		return values;
+
+	/* Move the smallest values to the front of the array... */
+	float_array_select(values, *len, num_from_ends);
+
+	/* ...and the largest values to the end of the remaining values. */
+	*len -= num_from_ends;
+	float_array_select(values + num_from_ends, *len,
+			   *len - num_from_ends);
+
+	*len -= num_from_ends;
+	return values + num_from_ends;
+}
@@ -0,0 +1,40 @@
+/*
+ * float_array.h
+ *
+ * Copyright (C) 2016-2017 Brian Masney <masneyb@onstation.org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+float float_array_sum(float *values, int len);
+
+float float_array_min(float *values, int len);
+
+float float_array_max(float *values, int len);
+
+/*
+ * Returns the k-th smallest value (0 based). The array is partially
+ * reordered so that values[0..k-1] <= values[k] <= values[k+1..len-1].
+ */
+float float_array_select(float *values, int len, int k);
+
+/*
+ * Discards the num_from_ends smallest and largest values without sorting
+ * the array. Returns a pointer to the remaining values and updates len.
+ */
+float *float_array_trim(float *values, int *len, int num_from_ends);
+
+void float_array_sort(float *values, int len);
@@ -0,0 +1,238 @@
+/*
+ * gpio_events.c - One epoll loop that hands GPIO line events to the handlers.
+ *
+ * Copyright (C) 2016-2017 Brian Masney <masneyb@onstation.org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <linux/gpio.h>
+#include <sys/epoll.h>
+#include "gpio_events.h"
+
+/* Set for the handler that is running on this thread */
+static _Thread_local uint64_t _event_usecs;
+static _Thread_local int _event_level;
+
+int gpio_events_init(gpio_events *events)
+{
+	events->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (events->epoll_fd < 0) {
+		fprintf(stderr, "Error creating the GPIO event loop: %s\n",
+			strerror(errno));
+		return -1;
+	}
+
+	events->num_sources = 0;
+	atomic_init(&events->num_events, 0);
+	atomic_init(&events->num_reads, 0);
+	atomic_init(&events->num_dropped, 0);
+
+	return 0;
+}
+
+static gpio_event_source *_add_source(gpio_events *events, int fd,
+				      void (*handler)(void))
+{
+	if (events->num_sources == GPIO_EVENTS_MAX_SOURCES) {
+		fprintf(stderr, "Only %d GPIO event sources are supported\n",
+			GPIO_EVENTS_MAX_SOURCES);
+		return NULL;
+	}
+
+	gpio_event_source *source = &events->sources[events->num_sources];
+
+	source->fd = fd;
+	source->handler = handler;
+	source->last_line_seqno = 0;
+	source->mock_fd = -1;
+	source->mock_line_seqno = 0;
+
+	/*
+	 * The loop may already be running. It only sees the source once it
+	 * has been filled in and added here.
+	 */
+	struct epoll_event ev;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.ptr = source;
+
+	if (epoll_ctl(events->epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+		fprintf(stderr, "Error adding a GPIO event source: %s\n",
+			strerror(errno));
+		return NULL;
+	}
+
+	events->num_sources++;
+
+	return source;
+}
+
+int gpio_events_add(gpio_events *events, int fd, void (*handler)(void))
+{
+	return _add_source(events, fd, handler) == NULL ? -1 : 0;
+}
+
+static int _read_events(gpio_events *events, gpio_event_source *source)
+{
+	struct gpio_v2_line_event buf[GPIO_EVENTS_BATCH_SIZE];
+	ssize_t len = read(source->fd, buf, sizeof(buf));
+
+	if (len < 0)
+		return errno == EINTR || errno == EAGAIN ? 0 : -1;
+
+	int num_events = len / sizeof(buf[0]);
+
+	for (int i = 0; i < num_events; i++) {
+		/*
+		 * line_seqno starts at 1. When the kernel's buffer is full it
+		 * throws away the oldest event, which leaves a gap.
+		 */
+		if (source->last_line_seqno != 0 &&
+		    buf[i].line_seqno > source->last_line_seqno + 1)
+			atomic_fetch_add_explicit(&events->num_dropped,
+						  buf[i].line_seqno -
+						  source->last_line_seqno - 1,
+						  memory_order_relaxed);
+		source->last_line_seqno = buf[i].line_seqno;
+
+		_event_usecs = buf[i].timestamp_ns / 1000;
+		_event_level = buf[i].id == GPIO_V2_LINE_EVENT_RISING_EDGE;
+		source->handler();
+	}
+
+	atomic_fetch_add_explicit(&events->num_events, num_events,
+				  memory_order_relaxed);
+	atomic_fetch_add_explicit(&events->num_reads, 1, memory_order_relaxed);
+
+	return num_events;
+}
+
+int gpio_events_dispatch(gpio_events *events, int timeout_millis)
+{
+	struct epoll_event ready[GPIO_EVENTS_MAX_SOURCES];
+	int num_ready = epoll_wait(events->epoll_fd, ready,
+				   GPIO_EVENTS_MAX_SOURCES, timeout_millis);
+
+	if (num_ready < 0)
+		return errno == EINTR ? 0 : -1;
+
+	int num_events = 0;
+
+	for (int i = 0; i < num_ready; i++) {
+		int ret = _read_events(events, ready[i].data.ptr);
+
+		if (ret < 0)
+			return -1;
+		num_events += ret;
+	}
+
+	return num_events;
+}
+
+void *gpio_events_thread(void *arg)
+{
+	gpio_events *events = arg;
+
+	while (1) {
+		if (gpio_events_dispatch(events, -1) < 0) {
+			fprintf(stderr, "Error reading the GPIO events: %s\n",
+				strerror(errno));
+			exit(1);
+		}
+	}
+
+	return NULL;
+}
+
+uint64_t gpio_events_usecs(void)
+{
+	return _event_usecs;
+}
+
+int gpio_events_level(void)
+{
+	return _event_level;
+}
+
+int gpio_events_add_mock(gpio_events *events, void (*handler)(void))
+{
+	int fds[2];
+
+	if (pipe(fds) < 0) {
+		fprintf(stderr, "Error creating the mock GPIO events: %s\n",
+			strerror(errno));
+		return -1;
+	}
+
+	gpio_event_source *source = _add_source(events, fds[0], handler);
+
+	if (source == NULL) {
+		close(fds[0]);
+		close(fds[1]);
+		return -1;
+	}
+
+	source->mock_fd = fds[1];
+
+	return source - events->sources;
+}
+
+int gpio_events_mock_edges(gpio_events *events, int source,
+			   uint64_t *usecs, int num_edges)
+{
+	gpio_event_source *src = &events->sources[source];
+	struct gpio_v2_line_event buf[GPIO_EVENTS_BATCH_SIZE];
+
+	/*
+	 * Each write is smaller than PIPE_BUF so that the reader never sees
+	 * part of an event.
+	 */
+	for (int i = 0; i < num_edges; i += GPIO_EVENTS_BATCH_SIZE) {
+		int num = num_edges - i;
+
+		if (num > GPIO_EVENTS_BATCH_SIZE)
+			num = GPIO_EVENTS_BATCH_SIZE;
+
+		memset(buf, 0, sizeof(buf));
+		for (int j = 0; j < num; j++) {
+			src->mock_line_seqno++;
+			buf[j].timestamp_ns = usecs[i + j] * 1000;
+			buf[j].id = GPIO_V2_LINE_EVENT_RISING_EDGE;
+			buf[j].offset = source;
+			buf[j].seqno = src->mock_line_seqno;
+			buf[j].line_seqno = src->mock_line_seqno;
+		}
+
+		ssize_t len = num * sizeof(buf[0]);
+
+		if (write(src->mock_fd, buf, len) != len)
+			return -1;
+	}
+
+	return 0;
+}
+
+void gpio_events_mock_drop(gpio_events *events, int source, int num_events)
+{
+	events->sources[source].mock_line_seqno += num_events;
+}
@@ -0,0 +1,99 @@
+/*
+ * gpio_events.h - One epoll loop that hands GPIO line events to the handlers.
+ *
+ * Copyright (C) 2016-2017 Brian Masney <masneyb@onstation.org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#define GPIO_EVENTS_MAX_SOURCES	32
+
+/* The number of line events that are read with one system call */
+#define GPIO_EVENTS_BATCH_SIZE	16
+
+/*
+ * A file descriptor that the kernel writes struct gpio_v2_line_event to.
+ * mock_fd is the write end of the pipe for the sources that are added
+ * with gpio_events_add_mock().
+ */
+typedef struct gpio_event_source_tag {
+	int fd;
+	void (*handler)(void);
+	uint32_t last_line_seqno;
+
+	int mock_fd;
+	uint32_t mock_line_seqno;
+} gpio_event_source;
+
+/*
+ * The edges of all of the pins are handled by one thread that waits on a
+ * single epoll descriptor. Each handler is called once per event, in the
+ * order that the kernel saw them, and gpio_events_usecs() returns the
+ * kernel's timestamp of the edge while the handler runs. num_dropped
+ * counts the events that the kernel threw away because its buffer filled
+ * up before they were read.
+ */
+typedef struct gpio_events_tag {
+	int epoll_fd;
+	int num_sources;
+	gpio_event_source sources[GPIO_EVENTS_MAX_SOURCES];
+
+	atomic_uint_fast64_t num_events;
+	atomic_uint_fast64_t num_reads;
+	atomic_uint_fast64_t num_dropped;
+} gpio_events;
+
+/* These return -1 on error */
+int gpio_events_init(gpio_events *events);
+
+int gpio_events_add(gpio_events *events, int fd, void (*handler)(void));
+
+/*
+ * Waits up to timeout_millis (-1 waits forever) for events and calls the
+ * handlers. Returns the number of events that were handled.
+ */
+int gpio_events_dispatch(gpio_events *events, int timeout_millis);
+
+/* Calls gpio_events_dispatch() forever. arg is the gpio_events. */
+void *gpio_events_thread(void *arg);
+
+/*
+ * The CLOCK_MONOTONIC timestamp of the event that is being handled, and
+ * the level of the line after it.
+ */
+uint64_t gpio_events_usecs(void);
+
+int gpio_events_level(void);
+
+/*
+ * A source that is fed through a pipe instead of a GPIO line so that the
+ * event loop can be exercised without the hardware. Returns the index of
+ * the source that is passed to gpio_events_mock_edges().
+ */
+int gpio_events_add_mock(gpio_events *events, void (*handler)(void));
+
+int gpio_events_mock_edges(gpio_events *events, int source,
+			   uint64_t *usecs, int num_edges);
+
+/*
+ * Skips the next num_events line sequence numbers of a mock source, like
+ * the kernel does when it throws events away, so that the next edge that
+ * is written counts them in num_dropped.
+ */
+void gpio_events_mock_drop(gpio_events *events, int source, int num_events);
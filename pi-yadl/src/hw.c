@@ -0,0 +1,111 @@
+/*
+ * hw.c
+ *
+ * Copyright (C) 2016-2017 Brian Masney <masneyb@onstation.org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hw.h"
+
+_Thread_local uint64_t hw_i2c_transactions;
+
+hw_backend *get_hw_backend(char *name)
+{
+	if (name == NULL) {
+#ifdef YADL_NO_WIRINGPI
+		return &sim_hw_backend;
+#else
+		return &wiringpi_hw_backend;
+#endif
+	} else if (strcmp(name, "sim") == 0)
+		return &sim_hw_backend;
+	else if (strcmp(name, "wiringpi") == 0 ||
+		 strcmp(name, "gpiochip") == 0) {
+#ifdef YADL_NO_WIRINGPI
+		fprintf(stderr, "yadl was compiled without wiringPi support\n");
+		exit(1);
+#else
+		if (strcmp(name, "gpiochip") == 0)
+			return &gpiochip_hw_backend;
+		return &wiringpi_hw_backend;
+#endif
+	}
+
+	fprintf(stderr, "Unknown hardware backend '%s'\n", name);
+	exit(1);
+}
+
+typedef struct hw_isr_arg_tag {
+	void (*handler)(void *arg);
+	void *arg;
+} hw_isr_arg;
+
+static hw_isr_arg _isr_args[HW_MAX_ISR_ARGS];
+static int _num_isr_args;
+
+#define HW_ISR_TRAMPOLINE(n) \
+	static void _isr_trampoline_##n(void) \
+	{ \
+		_isr_args[n].handler(_isr_args[n].arg); \
+	}
+
+HW_ISR_TRAMPOLINE(0)
+HW_ISR_TRAMPOLINE(1)
+HW_ISR_TRAMPOLINE(2)
+HW_ISR_TRAMPOLINE(3)
+HW_ISR_TRAMPOLINE(4)
+HW_ISR_TRAMPOLINE(5)
+HW_ISR_TRAMPOLINE(6)
+HW_ISR_TRAMPOLINE(7)
+HW_ISR_TRAMPOLINE(8)
+HW_ISR_TRAMPOLINE(9)
+HW_ISR_TRAMPOLINE(10)
+HW_ISR_TRAMPOLINE(11)
+HW_ISR_TRAMPOLINE(12)
+HW_ISR_TRAMPOLINE(13)
+HW_ISR_TRAMPOLINE(14)
+HW_ISR_TRAMPOLINE(15)
+
+static void (*_isr_trampolines[HW_MAX_ISR_ARGS])(void) = {
+	&_isr_trampoline_0, &_isr_trampoline_1, &_isr_trampoline_2,
+	&_isr_trampoline_3, &_isr_trampoline_4, &_isr_trampoline_5,
+	&_isr_trampoline_6, &_isr_trampoline_7, &_isr_trampoline_8,
+	&_isr_trampoline_9, &_isr_trampoline_10, &_isr_trampoline_11,
+	&_isr_trampoline_12, &_isr_trampoline_13, &_isr_trampoline_14,
+	&_isr_trampoline_15
+};
+
+int hw_isr_with_arg(hw_backend *hw, int pin, int edge,
+		    void (*handler)(void *arg), void *arg)
+{
+	if (_num_isr_args == HW_MAX_ISR_ARGS) {
+		fprintf(stderr, "Only %d interrupt handlers are supported\n",
+			HW_MAX_ISR_ARGS);
+		exit(1);
+	}
+
+	/* The slot is filled in before the handler can be called */
+	int idx = _num_isr_args++;
+
+	_isr_args[idx].handler = handler;
+	_isr_args[idx].arg = arg;
+
+	return hw->isr(pin, edge, _isr_trampolines[idx]);
+}
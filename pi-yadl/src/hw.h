@@ -0,0 +1,154 @@
+/*
+ * hw.h - Hardware access layer used by the sensors and ADCs.
+ *
+ * Copyright (C) 2016-2017 Brian Masney <masneyb@onstation.org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include <stdint.h>
+
+/* These have the same values as the wiringPi constants */
+#define HW_INPUT		0
+#define HW_OUTPUT		1
+
+#define HW_LOW			0
+#define HW_HIGH			1
+
+#define HW_EDGE_FALLING		1
+#define HW_EDGE_RISING		2
+#define HW_EDGE_BOTH		3
+
+#define HW_WAIT_FOREVER		UINT64_MAX
+
+/* The number of handlers that can be installed with hw_isr_with_arg() */
+#define HW_MAX_ISR_ARGS		16
+
+#define DEFAULT_GPIO_CHIP	"/dev/gpiochip0"
+
+typedef struct hw_options_tag {
+	/* Recorded data that the simulated backend replays */
+	char *trace_file;
+
+	/*
+	 * The gpiochip backend requests the interrupt pins from gpio_chip.
+	 * The kernel drops the edges that follow another edge within
+	 * gpio_debounce_usecs when it is not 0.
+	 */
+	char *gpio_chip;
+	int gpio_debounce_usecs;
+} hw_options;
+
+/*
+ * The sensors and ADCs only talk to the hardware through one of these so
+ * that the program can also be ran against recorded data on a machine
+ * that is not a Pi. The functions follow the wiringPi API.
+ */
+typedef struct hw_backend_tag {
+	int (*setup)(hw_options *opts);
+
+	void (*pin_mode)(int pin, int mode);
+	int (*digital_read)(int pin);
+	void (*digital_write)(int pin, int value);
+	int (*isr)(int pin, int edge, void (*handler)(void));
+
+	/*
+	 * The monotonic_usecs() time of the edge that the isr() handler is
+	 * called for. This is when the kernel saw the edge with the gpiochip
+	 * backend and when the handler started running otherwise.
+	 */
+	uint64_t (*event_usecs)(void);
+
+	/* The level of the pin right after that edge */
+	int (*event_level)(int pin);
+
+	int (*i2c_setup)(int address);
+	int (*i2c_read)(int fd);
+	int (*i2c_write)(int fd, int data);
+	int (*i2c_read_reg8)(int fd, int reg);
+	int (*i2c_read_reg16)(int fd, int reg);
+	int (*i2c_write_reg8)(int fd, int reg, int data);
+
+	/*
+	 * Reads len (up to 32) registers starting at reg in a single
+	 * transaction. Returns the number of bytes read or -1.
+	 */
+	int (*i2c_read_block)(int fd, int reg, uint8_t *data, int len);
+
+	int (*mcp3002_setup)(int pin_base, int spi_channel);
+	int (*mcp3004_setup)(int pin_base, int spi_channel);
+	int (*pcf8591_setup)(int pin_base, int i2c_address);
+	int (*analog_read)(int pin);
+
+	void (*delay)(unsigned int millis);
+	void (*delay_microseconds)(unsigned int usecs);
+	unsigned int (*millis)(void);
+	unsigned int (*micros)(void);
+
+	/*
+	 * A monotonic clock that does not wrap like millis() and micros().
+	 * sleep_until() may return early when a signal arrives.
+	 */
+	uint64_t (*monotonic_usecs)(void);
+	void (*sleep_until)(uint64_t monotonic_usecs);
+
+	/*
+	 * sleep_until() that also returns once an isr() handler calls
+	 * notify_event(). A notification that arrives while the thread is
+	 * not waiting makes the next wait_event() return right away.
+	 * HW_WAIT_FOREVER only returns for an event or a signal.
+	 */
+	void (*wait_event)(uint64_t monotonic_usecs);
+	void (*notify_event)(void);
+
+	/* Microseconds since the epoch */
+	uint64_t (*realtime_usecs)(void);
+
+	/* Threads that call delay() must be started with this */
+	int (*thread_create)(void *(*func)(void *), void *arg);
+} hw_backend;
+
+#ifndef YADL_NO_WIRINGPI
+extern hw_backend wiringpi_hw_backend;
+
+/* wiringPi with the interrupts read from the GPIO character device */
+extern hw_backend gpiochip_hw_backend;
+
+/* Called after wiringPiSetup() */
+int gpiochip_setup(hw_options *opts);
+
+int gpiochip_isr(int pin, int edge, void (*handler)(void));
+
+int gpiochip_event_level(int pin);
+#endif
+
+extern hw_backend sim_hw_backend;
+
+/*
+ * The number of I2C transactions that the calling thread made. Each of the
+ * i2c_ functions above other than i2c_setup() is one transaction.
+ */
+extern _Thread_local uint64_t hw_i2c_transactions;
+
+hw_backend *get_hw_backend(char *name);
+
+/*
+ * isr() handlers don't take an argument. This passes arg to the handler
+ * through one of HW_MAX_ISR_ARGS fixed functions and exits when they are
+ * all used.
+ */
+int hw_isr_with_arg(hw_backend *hw, int pin, int edge,
+		    void (*handler)(void *arg), void *arg);
@@ -0,0 +1,140 @@
+/*
+ * hw_gpiochip.c - Hardware access on the Pi with GPIO line events.
+ *
+ * Copyright (C) 2016-2017 Brian Masney <masneyb@onstation.org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <linux/gpio.h>
+#include <sys/ioctl.h>
+#include <wiringPi.h>
+#include "gpio_events.h"
+#include "hw.h"
+
+/*
+ * wiringPiISR() starts a thread for each pin that calls the handler after
+ * it wakes up, so the handler only knows when it was scheduled. Here the
+ * pins are requested as line events from the GPIO character device. The
+ * kernel timestamps each edge, queues them until they are read and the
+ * edges of all of the pins are read in batches by one thread.
+ */
+
+static char *_gpiochip_name;
+static int _gpiochip_fd = -1;
+static int _gpiochip_debounce_usecs;
+static gpio_events _gpiochip_events;
+static int _gpiochip_thread_started;
+
+int gpiochip_setup(hw_options *opts)
+{
+	_gpiochip_name = opts->gpio_chip != NULL ? opts->gpio_chip :
+		DEFAULT_GPIO_CHIP;
+	_gpiochip_debounce_usecs = opts->gpio_debounce_usecs;
+
+	_gpiochip_fd = open(_gpiochip_name, O_RDWR | O_CLOEXEC);
+	if (_gpiochip_fd < 0) {
+		fprintf(stderr, "Error opening %s: %s\n", _gpiochip_name,
+			strerror(errno));
+		return -1;
+	}
+
+	return gpio_events_init(&_gpiochip_events);
+}
+
+static uint64_t _gpiochip_edge_flags(int edge)
+{
+	switch (edge) {
+	case HW_EDGE_FALLING:
+		return GPIO_V2_LINE_FLAG_EDGE_FALLING;
+	case HW_EDGE_RISING:
+		return GPIO_V2_LINE_FLAG_EDGE_RISING;
+	default:
+		return GPIO_V2_LINE_FLAG_EDGE_RISING |
+			GPIO_V2_LINE_FLAG_EDGE_FALLING;
+	}
+}
+
+int gpiochip_event_level(__attribute__((__unused__)) int pin)
+{
+	return gpio_events_level();
+}
+
+/* Exits on errors like wiringPiISR() */
+int gpiochip_isr(int pin, int edge, void (*handler)(void))
+{
+	struct gpio_v2_line_request req;
+
+	memset(&req, 0, sizeof(req));
+	req.offsets[0] = wpiPinToGpio(pin);
+	req.num_lines = 1;
+	strncpy(req.consumer, "yadl", sizeof(req.consumer) - 1);
+	req.config.flags = GPIO_V2_LINE_FLAG_INPUT |
+		_gpiochip_edge_flags(edge);
+
+	if (_gpiochip_debounce_usecs > 0) {
+		req.config.num_attrs = 1;
+		req.config.attrs[0].attr.id = GPIO_V2_LINE_ATTR_ID_DEBOUNCE;
+		req.config.attrs[0].attr.debounce_period_us =
+			_gpiochip_debounce_usecs;
+		req.config.attrs[0].mask = 1;
+	}
+
+	if (ioctl(_gpiochip_fd, GPIO_V2_GET_LINE_IOCTL, &req) < 0) {
+		fprintf(stderr, "Error requesting line %u of %s for pin %d: %s\n",
+			req.offsets[0], _gpiochip_name, pin, strerror(errno));
+		exit(1);
+	}
+
+	if (gpio_events_add(&_gpiochip_events, req.fd, handler) < 0)
+		exit(1);
+
+	if (!_gpiochip_thread_started) {
+		pthread_t tid;
+
+		/*
+		 * Keep SIGUSR1 on the main thread so that it interrupts the
+		 * sleep in the main loop instead of the wait for the edges.
+		 */
+		sigset_t mask, old_mask;
+
+		sigemptyset(&mask);
+		sigaddset(&mask, SIGUSR1);
+		pthread_sigmask(SIG_BLOCK, &mask, &old_mask);
+
+		int ret = pthread_create(&tid, NULL, &gpio_events_thread,
+					 &_gpiochip_events);
+
+		pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
+
+		if (ret != 0) {
+			fprintf(stderr, "Error starting the GPIO event thread: %s\n",
+				strerror(ret));
+			exit(1);
+		}
+		_gpiochip_thread_started = 1;
+	}
+
+	return 0;
+}
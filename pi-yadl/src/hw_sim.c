@@ -0,0 +1,917 @@
+/*
+ * hw_sim.c - Simulated hardware that replays a recorded trace file.
+ *
+ * Copyright (C) 2016-2017 Brian Masney <masneyb@onstation.org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/*
+ * Time is simulated and only moves forward when a thread calls one of the
+ * delay functions, so a run against the same trace file always produces
+ * the same readings and does not take any wall clock time. digital_read()
+ * costs 1 microsecond so that the busy loops in the DHT driver see about
+ * the same number of iterations as they do on a Pi.
+ *
+ * When several threads use the simulated clock, the clock only advances
+ * once all of them are waiting in a delay, and then jumps to the earliest
+ * wakeup time or the next interrupt pulse, whichever comes first. Only one
+ * thread runs at a time. The simulated wall clock starts at the real time
+ * when the backend is set up.
+ *
+ * The trace file contains one entry per line. Blank lines and lines
+ * starting with # are ignored. Numbers are decimal unless noted.
+ *
+ *   pin <pin> <initial level> [repeat] <usecs> <usecs> ...
+ *	Waveform for a digital pin. The level alternates after each duration,
+ *	and the pin goes back to the initial level after the last one unless
+ *	repeat is given. The waveform restarts each time the pin is set to
+ *	INPUT mode.
+ *
+ *   pulses <pin> at <usecs> <usecs> ...
+ *   pulses <pin> every <usecs> [ from <usecs> ] [ until <usecs> ]
+ *	Interrupt pulses for a pin, using the time since startup. Each pulse
+ *	calls the interrupt handler once. The handler sees the level of the
+ *	pin's waveform at the time of the pulse as the level after the edge.
+ *
+ *   i2c <hex address> <hex register> <hex byte> <hex byte> ...
+ *	Register map for an I2C device starting at the given register.
+ *
+ *   i2c_on_write <hex address> <hex register> <hex value> <hex register> <hex byte> ...
+ *	When value is written to the first register, the bytes are copied
+ *	into the register map starting at the second register. This is used
+ *	for sensors that put the result of different commands in the same
+ *	registers.
+ *
+ *   adc <channel> <code> <code> ...
+ *	Codes returned by successive analog reads from an ADC channel. The
+ *	codes are repeated once the end of the list is reached.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "hw.h"
+
+#define SIM_MAX_THREADS		16
+#define SIM_MAX_PINS		64
+#define SIM_MAX_I2C_DEVICES	16
+#define SIM_MAX_ADC_CHANNELS	8
+#define SIM_MAX_I2C_TRIGGERS	8
+#define SIM_I2C_FD_BASE		1000
+#define SIM_I2C_BLOCK_MAX	32
+#define SIM_NOT_SLEEPING	UINT64_MAX
+#define SIM_WAIT_FOREVER	(UINT64_MAX - 1)
+
+typedef struct sim_pin_tag {
+	int initial_level;
+	int repeat;
+	unsigned int *durations;
+	int num_durations;
+	uint64_t total_usecs;
+	uint64_t armed_usecs;
+
+	uint64_t *pulses;
+	int num_pulses;
+	uint64_t pulse_every;
+	uint64_t pulse_next;
+	uint64_t pulse_until;
+	int pulse_idx;
+	void (*handler)(void);
+} sim_pin;
+
+typedef struct sim_i2c_trigger_tag {
+	uint8_t reg;
+	uint8_t value;
+	uint8_t start;
+	uint8_t bytes[256];
+	int num_bytes;
+} sim_i2c_trigger;
+
+typedef struct sim_i2c_device_tag {
+	int address;
+	uint8_t regs[256];
+	uint8_t pointer;
+	sim_i2c_trigger triggers[SIM_MAX_I2C_TRIGGERS];
+	int num_triggers;
+} sim_i2c_device;
+
+typedef struct sim_adc_channel_tag {
+	int *codes;
+	int num_codes;
+	int idx;
+} sim_adc_channel;
+
+typedef struct sim_thread_start_tag {
+	void *(*func)(void *);
+	void *arg;
+	int slot;
+} sim_thread_start;
+
+static pthread_mutex_t _sim_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t _sim_cond = PTHREAD_COND_INITIALIZER;
+
+static uint64_t _sim_usecs;
+static uint64_t _sim_realtime_start_usecs;
+static uint64_t _sim_wakeups[SIM_MAX_THREADS];
+static int _sim_num_slots;
+static int _sim_num_threads;
+static int _sim_num_sleeping;
+static _Thread_local int _sim_slot = -1;
+
+/*
+ * The thread that is in wait_event(), and whether notify_event() was
+ * called while no thread was waiting.
+ */
+static int _sim_event_slot = -1;
+static int _sim_event_pending;
+
+static sim_pin _sim_pins[SIM_MAX_PINS];
+static sim_i2c_device _sim_i2c_devices[SIM_MAX_I2C_DEVICES];
+static int _sim_num_i2c_devices;
+static sim_adc_channel _sim_adc_channels[SIM_MAX_ADC_CHANNELS];
+static int _sim_adc_pin_base = -1;
+
+/* Called with _sim_mutex held */
+static int _sim_add_thread(void)
+{
+	if (_sim_num_slots == SIM_MAX_THREADS) {
+		fprintf(stderr, "sim: Too many threads\n");
+		exit(1);
+	}
+
+	_sim_num_threads++;
+	_sim_wakeups[_sim_num_slots] = SIM_NOT_SLEEPING;
+	return _sim_num_slots++;
+}
+
+/*
+ * Returns the pin with the earliest pending interrupt pulse, or NULL if
+ * there are none. Called with _sim_mutex held.
+ */
+static sim_pin *_sim_next_pulse(uint64_t *when)
+{
+	sim_pin *next = NULL;
+
+	for (int i = 0; i < SIM_MAX_PINS; i++) {
+		sim_pin *pin = &_sim_pins[i];
+		uint64_t pulse;
+
+		if (pin->handler == NULL)
+			continue;
+
+		if (pin->pulse_every > 0) {
+			if (pin->pulse_next > pin->pulse_until)
+				continue;
+			pulse = pin->pulse_next;
+		} else if (pin->pulse_idx < pin->num_pulses) {
+			pulse = pin->pulses[pin->pulse_idx];
+		} else {
+			continue;
+		}
+
+		if (next == NULL || pulse < *when) {
+			next = pin;
+			*when = pulse;
+		}
+	}
+
+	return next;
+}
+
+/* Called with _sim_mutex held */
+static void _sim_wait(uint64_t wakeup)
+{
+	_sim_wakeups[_sim_slot] = wakeup;
+	_sim_num_sleeping++;
+
+	while (_sim_wakeups[_sim_slot] != SIM_NOT_SLEEPING) {
+		if (_sim_num_sleeping < _sim_num_threads) {
+			pthread_cond_wait(&_sim_cond, &_sim_mutex);
+			continue;
+		}
+
+		/* Everyone is waiting so it's safe to move the clock */
+		uint64_t next = SIM_NOT_SLEEPING;
+
+		for (int i = 0; i < _sim_num_slots; i++) {
+			if (_sim_wakeups[i] < next)
+				next = _sim_wakeups[i];
+		}
+
+		uint64_t pulse = 0;
+		sim_pin *pin = _sim_next_pulse(&pulse);
+
+		if (pin == NULL && next == SIM_WAIT_FOREVER) {
+			fprintf(stderr, "sim: Waiting for an interrupt pulse that is not in the trace\n");
+			exit(1);
+		}
+
+		if (pin != NULL && pulse <= next) {
+			if (pulse > _sim_usecs)
+				_sim_usecs = pulse;
+
+			if (pin->pulse_every > 0)
+				pin->pulse_next += pin->pulse_every;
+			else
+				pin->pulse_idx++;
+
+			/* The handler will call event_usecs() */
+			void (*handler)(void) = pin->handler;
+
+			pthread_mutex_unlock(&_sim_mutex);
+			handler();
+			pthread_mutex_lock(&_sim_mutex);
+			continue;
+		}
+
+		_sim_usecs = next;
+
+		/*
+		 * Only wake up one thread at a time so that threads that wake
+		 * up at the same time always run in the same order.
+		 */
+		for (int i = 0; i < _sim_num_slots; i++) {
+			if (_sim_wakeups[i] == next) {
+				_sim_wakeups[i] = SIM_NOT_SLEEPING;
+				_sim_num_sleeping--;
+				break;
+			}
+		}
+
+		pthread_cond_broadcast(&_sim_cond);
+	}
+}
+
+static void _sim_sleep_until(uint64_t wakeup)
+{
+	pthread_mutex_lock(&_sim_mutex);
+
+	if (_sim_slot < 0)
+		_sim_slot = _sim_add_thread();
+
+	if (wakeup > _sim_usecs)
+		_sim_wait(wakeup);
+
+	pthread_mutex_unlock(&_sim_mutex);
+}
+
+static void _sim_wait_event(uint64_t wakeup)
+{
+	pthread_mutex_lock(&_sim_mutex);
+
+	if (_sim_slot < 0)
+		_sim_slot = _sim_add_thread();
+
+	if (wakeup == HW_WAIT_FOREVER)
+		wakeup = SIM_WAIT_FOREVER;
+
+	if (!_sim_event_pending && wakeup > _sim_usecs) {
+		_sim_event_slot = _sim_slot;
+		_sim_wait(wakeup);
+		_sim_event_slot = -1;
+	}
+
+	_sim_event_pending = 0;
+	pthread_mutex_unlock(&_sim_mutex);
+}
+
+/*
+ * Called from an interrupt handler, which runs while all of the other
+ * threads are waiting. The waiting thread is woken up at the time of the
+ * pulse.
+ */
+static void _sim_notify_event(void)
+{
+	pthread_mutex_lock(&_sim_mutex);
+
+	if (_sim_event_slot >= 0 &&
+	    _sim_wakeups[_sim_event_slot] != SIM_NOT_SLEEPING) {
+		_sim_wakeups[_sim_event_slot] = SIM_NOT_SLEEPING;
+		_sim_num_sleeping--;
+		pthread_cond_broadcast(&_sim_cond);
+	} else {
+		_sim_event_pending = 1;
+	}
+
+	pthread_mutex_unlock(&_sim_mutex);
+}
+
+static uint64_t _sim_now(void)
+{
+	pthread_mutex_lock(&_sim_mutex);
+	uint64_t now = _sim_usecs;
+
+	pthread_mutex_unlock(&_sim_mutex);
+	return now;
+}
+
+static void _sim_delay(unsigned int millis)
+{
+	_sim_sleep_until(_sim_now() + millis * 1000ULL);
+}
+
+static void _sim_delay_microseconds(unsigned int usecs)
+{
+	_sim_sleep_until(_sim_now() + usecs);
+}
+
+static unsigned int _sim_millis(void)
+{
+	return _sim_now() / 1000;
+}
+
+static unsigned int _sim_micros(void)
+{
+	return _sim_now();
+}
+
+static uint64_t _sim_realtime_usecs(void)
+{
+	return _sim_realtime_start_usecs + _sim_now();
+}
+
+static sim_pin *_sim_get_pin(int pin)
+{
+	if (pin < 0 || pin >= SIM_MAX_PINS)
+		return NULL;
+	return &_sim_pins[pin];
+}
+
+static void _sim_pin_mode(int pin, int mode)
+{
+	sim_pin *p = _sim_get_pin(pin);
+
+	if (p == NULL || mode != HW_INPUT)
+		return;
+
+	pthread_mutex_lock(&_sim_mutex);
+	p->armed_usecs = _sim_usecs;
+	pthread_mutex_unlock(&_sim_mutex);
+}
+
+/* Doesn't move the clock so that interrupt handlers can call it */
+static int _sim_pin_level(int pin)
+{
+	sim_pin *p = _sim_get_pin(pin);
+
+	if (p == NULL)
+		return HW_LOW;
+
+	pthread_mutex_lock(&_sim_mutex);
+	uint64_t elapsed = _sim_usecs - p->armed_usecs;
+
+	pthread_mutex_unlock(&_sim_mutex);
+
+	if (p->repeat && p->total_usecs > 0)
+		elapsed %= p->total_usecs;
+
+	int level = p->initial_level;
+
+	for (int i = 0; i < p->num_durations; i++) {
+		if (elapsed < p->durations[i])
+			return level;
+
+		elapsed -= p->durations[i];
+		level = !level;
+	}
+
+	return p->initial_level;
+}
+
+static int _sim_digital_read(int pin)
+{
+	_sim_delay_microseconds(1);
+
+	return _sim_pin_level(pin);
+}
+
+static void _sim_digital_write(__attribute__((__unused__)) int pin,
+			       __attribute__((__unused__)) int value)
+{
+}
+
+static int _sim_isr(int pin, __attribute__((__unused__)) int edge,
+		    void (*handler)(void))
+{
+	sim_pin *p = _sim_get_pin(pin);
+
+	if (p == NULL)
+		return -1;
+
+	pthread_mutex_lock(&_sim_mutex);
+	p->handler = handler;
+
+	/* Pulses before the handler was installed are lost like on the Pi */
+	while (p->pulse_idx < p->num_pulses &&
+	       p->pulses[p->pulse_idx] <= _sim_usecs)
+		p->pulse_idx++;
+
+	while (p->pulse_every > 0 && p->pulse_next <= _sim_usecs)
+		p->pulse_next += p->pulse_every;
+
+	pthread_mutex_unlock(&_sim_mutex);
+
+	return 0;
+}
+
+static sim_i2c_device *_sim_get_i2c_device(int fd)
+{
+	int idx = fd - SIM_I2C_FD_BASE;
+
+	if (idx < 0 || idx >= _sim_num_i2c_devices)
+		return NULL;
+	return &_sim_i2c_devices[idx];
+}
+
+static int _sim_i2c_setup(int address)
+{
+	for (int i = 0; i < _sim_num_i2c_devices; i++) {
+		if (_sim_i2c_devices[i].address == address)
+			return SIM_I2C_FD_BASE + i;
+	}
+
+	fprintf(stderr, "sim: No I2C device at address %x in the trace file\n",
+		address);
+	return -1;
+}
+
+static int _sim_i2c_read(int fd)
+{
+	sim_i2c_device *dev = _sim_get_i2c_device(fd);
+
+	if (dev == NULL)
+		return -1;
+
+	hw_i2c_transactions++;
+	return dev->regs[dev->pointer++];
+}
+
+static int _sim_i2c_write(int fd, int data)
+{
+	sim_i2c_device *dev = _sim_get_i2c_device(fd);
+
+	if (dev == NULL)
+		return -1;
+
+	hw_i2c_transactions++;
+	dev->pointer = data;
+	return 0;
+}
+
+static int _sim_i2c_read_reg8(int fd, int reg)
+{
+	sim_i2c_device *dev = _sim_get_i2c_device(fd);
+
+	if (dev == NULL)
+		return -1;
+
+	hw_i2c_transactions++;
+	return dev->regs[reg & 0xff];
+}
+
+/* SMBus word reads are little endian */
+static int _sim_i2c_read_reg16(int fd, int reg)
+{
+	sim_i2c_device *dev = _sim_get_i2c_device(fd);
+
+	if (dev == NULL)
+		return -1;
+
+	hw_i2c_transactions++;
+	return dev->regs[reg & 0xff] | (dev->regs[(reg + 1) & 0xff] << 8);
+}
+
+static int _sim_i2c_read_block(int fd, int reg, uint8_t *data, int len)
+{
+	sim_i2c_device *dev = _sim_get_i2c_device(fd);
+
+	if (dev == NULL || len < 0 || len > SIM_I2C_BLOCK_MAX)
+		return -1;
+
+	hw_i2c_transactions++;
+	for (int i = 0; i < len; i++)
+		data[i] = dev->regs[(reg + i) & 0xff];
+
+	return len;
+}
+
+static int _sim_i2c_write_reg8(int fd, int reg, int data)
+{
+	sim_i2c_device *dev = _sim_get_i2c_device(fd);
+
+	if (dev == NULL)
+		return -1;
+
+	hw_i2c_transactions++;
+	dev->regs[reg & 0xff] = data;
+
+	for (int i = 0; i < dev->num_triggers; i++) {
+		sim_i2c_trigger *trig = &dev->triggers[i];
+
+		if (trig->reg != (reg & 0xff) || trig->value != (data & 0xff))
+			continue;
+
+		for (int j = 0; j < trig->num_bytes; j++)
+			dev->regs[(trig->start + j) & 0xff] = trig->bytes[j];
+	}
+
+	return 0;
+}
+
+static int _sim_adc_setup(int pin_base, __attribute__((__unused__)) int bus)
+{
+	_sim_adc_pin_base = pin_base;
+	return 0;
+}
+
+static int _sim_analog_read(int pin)
+{
+	int channel = pin - _sim_adc_pin_base;
+
+	if (_sim_adc_pin_base < 0 || channel < 0 ||
+	    channel >= SIM_MAX_ADC_CHANNELS)
+		return 0;
+
+	sim_adc_channel *chan = &_sim_adc_channels[channel];
+
+	if (chan->num_codes == 0)
+		return 0;
+
+	pthread_mutex_lock(&_sim_mutex);
+	int code = chan->codes[chan->idx];
+
+	chan->idx = (chan->idx + 1) % chan->num_codes;
+	pthread_mutex_unlock(&_sim_mutex);
+
+	return code;
+}
+
+static void *_sim_thread_start(void *arg)
+{
+	sim_thread_start start = *(sim_thread_start *) arg;
+
+	free(arg);
+	_sim_slot = start.slot;
+
+	void *ret = start.func(start.arg);
+
+	/* Let the clock move without this thread */
+	pthread_mutex_lock(&_sim_mutex);
+	_sim_num_threads--;
+	pthread_cond_broadcast(&_sim_cond);
+	pthread_mutex_unlock(&_sim_mutex);
+
+	return ret;
+}
+
+static int _sim_thread_create(void *(*func)(void *), void *arg)
+{
+	sim_thread_start *start = malloc(sizeof(*start));
+	pthread_t tid;
+
+	start->func = func;
+	start->arg = arg;
+
+	/*
+	 * Count the thread now so that the clock doesn't move before it gets
+	 * a chance to run.
+	 */
+	pthread_mutex_lock(&_sim_mutex);
+	start->slot = _sim_add_thread();
+	pthread_mutex_unlock(&_sim_mutex);
+
+	return pthread_create(&tid, NULL, _sim_thread_start, start);
+}
+
+static int _sim_parse_number(char *tok, int base, unsigned long long *ret)
+{
+	char *end;
+
+	if (tok == NULL)
+		return -1;
+
+	errno = 0;
+	*ret = strtoull(tok, &end, base);
+	return errno != 0 || *end != '\0' ? -1 : 0;
+}
+
+static int _sim_parse_pin(char **saveptr)
+{
+	unsigned long long pin;
+
+	if (_sim_parse_number(strtok_r(NULL, " \t", saveptr), 10, &pin) < 0 ||
+	    pin >= SIM_MAX_PINS)
+		return -1;
+	return pin;
+}
+
+static int _sim_parse_waveform(char **saveptr)
+{
+	int pin = _sim_parse_pin(saveptr);
+	unsigned long long val;
+
+	if (pin < 0)
+		return -1;
+
+	sim_pin *p = &_sim_pins[pin];
+
+	if (_sim_parse_number(strtok_r(NULL, " \t", saveptr), 10, &val) < 0)
+		return -1;
+	p->initial_level = val != 0;
+
+	for (char *tok = strtok_r(NULL, " \t", saveptr); tok != NULL;
+	     tok = strtok_r(NULL, " \t", saveptr)) {
+		if (strcmp(tok, "repeat") == 0 && p->num_durations == 0) {
+			p->repeat = 1;
+			continue;
+		}
+
+		if (_sim_parse_number(tok, 10, &val) < 0)
+			return -1;
+
+		p->num_durations++;
+		p->durations = realloc(p->durations,
+				       sizeof(unsigned int) * p->num_durations);
+		p->durations[p->num_durations - 1] = val;
+		p->total_usecs += val;
+	}
+
+	return 0;
+}
+
+static int _sim_parse_pulses(char **saveptr)
+{
+	int pin = _sim_parse_pin(saveptr);
+	char *mode = strtok_r(NULL, " \t", saveptr);
+	unsigned long long val;
+
+	if (pin < 0 || mode == NULL)
+		return -1;
+
+	sim_pin *p = &_sim_pins[pin];
+
+	if (strcmp(mode, "every") == 0) {
+		if (_sim_parse_number(strtok_r(NULL, " \t", saveptr), 10,
+				      &val) < 0 || val == 0)
+			return -1;
+
+		p->pulse_every = val;
+		p->pulse_next = val;
+		p->pulse_until = UINT64_MAX;
+
+		for (char *tok = strtok_r(NULL, " \t", saveptr); tok != NULL;
+		     tok = strtok_r(NULL, " \t", saveptr)) {
+			if (_sim_parse_number(strtok_r(NULL, " \t", saveptr),
+					      10, &val) < 0)
+				return -1;
+
+			if (strcmp(tok, "from") == 0)
+				p->pulse_next = val;
+			else if (strcmp(tok, "until") == 0)
+				p->pulse_until = val;
+			else
+				return -1;
+		}
+
+		return 0;
+	} else if (strcmp(mode, "at") != 0) {
+		return -1;
+	}
+
+	for (char *tok = strtok_r(NULL, " \t", saveptr); tok != NULL;
+	     tok = strtok_r(NULL, " \t", saveptr)) {
+		if (_sim_parse_number(tok, 10, &val) < 0)
+			return -1;
+
+		p->num_pulses++;
+		p->pulses = realloc(p->pulses,
+				    sizeof(uint64_t) * p->num_pulses);
+		p->pulses[p->num_pulses - 1] = val;
+	}
+
+	return 0;
+}
+
+static sim_i2c_device *_sim_parse_i2c_device(char **saveptr)
+{
+	unsigned long long address;
+
+	if (_sim_parse_number(strtok_r(NULL, " \t", saveptr), 16,
+			      &address) < 0)
+		return NULL;
+
+	for (int i = 0; i < _sim_num_i2c_devices; i++) {
+		if (_sim_i2c_devices[i].address == (int) address)
+			return &_sim_i2c_devices[i];
+	}
+
+	if (_sim_num_i2c_devices == SIM_MAX_I2C_DEVICES)
+		return NULL;
+
+	sim_i2c_device *dev = &_sim_i2c_devices[_sim_num_i2c_devices++];
+
+	dev->address = address;
+	return dev;
+}
+
+/* Parses the remaining hex bytes on the line. Returns the number of bytes. */
+static int _sim_parse_bytes(char **saveptr, uint8_t *bytes, int max_bytes)
+{
+	unsigned long long val;
+	int num_bytes = 0;
+
+	for (char *tok = strtok_r(NULL, " \t", saveptr); tok != NULL;
+	     tok = strtok_r(NULL, " \t", saveptr)) {
+		if (_sim_parse_number(tok, 16, &val) < 0 || val > 0xff ||
+		    num_bytes == max_bytes)
+			return -1;
+
+		bytes[num_bytes++] = val;
+	}
+
+	return num_bytes;
+}
+
+static int _sim_parse_i2c(char **saveptr)
+{
+	sim_i2c_device *dev = _sim_parse_i2c_device(saveptr);
+	unsigned long long reg;
+	uint8_t bytes[256];
+
+	if (dev == NULL ||
+	    _sim_parse_number(strtok_r(NULL, " \t", saveptr), 16, &reg) < 0 ||
+	    reg > 0xff)
+		return -1;
+
+	int num_bytes = _sim_parse_bytes(saveptr, bytes, 256 - reg);
+
+	if (num_bytes < 0)
+		return -1;
+
+	memcpy(&dev->regs[reg], bytes, num_bytes);
+	return 0;
+}
+
+static int _sim_parse_i2c_trigger(char **saveptr)
+{
+	sim_i2c_device *dev = _sim_parse_i2c_device(saveptr);
+	unsigned long long reg, value, start;
+
+	if (dev == NULL || dev->num_triggers == SIM_MAX_I2C_TRIGGERS ||
+	    _sim_parse_number(strtok_r(NULL, " \t", saveptr), 16, &reg) < 0 ||
+	    _sim_parse_number(strtok_r(NULL, " \t", saveptr), 16,
+			      &value) < 0 ||
+	    _sim_parse_number(strtok_r(NULL, " \t", saveptr), 16,
+			      &start) < 0 ||
+	    reg > 0xff || value > 0xff || start > 0xff)
+		return -1;
+
+	sim_i2c_trigger *trig = &dev->triggers[dev->num_triggers];
+
+	trig->reg = reg;
+	trig->value = value;
+	trig->start = start;
+	trig->num_bytes = _sim_parse_bytes(saveptr, trig->bytes, 256 - start);
+	if (trig->num_bytes < 0)
+		return -1;
+
+	dev->num_triggers++;
+	return 0;
+}
+
+static int _sim_parse_adc(char **saveptr)
+{
+	unsigned long long channel, val;
+
+	if (_sim_parse_number(strtok_r(NULL, " \t", saveptr), 10,
+			      &channel) < 0 || channel >= SIM_MAX_ADC_CHANNELS)
+		return -1;
+
+	sim_adc_channel *chan = &_sim_adc_channels[channel];
+
+	for (char *tok = strtok_r(NULL, " \t", saveptr); tok != NULL;
+	     tok = strtok_r(NULL, " \t", saveptr)) {
+		if (_sim_parse_number(tok, 10, &val) < 0)
+			return -1;
+
+		chan->num_codes++;
+		chan->codes = realloc(chan->codes,
+				      sizeof(int) * chan->num_codes);
+		chan->codes[chan->num_codes - 1] = val;
+	}
+
+	return 0;
+}
+
+static int _sim_setup(hw_options *opts)
+{
+	char *trace_file = opts->trace_file;
+
+	/* The thread that sets up the hardware is the main thread */
+	pthread_mutex_lock(&_sim_mutex);
+	_sim_slot = _sim_add_thread();
+	pthread_mutex_unlock(&_sim_mutex);
+
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	_sim_realtime_start_usecs = ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+
+	if (trace_file == NULL)
+		return 0;
+
+	FILE *fd = fopen(trace_file, "r");
+
+	if (fd == NULL) {
+		fprintf(stderr, "Error opening %s: %s\n", trace_file,
+			strerror(errno));
+		return -1;
+	}
+
+	char *line = NULL;
+	size_t line_size = 0;
+	int line_number = 0;
+	int ret = 0;
+
+	while (ret == 0 && getline(&line, &line_size, fd) >= 0) {
+		char *saveptr = NULL;
+
+		line_number++;
+		line[strcspn(line, "\r\n")] = '\0';
+
+		char *type = strtok_r(line, " \t", &saveptr);
+
+		if (type == NULL || type[0] == '#')
+			continue;
+		else if (strcmp(type, "pin") == 0)
+			ret = _sim_parse_waveform(&saveptr);
+		else if (strcmp(type, "pulses") == 0)
+			ret = _sim_parse_pulses(&saveptr);
+		else if (strcmp(type, "i2c") == 0)
+			ret = _sim_parse_i2c(&saveptr);
+		else if (strcmp(type, "i2c_on_write") == 0)
+			ret = _sim_parse_i2c_trigger(&saveptr);
+		else if (strcmp(type, "adc") == 0)
+			ret = _sim_parse_adc(&saveptr);
+		else
+			ret = -1;
+
+		if (ret < 0)
+			fprintf(stderr, "%s:%d: Invalid trace entry\n",
+				trace_file, line_number);
+	}
+
+	free(line);
+	fclose(fd);
+
+	return ret;
+}
+
+hw_backend sim_hw_backend = {
+	.setup = &_sim_setup,
+	.pin_mode = &_sim_pin_mode,
+	.digital_read = &_sim_digital_read,
+	.digital_write = &_sim_digital_write,
+	.isr = &_sim_isr,
+	.event_usecs = &_sim_now,
+	.event_level = &_sim_pin_level,
+	.i2c_setup = &_sim_i2c_setup,
+	.i2c_read = &_sim_i2c_read,
+	.i2c_write = &_sim_i2c_write,
+	.i2c_read_reg8 = &_sim_i2c_read_reg8,
+	.i2c_read_reg16 = &_sim_i2c_read_reg16,
+	.i2c_write_reg8 = &_sim_i2c_write_reg8,
+	.i2c_read_block = &_sim_i2c_read_block,
+	.mcp3002_setup = &_sim_adc_setup,
+	.mcp3004_setup = &_sim_adc_setup,
+	.pcf8591_setup = &_sim_adc_setup,
+	.analog_read = &_sim_analog_read,
+	.delay = &_sim_delay,
+	.delay_microseconds = &_sim_delay_microseconds,
+	.millis = &_sim_millis,
+	.micros = &_sim_micros,
+	.monotonic_usecs = &_sim_now,
+	.sleep_until = &_sim_sleep_until,
+	.wait_event = &_sim_wait_event,
+	.notify_event = &_sim_notify_event,
+	.realtime_usecs = &_sim_realtime_usecs,
+	.thread_create = &_sim_thread_create
+};
@@ -0,0 +1,275 @@
+/*
+ * hw_wiringpi.c - Hardware access on the Pi using wiringPi.
+ *
+ * Copyright (C) 2016-2017 Brian Masney <masneyb@onstation.org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <sys/timerfd.h>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+#include <wiringPi.h>
+#include <wiringPiI2C.h>
+#include <mcp3002.h>
+#include <mcp3004.h>
+#include <pcf8591.h>
+#include "gpio_events.h"
+#include "hw.h"
+
+/* Written by notify_event() and the timer for the wait_event() deadline */
+static int _wiringpi_event_fd = -1;
+static int _wiringpi_timer_fd = -1;
+
+static int _wiringpi_setup(__attribute__((__unused__)) hw_options *opts)
+{
+	_wiringpi_event_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	_wiringpi_timer_fd = timerfd_create(CLOCK_MONOTONIC,
+					    TFD_CLOEXEC | TFD_NONBLOCK);
+	if (_wiringpi_event_fd < 0 || _wiringpi_timer_fd < 0) {
+		fprintf(stderr, "Error creating the event descriptors: %s\n",
+			strerror(errno));
+		return -1;
+	}
+
+	return wiringPiSetup();
+}
+
+static int _gpiochip_backend_setup(hw_options *opts)
+{
+	if (_wiringpi_setup(opts) < 0)
+		return -1;
+
+	return gpiochip_setup(opts);
+}
+
+static int _wiringpi_thread_create(void *(*func)(void *), void *arg)
+{
+	pthread_t tid;
+
+	return pthread_create(&tid, NULL, func, arg);
+}
+
+static uint64_t _wiringpi_clock_usecs(clockid_t clock_id)
+{
+	struct timespec ts;
+
+	clock_gettime(clock_id, &ts);
+	return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static uint64_t _wiringpi_monotonic_usecs(void)
+{
+	return _wiringpi_clock_usecs(CLOCK_MONOTONIC);
+}
+
+static uint64_t _wiringpi_realtime_usecs(void)
+{
+	return _wiringpi_clock_usecs(CLOCK_REALTIME);
+}
+
+/*
+ * The deadline is absolute so that the time spent reading the sensors
+ * does not add up over time.
+ */
+static void _wiringpi_sleep_until(uint64_t monotonic_usecs)
+{
+	struct timespec ts;
+
+	ts.tv_sec = monotonic_usecs / 1000000;
+	ts.tv_nsec = (monotonic_usecs % 1000000) * 1000;
+
+	clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+}
+
+/* Returns 1 if the descriptor was readable */
+static int _wiringpi_clear_fd(int fd)
+{
+	uint64_t value;
+
+	return read(fd, &value, sizeof(value)) == sizeof(value);
+}
+
+/* Returns early with EINTR when a signal arrives like sleep_until() */
+static void _wiringpi_wait_event(uint64_t monotonic_usecs)
+{
+	struct pollfd fds[2];
+	int num_fds = 1;
+
+	fds[0].fd = _wiringpi_event_fd;
+	fds[0].events = POLLIN;
+
+	if (monotonic_usecs != HW_WAIT_FOREVER) {
+		/* A zero deadline would disarm the timer */
+		if (monotonic_usecs <= _wiringpi_monotonic_usecs())
+			return;
+
+		struct itimerspec its;
+
+		memset(&its, 0, sizeof(its));
+		its.it_value.tv_sec = monotonic_usecs / 1000000;
+		its.it_value.tv_nsec = (monotonic_usecs % 1000000) * 1000;
+		timerfd_settime(_wiringpi_timer_fd, TFD_TIMER_ABSTIME, &its,
+				NULL);
+
+		fds[1].fd = _wiringpi_timer_fd;
+		fds[1].events = POLLIN;
+		num_fds++;
+	}
+
+	poll(fds, num_fds, -1);
+
+	_wiringpi_clear_fd(_wiringpi_event_fd);
+	_wiringpi_clear_fd(_wiringpi_timer_fd);
+}
+
+static void _wiringpi_notify_event(void)
+{
+	uint64_t value = 1;
+
+	/* This can only fail when the counter is full, which still wakes up */
+	if (write(_wiringpi_event_fd, &value, sizeof(value)) < 0)
+		return;
+}
+
+static int _wiringpi_i2c_read(int fd)
+{
+	hw_i2c_transactions++;
+	return wiringPiI2CRead(fd);
+}
+
+static int _wiringpi_i2c_write(int fd, int data)
+{
+	hw_i2c_transactions++;
+	return wiringPiI2CWrite(fd, data);
+}
+
+static int _wiringpi_i2c_read_reg8(int fd, int reg)
+{
+	hw_i2c_transactions++;
+	return wiringPiI2CReadReg8(fd, reg);
+}
+
+static int _wiringpi_i2c_read_reg16(int fd, int reg)
+{
+	hw_i2c_transactions++;
+	return wiringPiI2CReadReg16(fd, reg);
+}
+
+static int _wiringpi_i2c_write_reg8(int fd, int reg, int data)
+{
+	hw_i2c_transactions++;
+	return wiringPiI2CWriteReg8(fd, reg, data);
+}
+
+/*
+ * wiringPi does not have a block read. This is the SMBus I2C block read
+ * that i2c_smbus_read_i2c_block_data() does: the register is written and
+ * the bytes are read back after a repeated start.
+ */
+static int _wiringpi_i2c_read_block(int fd, int reg, uint8_t *data, int len)
+{
+	union i2c_smbus_data block;
+	struct i2c_smbus_ioctl_data args;
+
+	if (len < 0 || len > I2C_SMBUS_BLOCK_MAX)
+		return -1;
+
+	block.block[0] = len;
+	args.read_write = I2C_SMBUS_READ;
+	args.command = reg;
+	args.size = I2C_SMBUS_I2C_BLOCK_DATA;
+	args.data = &block;
+
+	hw_i2c_transactions++;
+	if (ioctl(fd, I2C_SMBUS, &args) < 0)
+		return -1;
+
+	memcpy(data, &block.block[1], block.block[0]);
+	return block.block[0];
+}
+
+hw_backend wiringpi_hw_backend = {
+	.setup = &_wiringpi_setup,
+	.pin_mode = &pinMode,
+	.digital_read = &digitalRead,
+	.digital_write = &digitalWrite,
+	.isr = &wiringPiISR,
+	.event_usecs = &_wiringpi_monotonic_usecs,
+	.event_level = &digitalRead,
+	.i2c_setup = &wiringPiI2CSetup,
+	.i2c_read = &_wiringpi_i2c_read,
+	.i2c_write = &_wiringpi_i2c_write,
+	.i2c_read_reg8 = &_wiringpi_i2c_read_reg8,
+	.i2c_read_reg16 = &_wiringpi_i2c_read_reg16,
+	.i2c_write_reg8 = &_wiringpi_i2c_write_reg8,
+	.i2c_read_block = &_wiringpi_i2c_read_block,
+	.mcp3002_setup = &mcp3002Setup,
+	.mcp3004_setup = &mcp3004Setup,
+	.pcf8591_setup = &pcf8591Setup,
+	.analog_read = &analogRead,
+	.delay = &delay,
+	.delay_microseconds = &delayMicroseconds,
+	.millis = &millis,
+	.micros = &micros,
+	.monotonic_usecs = &_wiringpi_monotonic_usecs,
+	.sleep_until = &_wiringpi_sleep_until,
+	.wait_event = &_wiringpi_wait_event,
+	.notify_event = &_wiringpi_notify_event,
+	.realtime_usecs = &_wiringpi_realtime_usecs,
+	.thread_create = &_wiringpi_thread_create
+};
+
+/* Only the interrupts differ from wiringpi_hw_backend */
+hw_backend gpiochip_hw_backend = {
+	.setup = &_gpiochip_backend_setup,
+	.pin_mode = &pinMode,
+	.digital_read = &digitalRead,
+	.digital_write = &digitalWrite,
+	.isr = &gpiochip_isr,
+	.event_usecs = &gpio_events_usecs,
+	.event_level = &gpiochip_event_level,
+	.i2c_setup = &wiringPiI2CSetup,
+	.i2c_read = &_wiringpi_i2c_read,
+	.i2c_write = &_wiringpi_i2c_write,
+	.i2c_read_reg8 = &_wiringpi_i2c_read_reg8,
+	.i2c_read_reg16 = &_wiringpi_i2c_read_reg16,
+	.i2c_write_reg8 = &_wiringpi_i2c_write_reg8,
+	.i2c_read_block = &_wiringpi_i2c_read_block,
+	.mcp3002_setup = &mcp3002Setup,
+	.mcp3004_setup = &mcp3004Setup,
+	.pcf8591_setup = &pcf8591Setup,
+	.analog_read = &analogRead,
+	.delay = &delay,
+	.delay_microseconds = &delayMicroseconds,
+	.millis = &millis,
+	.micros = &micros,
+	.monotonic_usecs = &_wiringpi_monotonic_usecs,
+	.sleep_until = &_wiringpi_sleep_until,
+	.wait_event = &_wiringpi_wait_event,
+	.notify_event = &_wiringpi_notify_event,
+	.realtime_usecs = &_wiringpi_realtime_usecs,
+	.thread_create = &_wiringpi_thread_create
+};
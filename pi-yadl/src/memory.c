@@ -0,0 +1,87 @@
+/*
+ * memory.c - Allocation counting and per cycle arenas.
+ *
+ * Copyright (C) 2016-2017 Brian Masney <masneyb@onstation.org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "memory.h"
+
+/* The argent wind thread can allocate at the same time as the main loop */
+static atomic_uint_fast64_t _num_allocations;
+
+static void *_check_allocation(void *ptr, size_t size)
+{
+	if (ptr == NULL && size > 0) {
+		fprintf(stderr, "Error allocating %zu bytes of memory\n", size);
+		exit(1);
+	}
+
+	atomic_fetch_add_explicit(&_num_allocations, 1, memory_order_relaxed);
+	return ptr;
+}
+
+void *yadl_malloc(size_t size)
+{
+	return _check_allocation(malloc(size), size);
+}
+
+void *yadl_calloc(size_t nmemb, size_t size)
+{
+	return _check_allocation(calloc(nmemb, size), nmemb * size);
+}
+
+void *yadl_realloc(void *ptr, size_t size)
+{
+	return _check_allocation(realloc(ptr, size), size);
+}
+
+uint64_t yadl_num_allocations(void)
+{
+	return atomic_load_explicit(&_num_allocations, memory_order_relaxed);
+}
+
+void arena_init(arena *a, size_t size)
+{
+	a->buf = yadl_malloc(size);
+	a->size = size;
+	a->used = 0;
+}
+
+void *arena_alloc(arena *a, size_t size)
+{
+	/* Keep everything aligned for any type */
+	size_t align = _Alignof(max_align_t);
+	size_t start = (a->used + align - 1) & ~(align - 1);
+
+	if (start + size > a->size) {
+		fprintf(stderr, "Arena of %zu bytes is too small for another %zu bytes\n",
+			a->size, size);
+		exit(1);
+	}
+
+	a->used = start + size;
+	return a->buf + start;
+}
+
+void arena_reset(arena *a)
+{
+	a->used = 0;
+}
@@ -0,0 +1,52 @@
+/*
+ * memory.h - Allocation counting and per cycle arenas.
+ *
+ * Copyright (C) 2016-2017 Brian Masney <masneyb@onstation.org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * The heap should only be used while starting up. These wrappers count
+ * the allocations so that the stats can show that no allocations are
+ * made in the steady state.
+ */
+void *yadl_malloc(size_t size);
+
+void *yadl_calloc(size_t nmemb, size_t size);
+
+void *yadl_realloc(void *ptr, size_t size);
+
+uint64_t yadl_num_allocations(void);
+
+/*
+ * A bump allocator for the scratch memory that is needed while producing
+ * a single result. Everything is released at once with arena_reset().
+ */
+typedef struct arena_tag {
+	char *buf;
+	size_t size;
+	size_t used;
+} arena;
+
+void arena_init(arena *a, size_t size);
+
+void *arena_alloc(arena *a, size_t size);
+
+void arena_reset(arena *a);
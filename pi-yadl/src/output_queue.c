@@ -0,0 +1,227 @@
+/*
+ * output_queue.c - Lock free queue between the main loop and the output thread.
+ *
+ * Copyright (C) 2016-2017 Brian Masney <masneyb@onstation.org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "yadl.h"
+#include "output_queue.h"
+
+int get_output_queue_policy(char *name, output_queue_policy *policy)
+{
+	if (name == NULL || strcmp(name, "block") == 0)
+		*policy = OUTPUT_QUEUE_BLOCK;
+	else if (strcmp(name, "drop_oldest") == 0)
+		*policy = OUTPUT_QUEUE_DROP_OLDEST;
+	else if (strcmp(name, "coalesce") == 0)
+		*policy = OUTPUT_QUEUE_COALESCE;
+	else {
+		fprintf(stderr, "Unknown output backpressure policy '%s'\n",
+			name);
+		return -1;
+	}
+
+	return 0;
+}
+
+static void _init_entry(output_entry *entry, int max_values, int max_units)
+{
+	memset(entry, 0, sizeof(*entry));
+	entry->result.value = yadl_calloc(max_values, sizeof(float));
+	entry->result.unit = max_units == 0 ?
+		NULL : yadl_calloc(max_units, sizeof(char *));
+}
+
+void init_output_entry(output_queue *queue, output_entry *entry)
+{
+	_init_entry(entry, queue->max_values, queue->max_units);
+}
+
+output_queue *new_output_queue(int size, int max_values, int max_units,
+			       output_queue_policy policy)
+{
+	output_queue *queue = yadl_calloc(1, sizeof(*queue));
+
+	queue->entries = yadl_calloc(size, sizeof(output_entry));
+	for (int i = 0; i < size; i++)
+		_init_entry(&queue->entries[i], max_values, max_units);
+
+	queue->size = size;
+	queue->max_values = max_values;
+	queue->max_units = max_units;
+	queue->policy = policy;
+
+	atomic_init(&queue->head, 0);
+	atomic_init(&queue->tail, 0);
+	atomic_init(&queue->closed, 0);
+	atomic_init(&queue->num_queued, 0);
+	atomic_init(&queue->num_dropped, 0);
+	atomic_init(&queue->num_coalesced, 0);
+	atomic_init(&queue->max_depth, 0);
+
+	if (sem_init(&queue->items, 0, 0) < 0 ||
+	    sem_init(&queue->space, 0, size) < 0) {
+		fprintf(stderr, "Error creating the output queue semaphores: %s\n",
+			strerror(errno));
+		exit(1);
+	}
+
+	return queue;
+}
+
+static void _sem_wait(sem_t *sem)
+{
+	/* The stats signal can interrupt the wait */
+	while (sem_wait(sem) < 0 && errno == EINTR)
+		;
+}
+
+static void _copy_entry(output_entry *dst, output_entry *src)
+{
+	atomic_store_explicit(&dst->owner,
+			      atomic_load_explicit(&src->owner,
+						   memory_order_relaxed),
+			      memory_order_relaxed);
+	dst->reading_number = src->reading_number;
+	dst->num_values = src->num_values;
+	dst->num_units = src->num_units;
+	dst->result.timestamp = src->result.timestamp;
+	memcpy(dst->result.value, src->result.value,
+	       sizeof(float) * src->num_values);
+	if (src->num_units > 0)
+		memcpy(dst->result.unit, src->result.unit,
+		       sizeof(char *) * src->num_units);
+}
+
+void output_queue_push(output_queue *queue, void *owner, int reading_number,
+		       yadl_result *result, int num_values, int num_units)
+{
+	/* Only this thread changes head */
+	uint_fast64_t head = atomic_load_explicit(&queue->head,
+						  memory_order_relaxed);
+
+	if (queue->policy == OUTPUT_QUEUE_BLOCK) {
+		_sem_wait(&queue->space);
+	} else {
+		uint_fast64_t tail = atomic_load(&queue->tail);
+
+		/* A failed compare and swap means the consumer took one */
+		while (head - tail >= (uint_fast64_t) queue->size) {
+			if (atomic_compare_exchange_weak(&queue->tail, &tail,
+							 tail + 1)) {
+				atomic_fetch_add(&queue->num_dropped, 1);
+				break;
+			}
+		}
+	}
+
+	output_entry *entry = &queue->entries[head % queue->size];
+
+	atomic_store_explicit(&entry->owner, owner, memory_order_relaxed);
+	entry->reading_number = reading_number;
+	entry->num_values = num_values;
+	entry->num_units = num_units;
+	entry->result.timestamp = result->timestamp;
+	memcpy(entry->result.value, result->value, sizeof(float) * num_values);
+	if (num_units > 0)
+		memcpy(entry->result.unit, result->unit,
+		       sizeof(char *) * num_units);
+
+	atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+	atomic_fetch_add(&queue->num_queued, 1);
+
+	uint_fast64_t depth = output_queue_depth(queue);
+
+	if (depth > atomic_load(&queue->max_depth))
+		atomic_store(&queue->max_depth, depth);
+
+	sem_post(&queue->items);
+}
+
+/*
+ * The producer can drop and overwrite the entries while they are scanned.
+ * A match in an overwritten entry is still a newer result from the same
+ * sensor, so only the load itself needs to be atomic.
+ */
+static int _has_newer_entry(output_queue *queue, void *owner,
+			    uint_fast64_t from, uint_fast64_t head)
+{
+	for (uint_fast64_t pos = from; pos < head; pos++) {
+		output_entry *entry = &queue->entries[pos % queue->size];
+
+		if (atomic_load_explicit(&entry->owner,
+					 memory_order_relaxed) == owner)
+			return 1;
+	}
+
+	return 0;
+}
+
+int output_queue_pop(output_queue *queue, output_entry *entry)
+{
+	while (1) {
+		uint_fast64_t tail = atomic_load(&queue->tail);
+		int closed = atomic_load(&queue->closed);
+		uint_fast64_t head = atomic_load_explicit(&queue->head,
+							  memory_order_acquire);
+
+		if (tail == head) {
+			if (closed)
+				return -1;
+
+			_sem_wait(&queue->items);
+			continue;
+		}
+
+		_copy_entry(entry, &queue->entries[tail % queue->size]);
+
+		/* Start over if the producer dropped the entry while copying */
+		if (!atomic_compare_exchange_strong(&queue->tail, &tail,
+						    tail + 1))
+			continue;
+
+		if (queue->policy == OUTPUT_QUEUE_BLOCK)
+			sem_post(&queue->space);
+
+		if (queue->policy == OUTPUT_QUEUE_COALESCE &&
+		    _has_newer_entry(queue, entry->owner, tail + 1, head)) {
+			atomic_fetch_add(&queue->num_coalesced, 1);
+			continue;
+		}
+
+		return 0;
+	}
+}
+
+void output_queue_close(output_queue *queue)
+{
+	atomic_store(&queue->closed, 1);
+	sem_post(&queue->items);
+}
+
+uint64_t output_queue_depth(output_queue *queue)
+{
+	uint_fast64_t tail = atomic_load(&queue->tail);
+	uint_fast64_t head = atomic_load(&queue->head);
+
+	return head > tail ? head - tail : 0;
+}
@@ -0,0 +1,103 @@
+/*
+ * output_queue.h - Hands finished results to the output thread.
+ *
+ * Copyright (C) 2016-2017 Brian Masney <masneyb@onstation.org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <stdint.h>
+
+/* What to do when a result is ready and the queue is full */
+typedef enum {
+	/* Wait for the output thread. This delays the next reading. */
+	OUTPUT_QUEUE_BLOCK,
+
+	/* Throw away the oldest queued result */
+	OUTPUT_QUEUE_DROP_OLDEST,
+
+	/*
+	 * Same as OUTPUT_QUEUE_DROP_OLDEST, and the output thread also skips
+	 * a result when a newer one from the same sensor is already queued.
+	 */
+	OUTPUT_QUEUE_COALESCE
+} output_queue_policy;
+
+typedef struct output_entry_tag {
+	/*
+	 * The sensor instance that the result belongs to. The consumer reads
+	 * it from entries that the producer may be overwriting when it looks
+	 * for a newer result to coalesce with.
+	 */
+	_Atomic(void *) owner;
+	int reading_number;
+	yadl_result result;
+	int num_values;
+	int num_units;
+} output_entry;
+
+/*
+ * A ring of preallocated entries with a single producer (the main loop)
+ * and a single consumer (the output thread). head and tail only ever
+ * increase and are reduced modulo size when indexing. The producer can
+ * also advance tail to drop the oldest entry, so the consumer copies an
+ * entry out first and then claims it with a compare and swap on tail.
+ * The semaphores are only used to sleep when there is nothing to do.
+ */
+typedef struct output_queue_tag {
+	output_entry *entries;
+	int size;
+	int max_values;
+	int max_units;
+	output_queue_policy policy;
+
+	atomic_uint_fast64_t head;
+	atomic_uint_fast64_t tail;
+	atomic_int closed;
+
+	sem_t items;
+	sem_t space;
+
+	atomic_uint_fast64_t num_queued;
+	atomic_uint_fast64_t num_dropped;
+	atomic_uint_fast64_t num_coalesced;
+	atomic_uint_fast64_t max_depth;
+} output_queue;
+
+int get_output_queue_policy(char *name, output_queue_policy *policy);
+
+output_queue *new_output_queue(int size, int max_values, int max_units,
+			       output_queue_policy policy);
+
+/* Allocates the value and unit arrays that output_queue_pop() copies into */
+void init_output_entry(output_queue *queue, output_entry *entry);
+
+/* Copies the result into the queue */
+void output_queue_push(output_queue *queue, void *owner, int reading_number,
+		       yadl_result *result, int num_values, int num_units);
+
+/*
+ * Waits for the next result and copies it into entry, which must have room
+ * for max_values and max_units. Returns -1 once the queue is closed and
+ * empty.
+ */
+int output_queue_pop(output_queue *queue, output_entry *entry);
+
+void output_queue_close(output_queue *queue);
+
+uint64_t output_queue_depth(output_queue *queue);
@@ -21,7 +21,6 @@
 
 #include <sys/types.h>
 #include <sys/stat.h>
-#include <sys/time.h>
 #include <fcntl.h>
 #include <errno.h>
 #include <stdio.h>
@@ -35,13 +34,24 @@
 #include "rrd_common.h"
 #include "yadl.h"
 
-static long _get_current_timestamp(void)
+/* Keeps track of the number of bytes written for the stats */
+static void _output_printf(output_metadata *meta, const char *format, ...)
 {
-	struct timeval tv;
+	va_list args;
 
-	if (gettimeofday(&tv, NULL) < 0)
-		return 0;
-	return tv.tv_sec;
+	va_start(args, format);
+
+	int ret = vfprintf(meta->fd, format, args);
+
+	va_end(args);
+
+	if (ret > 0)
+		meta->bytes_written += ret;
+}
+
+static void _output_write(output_metadata *meta, const char *str, int len)
+{
+	meta->bytes_written += fwrite(str, 1, len, meta->fd);
 }
 
 static int show_value(yadl_config *config, yadl_result *result)
@@ -49,7 +59,7 @@ static int show_value(yadl_config *config, yadl_result *result)
 	if (!config->only_log_value_changes)
 		return 1;
 
-	int num_values = get_num_values(config);
+	int num_values = config->schema->num_values;
 
 	int equal = 1;
 
@@ -76,9 +86,11 @@ static output_metadata *_open_fd_for_each_result(__attribute__((__unused__))
 						 yadl_config *config,
 						 char *outfile)
 {
-	output_metadata *ret = malloc(sizeof(*ret));
+	output_metadata *ret = yadl_malloc(sizeof(*ret));
 
 	ret->outfile = outfile;
+	ret->bytes_written = 0;
+	ret->num_results_written = 0;
 
 	if (outfile == NULL) {
 		ret->fd = stdout;
@@ -91,9 +103,11 @@ static output_metadata *_open_fd_for_each_result(__attribute__((__unused__))
 
 static output_metadata *_open_fd(yadl_config *config, char *outfile)
 {
-	output_metadata *ret = malloc(sizeof(*ret));
+	output_metadata *ret = yadl_malloc(sizeof(*ret));
 
 	ret->outfile = outfile;
+	ret->bytes_written = 0;
+	ret->num_results_written = 0;
 
 	if (outfile == NULL) {
 		ret->fd = stdout;
@@ -132,42 +146,52 @@ static void _write_multi_json_header(output_metadata *meta,
 				     __attribute__((__unused__))
 				     yadl_config *config)
 {
-	fprintf(meta->fd, "{ \"result\": [ ");
+	_output_printf(meta, "{ \"result\": [ ");
 }
 
-static void _write_multi_json(output_metadata *meta, int reading_number,
-			      yadl_result *result, yadl_config *config)
+/* Writes the values and units of a result as JSON object members */
+static void _write_json_members(output_metadata *meta, yadl_result *result,
+				yadl_config *config)
 {
-	if (!show_value(config, result))
-		return;
+	sensor_schema *schema = config->schema;
 
-	fprintf(meta->fd, " {");
-
-	char **header_names = config->sens->get_value_header_names(config);
+	for (int i = 0; i < schema->num_values; i++) {
+		_output_write(meta, schema->values[i].json_key,
+			      schema->values[i].json_key_len);
+		_output_printf(meta, "%.2f,", result->value[i]);
+	}
 
-	for (int i = 0; header_names[i] != NULL; i++) {
-		fprintf(meta->fd, " \"%s\": %.2f,", header_names[i],
-			result->value[i]);
+	for (int i = 0; i < schema->num_units; i++) {
+		_output_write(meta, schema->units[i].json_key,
+			      schema->units[i].json_key_len);
+		_output_printf(meta, "\"%s\",", result->unit[i]);
 	}
+}
 
-	if (config->sens->get_unit_header_names != NULL) {
-		char **unit_names = config->sens->get_unit_header_names(config);
+static void _write_multi_json(output_metadata *meta,
+			      __attribute__((__unused__)) int reading_number,
+			      yadl_result *result, yadl_config *config)
+{
+	if (!show_value(config, result))
+		return;
 
-		for (int i = 0; unit_names[i] != NULL; i++) {
-			fprintf(meta->fd, " \"%s\": \"%s\",", unit_names[i],
-				result->unit[i]);
-		}
-	}
+	/*
+	 * Results that failed or were dropped are never written, so the
+	 * separator goes in front of each result after the first.
+	 */
+	if (meta->num_results_written++ > 0)
+		_output_printf(meta, ",\n");
 
-	fprintf(meta->fd, " \"timestamp\": %ld }", _get_current_timestamp());
+	_output_printf(meta, " {");
 
-	if (reading_number + 1 < config->num_results)
-		fprintf(meta->fd, ",\n");
+	_write_json_members(meta, result, config);
+
+	_output_printf(meta, " \"timestamp\": %ld }", result->timestamp);
 }
 
 static void _write_multi_json_footer(output_metadata *meta)
 {
-	fprintf(meta->fd, " ] }\n");
+	_output_printf(meta, " ] }\n");
 }
 
 /* This format is useful if you want to run yadl in daemon mode and have it
@@ -192,26 +216,12 @@ static void _write_single_json(output_metadata *meta,
 		}
 	}
 
-	fprintf(meta->fd, "{ \"result\": [ {");
-
-	char **header_names = config->sens->get_value_header_names(config);
-
-	for (int i = 0; header_names[i] != NULL; i++) {
-		fprintf(meta->fd, " \"%s\": %.2f,", header_names[i],
-			result->value[i]);
-	}
-
-	if (config->sens->get_unit_header_names != NULL) {
-		char **unit_names = config->sens->get_unit_header_names(config);
+	_output_printf(meta, "{ \"result\": [ {");
 
-		for (int i = 0; unit_names[i] != NULL; i++) {
-			fprintf(meta->fd, " \"%s\": \"%s\",", unit_names[i],
-				result->unit[i]);
-		}
-	}
+	_write_json_members(meta, result, config);
 
-	fprintf(meta->fd, " \"timestamp\": %ld } ] }",
-		_get_current_timestamp());
+	_output_printf(meta, " \"timestamp\": %ld } ] }",
+		result->timestamp);
 
 	if (meta->outfile != NULL) {
 		if (fclose(meta->fd) < 0) {
@@ -226,7 +236,7 @@ static void _write_single_json(output_metadata *meta,
 static void _write_yaml_header(output_metadata *meta,
 			       __attribute__((__unused__)) yadl_config *config)
 {
-	fprintf(meta->fd, "---\nresult:\n");
+	_output_printf(meta, "---\nresult:\n");
 }
 
 static void _write_yaml(output_metadata *meta,
@@ -237,26 +247,31 @@ static void _write_yaml(output_metadata *meta,
 	if (!show_value(config, result))
 		return;
 
-	char **header_names = config->sens->get_value_header_names(config);
+	sensor_schema *schema = config->schema;
 
-	for (int i = 0; header_names[i] != NULL; i++) {
-		fprintf(meta->fd, "%c %s: %.2f\n", i == 0 ? '-' : ' ',
-			header_names[i], result->value[i]);
+	for (int i = 0; i < schema->num_values; i++) {
+		_output_write(meta, i == 0 ? "- " : "  ", 2);
+		_output_write(meta, schema->values[i].name,
+			      schema->values[i].name_len);
+		_output_printf(meta, ": %.2f\n", result->value[i]);
 	}
-	fprintf(meta->fd, "  timestamp: %ld\n",
-		_get_current_timestamp());
+	_output_printf(meta, "  timestamp: %ld\n",
+		result->timestamp);
 }
 
 static void _write_csv_header(output_metadata *meta, yadl_config *config)
 {
-	fprintf(meta->fd, "reading_number,timestamp");
+	_output_printf(meta, "reading_number,timestamp");
 
-	char **header_names = config->sens->get_value_header_names(config);
+	sensor_schema *schema = config->schema;
 
-	for (int i = 0; header_names[i] != NULL; i++)
-		fprintf(meta->fd, ",%s", header_names[i]);
+	for (int i = 0; i < schema->num_values; i++) {
+		_output_write(meta, ",", 1);
+		_output_write(meta, schema->values[i].name,
+			      schema->values[i].name_len);
+	}
 
-	fprintf(meta->fd, "\n");
+	_output_printf(meta, "\n");
 }
 
 static void _write_csv(output_metadata *meta, int reading_number,
@@ -266,22 +281,22 @@ static void _write_csv(output_metadata *meta, int reading_number,
 	if (!show_value(config, result))
 		return;
 
-	fprintf(meta->fd, "%d,%ld", reading_number, _get_current_timestamp());
-
-	char **header_names = config->sens->get_value_header_names(config);
+	_output_printf(meta, "%d,%ld", reading_number, result->timestamp);
 
-	for (int i = 0; header_names[i] != NULL; i++)
-		fprintf(meta->fd, ",%.2f", result->value[i]);
+	for (int i = 0; i < config->schema->num_values; i++)
+		_output_printf(meta, ",%.2f", result->value[i]);
 
-	fprintf(meta->fd, "\n");
+	_output_printf(meta, "\n");
 }
 
 static output_metadata *_rrd_open_fd(__attribute__((__unused__))
 				     yadl_config *config, char *outfile)
 {
-	output_metadata *ret = malloc(sizeof(*ret));
+	output_metadata *ret = yadl_malloc(sizeof(*ret));
 
 	ret->outfile = outfile;
+	ret->bytes_written = 0;
+	ret->num_results_written = 0;
 	ret->fd = NULL;
 	return ret;
 }
@@ -305,17 +320,15 @@ static void _write_rrd(output_metadata *meta,
 		exit(1);
 	}
 
-	char **header_names = config->sens->get_value_header_names(config);
-
-	write_to_rrd_database(config->logger, meta->outfile, header_names,
-			      result->value);
+	write_to_rrd_database(config->logger, meta->outfile,
+			      config->schema->value_names, result->value);
 }
 
 static void _write_xml_header(output_metadata *meta,
 			      __attribute__((__unused__)) yadl_config *config)
 {
-	fprintf(meta->fd, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n");
-	fprintf(meta->fd, "<results>\n");
+	_output_printf(meta, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n");
+	_output_printf(meta, "<results>\n");
 }
 
 static void _write_xml(output_metadata *meta,
@@ -326,22 +339,25 @@ static void _write_xml(output_metadata *meta,
 	if (!show_value(config, result))
 		return;
 
-	fprintf(meta->fd, "  <result><timestamp>%ld</timestamp>",
-		_get_current_timestamp());
+	_output_printf(meta, "  <result><timestamp>%ld</timestamp>",
+		result->timestamp);
 
-	char **header_names = config->sens->get_value_header_names(config);
+	sensor_schema *schema = config->schema;
 
-	for (int i = 0; header_names[i] != NULL; i++) {
-		fprintf(meta->fd, "<%s>%.2f</%s>", header_names[i],
-			result->value[i], header_names[i]);
+	for (int i = 0; i < schema->num_values; i++) {
+		_output_write(meta, schema->values[i].xml_open,
+			      schema->values[i].xml_open_len);
+		_output_printf(meta, "%.2f", result->value[i]);
+		_output_write(meta, schema->values[i].xml_close,
+			      schema->values[i].xml_close_len);
 	}
 
-	fprintf(meta->fd, "</result>\n");
+	_output_printf(meta, "</result>\n");
 }
 
 static void _write_xml_footer(output_metadata *meta)
 {
-	fprintf(meta->fd, "</results>\n");
+	_output_printf(meta, "</results>\n");
 }
 
 static outputter _multi_json_output_funcs = {
@@ -0,0 +1,67 @@
+/*
+ * pulse_ring.c - Pulse timestamps handed from an interrupt handler to a thread.
+ *
+ * Copyright (C) 2016-2017 Brian Masney <masneyb@onstation.org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include "memory.h"
+#include "pulse_ring.h"
+
+void pulse_ring_init(pulse_ring *ring, int size)
+{
+	ring->timestamps = yadl_calloc(size, sizeof(uint64_t));
+	ring->size = size;
+	atomic_init(&ring->head, 0);
+	atomic_init(&ring->tail, 0);
+	atomic_init(&ring->num_dropped, 0);
+}
+
+int pulse_ring_push(pulse_ring *ring, uint64_t usecs)
+{
+	uint64_t head = atomic_load_explicit(&ring->head,
+					     memory_order_relaxed);
+	uint64_t tail = atomic_load_explicit(&ring->tail,
+					     memory_order_acquire);
+
+	if (head - tail == (uint64_t) ring->size) {
+		atomic_fetch_add_explicit(&ring->num_dropped, 1,
+					  memory_order_relaxed);
+		return -1;
+	}
+
+	ring->timestamps[head % ring->size] = usecs;
+	atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+
+	return 0;
+}
+
+int pulse_ring_pop(pulse_ring *ring, uint64_t *usecs)
+{
+	uint64_t tail = atomic_load_explicit(&ring->tail,
+					     memory_order_relaxed);
+	uint64_t head = atomic_load_explicit(&ring->head,
+					     memory_order_acquire);
+
+	if (tail == head)
+		return -1;
+
+	*usecs = ring->timestamps[tail % ring->size];
+	atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+
+	return 0;
+}
@@ -0,0 +1,46 @@
+/*
+ * pulse_ring.h - Pulse timestamps handed from an interrupt handler to a thread.
+ *
+ * Copyright (C) 2016-2017 Brian Masney <masneyb@onstation.org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+/*
+ * A ring of pulse timestamps with a single producer (the interrupt handler)
+ * and a single consumer. head and tail only ever increase and are reduced
+ * modulo size when indexing. The interrupt handler never waits: when the
+ * ring is full the new timestamp is thrown away and counted in num_dropped.
+ */
+typedef struct pulse_ring_tag {
+	uint64_t *timestamps;
+	int size;
+
+	atomic_uint_fast64_t head;
+	atomic_uint_fast64_t tail;
+	atomic_uint_fast64_t num_dropped;
+} pulse_ring;
+
+void pulse_ring_init(pulse_ring *ring, int size);
+
+/* Returns -1 when the ring is full */
+int pulse_ring_push(pulse_ring *ring, uint64_t usecs);
+
+/* Returns -1 when the ring is empty */
+int pulse_ring_pop(pulse_ring *ring, uint64_t *usecs);
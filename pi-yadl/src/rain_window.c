@@ -0,0 +1,124 @@
+/*
+ * rain_window.c - Rain totals over a sliding window of time.
+ *
+ * Copyright (C) 2016-2017 Brian Masney <masneyb@onstation.org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include "memory.h"
+#include "rain_window.h"
+#include "state_file.h"
+
+void rain_window_init(rain_window *win, int window_millis, int bucket_millis)
+{
+	win->size = window_millis / bucket_millis;
+	if (win->size < 1)
+		win->size = 1;
+
+	win->bucket_usecs = bucket_millis * 1000ULL;
+	win->start_usecs = 0;
+	win->cur_bucket = 0;
+	win->started = 0;
+	win->buckets = yadl_calloc(win->size, sizeof(double));
+	win->total = 0.0;
+}
+
+static void _sum_buckets(rain_window *win)
+{
+	win->total = 0.0;
+	for (int i = 0; i < win->size; i++)
+		win->total += win->buckets[i];
+}
+
+static void _clear_buckets(rain_window *win, uint64_t bucket)
+{
+	if (bucket - win->cur_bucket >= (uint64_t) win->size) {
+		for (int i = 0; i < win->size; i++)
+			win->buckets[i] = 0.0;
+		win->total = 0.0;
+		win->cur_bucket = bucket;
+		return;
+	}
+
+	while (win->cur_bucket < bucket) {
+		win->cur_bucket++;
+
+		int idx = win->cur_bucket % win->size;
+
+		win->total -= win->buckets[idx];
+		win->buckets[idx] = 0.0;
+
+		/* Keep the rounding error from building up */
+		if (idx == 0)
+			_sum_buckets(win);
+	}
+}
+
+void rain_window_add(rain_window *win, uint64_t now_usecs, float amount)
+{
+	if (!win->started) {
+		win->start_usecs = now_usecs;
+		win->started = 1;
+	}
+
+	uint64_t bucket = (now_usecs - win->start_usecs +
+			   win->bucket_usecs / 2) / win->bucket_usecs;
+
+	if (bucket > win->cur_bucket)
+		_clear_buckets(win, bucket);
+
+	win->buckets[win->cur_bucket % win->size] += amount;
+	win->total += amount;
+}
+
+float rain_window_total(rain_window *win)
+{
+	/* What is left of the rounding error can take it just below 0 */
+	return win->total > 0.0 ? win->total : 0.0;
+}
+
+size_t rain_window_state_size(rain_window *win)
+{
+	return sizeof(win->started) + sizeof(uint64_t) +
+		sizeof(win->cur_bucket) + sizeof(win->total) +
+		win->size * sizeof(double);
+}
+
+void rain_window_save(rain_window *win, char **pos, uint64_t now_usecs)
+{
+	/* How long the window has been running */
+	uint64_t age_usecs = now_usecs - win->start_usecs;
+
+	state_write(pos, &win->started, sizeof(win->started));
+	state_write(pos, &age_usecs, sizeof(age_usecs));
+	state_write(pos, &win->cur_bucket, sizeof(win->cur_bucket));
+	state_write(pos, &win->total, sizeof(win->total));
+	state_write(pos, win->buckets, win->size * sizeof(double));
+}
+
+void rain_window_load(rain_window *win, char **pos, uint64_t saved_usecs)
+{
+	uint64_t age_usecs;
+
+	state_read(pos, &win->started, sizeof(win->started));
+	state_read(pos, &age_usecs, sizeof(age_usecs));
+	state_read(pos, &win->cur_bucket, sizeof(win->cur_bucket));
+	state_read(pos, &win->total, sizeof(win->total));
+	state_read(pos, win->buckets, win->size * sizeof(double));
+
+	win->start_usecs = saved_usecs - age_usecs;
+}
@@ -0,0 +1,63 @@
+/*
+ * rain_window.h - Rain totals over a sliding window of time.
+ *
+ * Copyright (C) 2016-2017 Brian Masney <masneyb@onstation.org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * The rain seen over the last window_millis, kept in a ring of buckets that
+ * are each one result interval wide. Each bucket is cleared and taken out
+ * of the running total when the clock moves past it, so adding a sample and
+ * reading the total are O(1) and nothing is allocated after the init.
+ */
+typedef struct rain_window_tag {
+	int size;
+	uint64_t bucket_usecs;
+
+	/*
+	 * The time of the first sample. The buckets are centered on it so
+	 * that results that are a little late or early stay in their own
+	 * bucket.
+	 */
+	uint64_t start_usecs;
+	uint64_t cur_bucket;
+	int started;
+
+	double *buckets;
+	double total;
+} rain_window;
+
+void rain_window_init(rain_window *win, int window_millis, int bucket_millis);
+
+void rain_window_add(rain_window *win, uint64_t now_usecs, float amount);
+
+float rain_window_total(rain_window *win);
+
+size_t rain_window_state_size(rain_window *win);
+
+void rain_window_save(rain_window *win, char **pos, uint64_t now_usecs);
+
+/*
+ * saved_usecs is the time that the window was saved on the current
+ * monotonic clock. It is before the clock started when the state is from
+ * before a reboot, and the unsigned math wraps around to handle that.
+ */
+void rain_window_load(rain_window *win, char **pos, uint64_t saved_usecs);
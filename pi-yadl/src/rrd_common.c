@@ -29,6 +29,9 @@
 #include "rrd_common.h"
 #include "yadl.h"
 
+/* Room for the values of the largest argent_80422 result */
+#define RRD_UPDATE_BUF_SIZE	2048
+
 static void _create_rrd_database(char *rrd_database, char **names)
 {
 	printf("Error: The RRD database %s does not exist. Please manually\n",
@@ -98,34 +101,45 @@ static void _create_rrd_database(char *rrd_database, char **names)
 	exit(1);
 }
 
+/*
+ * The values are passed with a template of the data source names so that
+ * an update fails with a clear error, instead of the values landing in the
+ * wrong data sources, when the database was created with a different set
+ * of names. See bin/create-rrds.sh for adding new names to an existing
+ * database.
+ */
 void write_to_rrd_database(logger log, char *rrd_database, char **names,
 			   float *values)
 {
 	struct stat st;
-	char update_buf[255];
-	char *updateparams[] = {
-		"rrdupdate",
-		rrd_database,
-		"",
-		NULL
-	};
+	char template_buf[RRD_UPDATE_BUF_SIZE];
+	char update_buf[RRD_UPDATE_BUF_SIZE];
+	const char *updateparams[] = { update_buf };
 
 	if (stat(rrd_database, &st) == -1)
 		_create_rrd_database(rrd_database, names);
 
-	snprintf(update_buf, sizeof(update_buf), "N");
-	for (int i = 0; names[i] != NULL; i++) {
-		char str_value[20];
+	int template_len = 0;
+	int len = snprintf(update_buf, sizeof(update_buf), "N");
 
-		snprintf(str_value, sizeof(str_value), ":%.2f", values[i]);
-		strncat(update_buf, str_value, sizeof(update_buf));
+	for (int i = 0; names[i] != NULL; i++) {
+		template_len += snprintf(template_buf + template_len,
+					 sizeof(template_buf) - template_len,
+					 "%s%s", i == 0 ? "" : ":", names[i]);
+		len += snprintf(update_buf + len, sizeof(update_buf) - len,
+				":%.2f", values[i]);
+		if (len >= (int) sizeof(update_buf) ||
+		    template_len >= (int) sizeof(template_buf)) {
+			fprintf(stderr, "Error: The update for RRD database %s does not fit in %d bytes\n",
+				rrd_database, RRD_UPDATE_BUF_SIZE);
+			return;
+		}
 	}
 
-	updateparams[2] = update_buf;
-
 	log("Writing data %s to RRD database %s\n", update_buf, rrd_database);
 
 	rrd_clear_error();
-	rrd_update(3, updateparams);
+	if (rrd_update_r(rrd_database, template_buf, 1, updateparams) != 0)
+		fprintf(stderr, "Error updating RRD database %s: %s\n",
+			rrd_database, rrd_get_error());
 }
-
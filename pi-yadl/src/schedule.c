@@ -0,0 +1,82 @@
+/*
+ * schedule.c - Absolute deadlines for the results of a sensor.
+ *
+ * Copyright (C) 2016-2017 Brian Masney <masneyb@onstation.org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "hw.h"
+#include "schedule.h"
+
+int get_schedule_missed_policy(char *name, schedule_missed_policy *policy)
+{
+	if (name == NULL || strcmp(name, "skip") == 0)
+		*policy = SCHEDULE_SKIP;
+	else if (strcmp(name, "catch_up") == 0)
+		*policy = SCHEDULE_CATCH_UP;
+	else {
+		fprintf(stderr, "Unknown missed results policy '%s'\n", name);
+		return -1;
+	}
+
+	return 0;
+}
+
+void schedule_start(schedule *sched, hw_backend *hw,
+		    unsigned int interval_millis, int align,
+		    schedule_missed_policy missed_policy)
+{
+	memset(sched, 0, sizeof(*sched));
+	sched->interval_usecs = interval_millis * 1000ULL;
+	sched->missed_policy = missed_policy;
+	sched->next_usecs = hw->monotonic_usecs();
+
+	if (align && sched->interval_usecs > 0) {
+		uint64_t past = hw->realtime_usecs() % sched->interval_usecs;
+
+		if (past > 0)
+			sched->next_usecs += sched->interval_usecs - past;
+	}
+}
+
+void schedule_advance(schedule *sched, uint64_t now_usecs)
+{
+	/* Back to back results */
+	if (sched->interval_usecs == 0) {
+		sched->next_usecs = now_usecs;
+		return;
+	}
+
+	/* A result that finishes right at the next deadline is on time */
+	sched->next_usecs += sched->interval_usecs;
+	if (now_usecs <= sched->next_usecs)
+		return;
+
+	sched->overruns++;
+
+	if (sched->missed_policy == SCHEDULE_CATCH_UP)
+		return;
+
+	/* Deadlines before now_usecs are dropped */
+	uint64_t missed = (now_usecs - sched->next_usecs +
+			   sched->interval_usecs - 1) / sched->interval_usecs;
+
+	sched->next_usecs += missed * sched->interval_usecs;
+	sched->skipped += missed;
+}
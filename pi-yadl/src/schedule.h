@@ -0,0 +1,63 @@
+/*
+ * schedule.h - Absolute deadlines for the results of a sensor.
+ *
+ * Copyright (C) 2016-2017 Brian Masney <masneyb@onstation.org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include <stdint.h>
+
+/* What to do when a result takes longer than the interval */
+typedef enum {
+	/* Wait for the next deadline that has not passed yet */
+	SCHEDULE_SKIP,
+
+	/* Take one result for each missed deadline, back to back */
+	SCHEDULE_CATCH_UP
+} schedule_missed_policy;
+
+/*
+ * The deadlines are a fixed interval apart on the hardware backend's
+ * monotonic clock and are never computed from the time that a result
+ * finished, so the time spent reading and writing a result does not
+ * make the results drift.
+ */
+typedef struct schedule_tag {
+	uint64_t interval_usecs;
+	uint64_t next_usecs;
+	schedule_missed_policy missed_policy;
+
+	/* Results that finished after the following deadline had passed */
+	uint64_t overruns;
+
+	/* Deadlines that were dropped with SCHEDULE_SKIP */
+	uint64_t skipped;
+} schedule;
+
+int get_schedule_missed_policy(char *name, schedule_missed_policy *policy);
+
+/*
+ * Sets the first deadline. With align, the deadlines fall on multiples of
+ * the interval on the wall clock, such as :00 and :30 past the minute for
+ * a 30 second interval. Otherwise the first deadline is right away.
+ */
+void schedule_start(schedule *sched, hw_backend *hw,
+		    unsigned int interval_millis, int align,
+		    schedule_missed_policy missed_policy);
+
+/* Moves to the next deadline once a result is done at now_usecs */
+void schedule_advance(schedule *sched, uint64_t now_usecs);
@@ -34,7 +34,7 @@ static void _analog_init(yadl_config *config)
 	config->adc->adc_init(config);
 }
 
-static yadl_result *_analog_read_data(yadl_config *config)
+static int _analog_read_data(yadl_config *config, yadl_result *result)
 {
 	config->logger("Performing analog read: adc_millivolts=%d, adc_resolution=%d\n",
 			config->adc_millivolts, config->adc->adc_resolution);
@@ -47,15 +47,10 @@ static yadl_result *_analog_read_data(yadl_config *config)
 	config->logger("Got analog reading %d; %d millivolts.\n",
 		       reading, read_millivolts);
 
-	yadl_result *result = malloc(sizeof(*result));
-
-	result->value = malloc(sizeof(float) * 2);
 	result->value[0] = reading;
 	result->value[1] = read_millivolts * config->adc_multiplier;
 
-	result->unit = NULL;
-
-	return result;
+	return 0;
 }
 
 static char *_analog_value_header_names[] = { "reading", "millivolts", NULL };
@@ -20,45 +20,48 @@
  * 02110-1301, USA.
  */
 
-#include <wiringPi.h>
 #include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <limits.h>
-#include <pthread.h>
+#include <math.h>
 #include <unistd.h>
 #include <time.h>
-#include <sys/time.h>
 #include "yadl.h"
 
-static volatile unsigned int _wind_last_millis;
+static volatile uint64_t _wind_last_usecs;
 static volatile int _wind_current_counter;
 static int _wind_last_counter;
 
-static volatile unsigned int _rain_last_millis;
+static volatile uint64_t _rain_last_usecs;
 static volatile int _rain_current_counter;
 static int _rain_last_counter;
 
-static struct timeval _last_time;
+static unsigned int _last_millis;
+
+/* The interrupt handlers don't have access to the config */
+static hw_backend *_hw;
+static anemometer *_anemometer;
 
 static void _wind_speed_handler(void)
 {
-	unsigned int cur_millis = millis();
+	uint64_t cur_usecs = _hw->event_usecs();
 
-	if (cur_millis - _wind_last_millis > 10) {
+	if (cur_usecs - _wind_last_usecs > 10000) {
 		_wind_current_counter++;
-		_wind_last_millis = cur_millis;
+		_wind_last_usecs = cur_usecs;
+		anemometer_pulse(_anemometer, cur_usecs);
 	}
 }
 
 static void _rain_gauge_handler(void)
 {
-	unsigned int cur_millis = millis();
+	uint64_t cur_usecs = _hw->event_usecs();
 
-	if (cur_millis - _rain_last_millis > 10) {
+	if (cur_usecs - _rain_last_usecs > 10000) {
 		_rain_current_counter++;
-		_rain_last_millis = cur_millis;
+		_rain_last_usecs = cur_usecs;
 	}
 }
 
@@ -70,84 +73,423 @@ static int _get_num_seen(int start_counter, int stop_counter)
 	return stop_counter - start_counter;
 }
 
-static void _check_wind_direction(int read_millivolts, int compare_millivolts,
-				float reading, float *direction, int *distance)
+/*
+ * The resistance for each wind vane position, starting at north, from the
+ * data sheet for the Sparkfun Weather Station
+ * https://www.sparkfun.com/products/8942
+ * http://www.sparkfun.com/datasheets/Sensors/Weather/Weather%20Sensor%20Assembly..pdf
+ *
+ * The voltages are calculated from these since the 4.78V that the data
+ * sheet lists for 315 degrees does not match its 64.9K resistor.
+ */
+static const int _wind_vane_ohms[CIRCULAR_NUM_POSITIONS] = {
+	33000, 6570, 8200, 891, 1000, 688, 2200, 1410,
+	3900, 3140, 16000, 14120, 120000, 42120, 64900, 21880
+};
+
+#define WIND_VANE_PULLUP_OHMS	10000
+#define WIND_VANE_MILLIVOLTS	5000
+
+static void _read_wind_vane_calibration(yadl_config *config,
+					float *millivolts)
 {
-	int this_distance = abs(read_millivolts - compare_millivolts);
+	FILE *fd = fopen(config->wind_vane_calibration, "r");
 
-	if (*direction < 0 || this_distance < *distance) {
-		*direction = reading;
-		*distance = this_distance;
+	if (fd == NULL) {
+		fprintf(stderr, "Error opening %s: %s\n",
+			config->wind_vane_calibration, strerror(errno));
+		exit(1);
 	}
+
+	char *line = NULL;
+	size_t line_size = 0;
+	int line_number = 0;
+
+	while (getline(&line, &line_size, fd) >= 0) {
+		float degrees, mv;
+		char extra;
+
+		line_number++;
+		line[strcspn(line, "#\r\n")] = '\0';
+		if (strspn(line, " \t") == strlen(line))
+			continue;
+
+		if (sscanf(line, "%f %f %c", &degrees, &mv, &extra) != 2) {
+			fprintf(stderr, "%s:%d: Expected <degrees> <millivolts>\n",
+				config->wind_vane_calibration, line_number);
+			exit(1);
+		}
+
+		int position = circular_position(degrees);
+
+		if (fabs(position * CIRCULAR_POSITION_DEGREES -
+			 fmodf(degrees, 360.0)) > 0.01) {
+			fprintf(stderr, "%s:%d: %.2f is not a wind vane direction\n",
+				config->wind_vane_calibration, line_number,
+				degrees);
+			exit(1);
+		}
+
+		millivolts[position] = mv;
+	}
+
+	free(line);
+	fclose(fd);
 }
 
-/* These values came from the data sheet for the Sparkfun Weather
- * Station
- * https://www.sparkfun.com/products/8942
- * http://www.sparkfun.com/datasheets/Sensors/Weather/Weather%20Sensor%20Assembly..pdf
+/*
+ * Maps each ADC code to the nearest wind vane position so that a reading
+ * is a single table lookup. A code in the middle half between two
+ * positions is flagged as unstable. This happens when the vane is moving
+ * or is stuck between two positions.
  */
-static float _get_wind_direction(yadl_config *config)
+static void _init_wind_vane_lut(yadl_config *config)
 {
-	float direction = -1.0;
-	int distance = 0;
+	int resolution = config->adc->adc_resolution;
+	float millivolts[CIRCULAR_NUM_POSITIONS];
+	float codes[CIRCULAR_NUM_POSITIONS];
+
+	for (int pos = 0; pos < CIRCULAR_NUM_POSITIONS; pos++)
+		millivolts[pos] = (float) WIND_VANE_MILLIVOLTS *
+			_wind_vane_ohms[pos] /
+			(_wind_vane_ohms[pos] + WIND_VANE_PULLUP_OHMS);
+
+	if (config->wind_vane_calibration != NULL)
+		_read_wind_vane_calibration(config, millivolts);
+
+	for (int pos = 0; pos < CIRCULAR_NUM_POSITIONS; pos++) {
+		codes[pos] = millivolts[pos] * resolution /
+			config->adc_millivolts;
+
+		config->logger("Wind vane: direction=%.1f degrees, %.0f mV, ADC code %.1f\n",
+			       pos * CIRCULAR_POSITION_DEGREES,
+			       millivolts[pos], codes[pos]);
+	}
+
+	config->wind_vane_lut = yadl_malloc(resolution);
+	config->wind_vane_last_position = -1;
+
+	for (int code = 0; code < resolution; code++) {
+		int nearest = 0;
+
+		for (int pos = 1; pos < CIRCULAR_NUM_POSITIONS; pos++) {
+			if (fabsf(code - codes[pos]) <
+			    fabsf(code - codes[nearest]))
+				nearest = pos;
+		}
+
+		/* The next position past the code, if there is one */
+		float distance = fabsf(code - codes[nearest]);
+		float gap = -1;
+
+		for (int pos = 0; pos < CIRCULAR_NUM_POSITIONS; pos++) {
+			float this_gap = codes[pos] - codes[nearest];
 
+			if (code < codes[nearest])
+				this_gap = -this_gap;
+
+			if (this_gap > 0 && (gap < 0 || this_gap < gap))
+				gap = this_gap;
+		}
+
+		config->wind_vane_lut[code] = nearest;
+		if (gap > 0 && distance > gap / 4)
+			config->wind_vane_lut[code] |= WIND_VANE_UNSTABLE;
+	}
+}
+
+/*
+ * An unstable reading returns the last stable direction so that it is not
+ * silently counted as one of the two positions that it is between.
+ */
+static float _get_wind_direction(yadl_config *config)
+{
 	int reading = config->adc->adc_read(config);
-	int millivolts = (float) reading *
-		((float) config->adc_millivolts /
-		 (float) config->adc->adc_resolution);
-
-	/* Find the closest reading to the values listed in the datasheet */
-	_check_wind_direction(millivolts, 3840, 0.0, &direction, &distance);
-	_check_wind_direction(millivolts, 1980, 22.5, &direction, &distance);
-	_check_wind_direction(millivolts, 2250, 45.0, &direction, &distance);
-	_check_wind_direction(millivolts, 410, 67.5, &direction, &distance);
-	_check_wind_direction(millivolts, 450, 90.0, &direction, &distance);
-	_check_wind_direction(millivolts, 320, 112.5, &direction, &distance);
-	_check_wind_direction(millivolts, 900, 135.0, &direction, &distance);
-	_check_wind_direction(millivolts, 620, 157.5, &direction, &distance);
-	_check_wind_direction(millivolts, 1400, 180.0, &direction, &distance);
-	_check_wind_direction(millivolts, 1190, 202.5, &direction, &distance);
-	_check_wind_direction(millivolts, 3080, 225.0, &direction, &distance);
-	_check_wind_direction(millivolts, 2930, 247.5, &direction, &distance);
-	_check_wind_direction(millivolts, 4620, 270.0, &direction, &distance);
-	_check_wind_direction(millivolts, 4040, 292.5, &direction, &distance);
-	_check_wind_direction(millivolts, 4780, 315.0, &direction, &distance);
-	_check_wind_direction(millivolts, 3430, 337.5, &direction, &distance);
-
-	config->logger("Wind direction: reading=%d, %d mV, direction=%.1f degrees\n",
-		       reading, millivolts, direction);
+
+	if (reading < 0)
+		reading = 0;
+	else if (reading >= config->adc->adc_resolution)
+		reading = config->adc->adc_resolution - 1;
+
+	int entry = config->wind_vane_lut[reading];
+	int position = entry & ~WIND_VANE_UNSTABLE;
+
+	if (!(entry & WIND_VANE_UNSTABLE))
+		atomic_store(&config->wind_vane_last_position, position);
+	else {
+		atomic_fetch_add(&config->wind_vane_num_unstable, 1);
+
+		int last_position =
+			atomic_load(&config->wind_vane_last_position);
+
+		if (last_position >= 0)
+			position = last_position;
+	}
+
+	float direction = position * CIRCULAR_POSITION_DEGREES;
+
+	config->logger("Wind direction: reading=%d, direction=%.1f degrees%s\n",
+		       reading, direction,
+		       entry & WIND_VANE_UNSTABLE ? " (unstable)" : "");
 
 	return direction;
 }
 
-static pthread_mutex_t _wind_rain_mutex = PTHREAD_MUTEX_INITIALIZER;
-
-static int _get_current_hour_of_day(void)
+static int _get_current_hour_of_day(yadl_config *config)
 {
-	time_t t;
+	time_t t = config->hw->realtime_usecs() / 1000000;
 	struct tm tm;
 
-	time(&t);
 	localtime_r(&t, &tm);
 
 	return tm.tm_hour;
 }
 
+/*
+ * The windows are needed for the value headers, which are looked up
+ * before the sensor is initialized.
+ */
+static void _init_wind_windows(yadl_config *config)
+{
+	if (config->wind_windows.windows != NULL)
+		return;
+
+	char *spec = config->wind_windows_spec != NULL ?
+		config->wind_windows_spec : DEFAULT_WIND_WINDOWS;
+
+	if (wind_windows_init(&config->wind_windows, spec) < 0) {
+		fprintf(stderr,
+			"Invalid --wind_windows %s. Each window is a number of seconds, minutes or hours, such as 3s,2m,24h, and windows over 10 minutes must be whole minutes. Up to %d windows are allowed.\n",
+			spec, WIND_MAX_WINDOWS);
+		usage();
+	}
+}
+
+static void _init_wind_stats(wind_stats *stats, int num_windows)
+{
+	stats->window_values = yadl_calloc(num_windows * 4, sizeof(float));
+	stats->direction_stddev = yadl_calloc(num_windows, sizeof(float));
+	stats->num_rain_clicks_today = 0;
+}
+
+static void _publish_wind_stats(yadl_config *config)
+{
+	wind_windows *ws = &config->wind_windows;
+	wind_stats *next = &config->wind_stats_next;
+	wind_stats *stats = &config->wind_stats;
+	int num_windows = ws->num_windows;
+
+	for (int i = 0; i < num_windows; i++)
+		wind_windows_values(ws, i, &next->window_values[i * 4],
+				    &next->direction_stddev[i]);
+
+	next->num_rain_clicks_today = config->num_rain_clicks_today;
+
+	/* The result reader copies these out while the wind thread runs */
+	seqlock_write_begin(&config->wind_stats_lock);
+	seqlock_store_words(stats->window_values, next->window_values,
+			    sizeof(float) * num_windows * 4);
+	seqlock_store_words(stats->direction_stddev, next->direction_stddev,
+			    sizeof(float) * num_windows);
+	seqlock_store_words(&stats->num_rain_clicks_today,
+			    &next->num_rain_clicks_today, sizeof(int));
+	seqlock_write_end(&config->wind_stats_lock);
+}
+
+/* The values are copied into the result */
+static int _get_wind_stats(yadl_config *config, float *window_values,
+			   float *direction_stddev)
+{
+	wind_stats *stats = &config->wind_stats;
+	int num_windows = config->wind_windows.num_windows;
+	int num_rain_clicks_today;
+	unsigned int seq;
+
+	do {
+		seq = seqlock_read_begin(&config->wind_stats_lock);
+		seqlock_load_words(window_values, stats->window_values,
+				   sizeof(float) * num_windows * 4);
+		seqlock_load_words(direction_stddev, stats->direction_stddev,
+				   sizeof(float) * num_windows);
+		seqlock_load_words(&num_rain_clicks_today,
+				   &stats->num_rain_clicks_today, sizeof(int));
+	} while (seqlock_read_retry(&config->wind_stats_lock, seq));
+
+	return num_rain_clicks_today;
+}
+
+/*
+ * The wind windows and the rain since midnight are saved by the wind
+ * thread, and the rain totals are saved by the reader each result.
+ */
+#define ARGENT_STATE_WIND	0
+#define ARGENT_STATE_RAIN	1
+#define ARGENT_STATE_SECTIONS	2
+
+/* How often the wind thread saves its state */
+#define ARGENT_STATE_SAVE_SECS	10
+
+static size_t _wind_state_size(yadl_config *config)
+{
+	return wind_windows_state_size(&config->wind_windows) +
+		sizeof(config->num_rain_clicks_today) +
+		sizeof(config->current_hour) + sizeof(int);
+}
+
+static size_t _rain_state_size(yadl_config *config)
+{
+	return rain_window_state_size(&config->rain_1h) +
+		rain_window_state_size(&config->rain_6h) +
+		rain_window_state_size(&config->rain_24h);
+}
+
+static void _save_wind_state(yadl_config *config)
+{
+	char *pos = state_file_begin_save(config->state, ARGENT_STATE_WIND);
+	int last_position = atomic_load(&config->wind_vane_last_position);
+
+	wind_windows_save(&config->wind_windows, &pos);
+	state_write(&pos, &config->num_rain_clicks_today,
+		    sizeof(config->num_rain_clicks_today));
+	state_write(&pos, &config->current_hour, sizeof(config->current_hour));
+	state_write(&pos, &last_position, sizeof(last_position));
+
+	state_file_end_save(config->state, ARGENT_STATE_WIND,
+			    config->hw->realtime_usecs());
+}
+
+static void _save_rain_state(yadl_config *config, uint64_t now_usecs)
+{
+	char *pos = state_file_begin_save(config->state, ARGENT_STATE_RAIN);
+
+	rain_window_save(&config->rain_1h, &pos, now_usecs);
+	rain_window_save(&config->rain_6h, &pos, now_usecs);
+	rain_window_save(&config->rain_24h, &pos, now_usecs);
+
+	state_file_end_save(config->state, ARGENT_STATE_RAIN,
+			    config->hw->realtime_usecs());
+}
+
+static int _same_day(time_t a, time_t b)
+{
+	struct tm tm_a, tm_b;
+
+	localtime_r(&a, &tm_a);
+	localtime_r(&b, &tm_b);
+
+	return tm_a.tm_year == tm_b.tm_year && tm_a.tm_yday == tm_b.tm_yday;
+}
+
+/*
+ * Returns the saved section, or NULL if there is none or it is older than
+ * --state_max_age_secs.
+ */
+static char *_load_state_section(yadl_config *config, int section,
+				 char *description, uint64_t now_usecs,
+				 uint64_t *age_usecs)
+{
+	uint64_t saved_usecs;
+	char *data = state_file_load(config->state, section, &saved_usecs);
+
+	if (data == NULL) {
+		config->logger("No saved %s state in %s\n", description,
+			       config->state_filename);
+		return NULL;
+	}
+
+	*age_usecs = now_usecs - saved_usecs;
+	if (saved_usecs > now_usecs ||
+	    *age_usecs > config->state_max_age_secs * 1000000ULL) {
+		config->logger("Ignoring the saved %s state in %s since it is %.0f seconds old\n",
+			       description, config->state_filename,
+			       ((double) now_usecs - saved_usecs) / 1000000.0);
+		return NULL;
+	}
+
+	config->logger("Loaded the %s state from %.1f seconds ago from %s\n",
+		       description, *age_usecs / 1000000.0,
+		       config->state_filename);
+
+	return data;
+}
+
+static void _load_state(yadl_config *config)
+{
+	char layout[STATE_FILE_LAYOUT_LEN];
+	size_t section_sizes[ARGENT_STATE_SECTIONS] = {
+		_wind_state_size(config), _rain_state_size(config)
+	};
+
+	snprintf(layout, sizeof(layout),
+		 "argent_80422 wind_windows=%s rain_bucket_usecs=%llu",
+		 config->wind_windows_spec != NULL ?
+		 config->wind_windows_spec : DEFAULT_WIND_WINDOWS,
+		 (unsigned long long) config->rain_1h.bucket_usecs);
+
+	config->state = state_file_open(config->state_filename, layout,
+					section_sizes, ARGENT_STATE_SECTIONS);
+	if (config->state == NULL)
+		exit(1);
+
+	uint64_t now_usecs = config->hw->realtime_usecs();
+	uint64_t age_usecs;
+	char *pos = _load_state_section(config, ARGENT_STATE_WIND, "wind",
+					now_usecs, &age_usecs);
+
+	if (pos != NULL) {
+		int last_position;
+
+		wind_windows_load(&config->wind_windows, &pos, age_usecs);
+		state_read(&pos, &config->num_rain_clicks_today,
+			   sizeof(config->num_rain_clicks_today));
+		state_read(&pos, &config->current_hour,
+			   sizeof(config->current_hour));
+		state_read(&pos, &last_position, sizeof(last_position));
+		atomic_store(&config->wind_vane_last_position, last_position);
+
+		if (!_same_day((now_usecs - age_usecs) / 1000000,
+			       now_usecs / 1000000)) {
+			config->num_rain_clicks_today = 0;
+			config->current_hour = 0;
+		}
+	}
+
+	pos = _load_state_section(config, ARGENT_STATE_RAIN, "rain", now_usecs,
+				  &age_usecs);
+	if (pos != NULL) {
+		uint64_t saved_usecs = config->hw->monotonic_usecs() -
+			age_usecs;
+
+		rain_window_load(&config->rain_1h, &pos, saved_usecs);
+		rain_window_load(&config->rain_6h, &pos, saved_usecs);
+		rain_window_load(&config->rain_24h, &pos, saved_usecs);
+	}
+}
+
+/*
+ * Samples the wind once a second on an absolute deadline so that the time
+ * spent taking a sample does not stretch the next one.
+ */
 static void *_argent_80422_wind_rain_thread(void *arg)
 {
 	yadl_config *config = (yadl_config *) arg;
 
-	int wind_start_counter = _wind_current_counter;
 	int rain_start_counter = _rain_current_counter;
+	uint64_t next_usecs = config->hw->monotonic_usecs();
+	int num_samples = 0;
 
 	while (1) {
-		sleep(1);
+		next_usecs += 1000000;
+		config->hw->sleep_until(next_usecs);
+
+		float wind_speed, wind_gust;
+		int num_dropped = anemometer_sample(&config->anemometer,
+						    config->hw->monotonic_usecs(),
+						    &wind_speed, &wind_gust);
 
-		int wind_stop_counter = _wind_current_counter;
-		int wind_num_seen = _get_num_seen(wind_start_counter,
-						  wind_stop_counter);
-		float wind_speed = wind_num_seen *
-			config->wind_speed_multiplier;
+		if (num_dropped > 0)
+			config->logger("Wind/Rain thread: %d anemometer pulses were dropped\n",
+				       num_dropped);
 
 		float wind_direction = _get_wind_direction(config);
 
@@ -155,30 +497,14 @@ static void *_argent_80422_wind_rain_thread(void *arg)
 		int rain_num_seen = _get_num_seen(rain_start_counter,
 						  rain_stop_counter);
 
-		int current_hour = _get_current_hour_of_day();
-
-		config->logger("Wind/Rain thread: wind_direction=%.1f, wind_speed=%.1f, rain_num_seen=%d\n",
-				wind_direction, wind_speed, rain_num_seen);
+		int current_hour = _get_current_hour_of_day(config);
 
-		pthread_mutex_lock(&_wind_rain_mutex);
+		config->logger("Wind/Rain thread: wind_direction=%.1f, wind_speed=%.1f, wind_gust=%.1f, rain_num_seen=%d\n",
+				wind_direction, wind_speed, wind_gust,
+				rain_num_seen);
 
-		config->wind_directions_2m[config->wind_2m_idx] =
-			wind_direction;
-		config->wind_speeds_2m[config->wind_2m_idx] = wind_speed;
-		config->wind_2m_idx = (config->wind_2m_idx + 1) %
-			NUM_WIND_2_MIN_SAMPLES;
-
-		config->wind_directions_10m[config->wind_10m_idx] =
-			wind_direction;
-		config->wind_speeds_10m[config->wind_10m_idx] = wind_speed;
-		config->wind_10m_idx = (config->wind_10m_idx + 1) %
-			NUM_WIND_10_MIN_SAMPLES;
-
-		config->wind_directions_60m[config->wind_60m_idx] =
-			wind_direction;
-		config->wind_speeds_60m[config->wind_60m_idx] = wind_speed;
-		config->wind_60m_idx = (config->wind_60m_idx + 1) %
-			NUM_WIND_60_MIN_SAMPLES;
+		wind_windows_push(&config->wind_windows, wind_speed, wind_gust,
+				  wind_direction);
 
 		if (config->current_hour == current_hour)
 			config->num_rain_clicks_today += rain_num_seen;
@@ -192,9 +518,12 @@ static void *_argent_80422_wind_rain_thread(void *arg)
 			config->current_hour = current_hour;
 		}
 
-		pthread_mutex_unlock(&_wind_rain_mutex);
+		_publish_wind_stats(config);
+
+		if (config->state != NULL &&
+		    ++num_samples % ARGENT_STATE_SAVE_SECS == 0)
+			_save_wind_state(config);
 
-		wind_start_counter = wind_stop_counter;
 		rain_start_counter = rain_stop_counter;
 	}
 
@@ -203,26 +532,19 @@ static void *_argent_80422_wind_rain_thread(void *arg)
 
 static void _create_wind_thread(yadl_config *config)
 {
-	pthread_t tid;
+	_init_wind_windows(config);
 
-	for (int i = 0; i < NUM_WIND_2_MIN_SAMPLES; i++) {
-		config->wind_directions_2m[i] = -1;
-		config->wind_speeds_2m[i] = -1;
-	}
-	for (int i = 0; i < NUM_WIND_10_MIN_SAMPLES; i++) {
-		config->wind_directions_10m[i] = -1;
-		config->wind_speeds_10m[i] = -1;
-	}
-	for (int i = 0; i < NUM_WIND_60_MIN_SAMPLES; i++) {
-		config->wind_directions_60m[i] = -1;
-		config->wind_speeds_60m[i] = -1;
-	}
+	int num_windows = config->wind_windows.num_windows;
 
-	int ret = pthread_create(&tid, NULL, _argent_80422_wind_rain_thread,
-				 config);
+	_init_wind_stats(&config->wind_stats, num_windows);
+	_init_wind_stats(&config->wind_stats_next, num_windows);
+	_publish_wind_stats(config);
 
-	if (ret < 0) {
-		printf("Error creating wind thread: %s\n", strerror(errno));
+	int ret = config->hw->thread_create(_argent_80422_wind_rain_thread,
+					    config);
+
+	if (ret != 0) {
+		printf("Error creating wind thread: %s\n", strerror(ret));
 		exit(1);
 	}
 }
@@ -269,93 +591,51 @@ static void _argent_80422_init(yadl_config *config)
 		usage();
 	}
 
+	/*
+	 * The rain totals are bucketed by the result interval. Use one second
+	 * buckets when there is no delay between the results.
+	 */
+	int rain_bucket_millis = config->sleep_millis_between_results > 0 ?
+		config->sleep_millis_between_results : RAIN_MIN_BUCKET_MILLIS;
+
+	rain_window_init(&config->rain_1h, 3600000, rain_bucket_millis);
+	rain_window_init(&config->rain_6h, 21600000, rain_bucket_millis);
+	rain_window_init(&config->rain_24h, 86400000, rain_bucket_millis);
+
 	/* Initialize the ADC for the wind direction */
 	if (config->adc == NULL) {
 		fprintf(stderr, "You must specify the --adc argument\n");
 		usage();
 	}
 	config->adc->adc_init(config);
+	_init_wind_vane_lut(config);
+
+	if (config->state_filename != NULL)
+		_load_state(config);
 
 	config->logger("wind_speed_pin=%d, rain_gauge_pin=%d\n",
 			config->wind_speed_pin, config->rain_gauge_pin);
 
-	wiringPiISR(config->wind_speed_pin, INT_EDGE_RISING,
-		    &_wind_speed_handler);
-	wiringPiISR(config->rain_gauge_pin, INT_EDGE_RISING,
-		    &_rain_gauge_handler);
+	anemometer_init(&config->anemometer, config->wind_speed_multiplier,
+			config->hw->monotonic_usecs());
+
+	_hw = config->hw;
+	_anemometer = &config->anemometer;
+	config->hw->isr(config->wind_speed_pin, HW_EDGE_RISING,
+			&_wind_speed_handler);
+	config->hw->isr(config->rain_gauge_pin, HW_EDGE_RISING,
+			&_rain_gauge_handler);
 
-	gettimeofday(&_last_time, NULL);
+	_last_millis = config->hw->millis();
 
 	_create_wind_thread(config);
 
 	/* Wait for the first sample */
 	if (config->sleep_millis_between_results > 0)
-		delay(config->sleep_millis_between_results);
-}
-
-static void _argent_80422_rain_gauge_total(float_node **list, int *num_samples,
-					   int interval_millis,
-					   float rain_gauge_cur,
-					   yadl_config *config)
-{
-	if (*num_samples == 0) {
-		*list = new_list_node(rain_gauge_cur);
-		*num_samples = 1;
-		return;
-	} else if (interval_millis < config->sleep_millis_between_results) {
-		(*list)->value = rain_gauge_cur;
-		return;
-	}
-
-	/* Add the new sample to the end of the list */
-	float_node *last_list_node = list_last_node(*list);
-
-	last_list_node->next = new_list_node(rain_gauge_cur);
-
-	/* Remove the first sample if needed */
-	int num_samples_to_keep = interval_millis /
-		config->sleep_millis_between_results;
-
-	if (*num_samples == num_samples_to_keep) {
-		float_node *del_node = *list;
-		*list = (*list)->next;
-		free(del_node);
-	} else {
-		(*num_samples)++;
-	}
-	config->logger("rain list: num_samples=%d, interval_millis=%d, samples_to_keep=%d\n",
-			*num_samples, interval_millis, num_samples_to_keep);
-}
-
-static float _get_average_values(float values[], int total)
-{
-	float sum = 0.0;
-	int num_items = 0;
-
-	for (int i = 0; i < total; i++) {
-		if (values[i] < 0)
-			continue;
-
-		sum += values[i];
-		num_items++;
-	}
-
-	return sum / num_items;
+		config->hw->delay(config->sleep_millis_between_results);
 }
 
-static int _get_wind_gust_index(float values[], int total)
-{
-	int max_gust_idx = 0;
-
-	for (int i = 0; i < total; i++) {
-		if (values[i] > values[max_gust_idx])
-			max_gust_idx = i;
-	}
-
-	return max_gust_idx;
-}
-
-static yadl_result *_argent_80422_read_data(yadl_config *config)
+static int _argent_80422_read_data(yadl_config *config, yadl_result *result)
 {
 	float wind_direction = _get_wind_direction(config);
 
@@ -370,15 +650,10 @@ static yadl_result *_argent_80422_read_data(yadl_config *config)
 
 	_rain_last_counter = stop_rain_counter;
 
-	static struct timeval _current_time;
+	unsigned int cur_millis = config->hw->millis();
+	double elapsed_secs = (cur_millis - _last_millis) / 1000.0;
 
-	gettimeofday(&_current_time, NULL);
-	double elapsed_secs = ((_current_time.tv_sec - _last_time.tv_sec) *
-			       1000000L + _current_time.tv_usec -
-			       _last_time.tv_usec) / 1000000L;
-
-	_last_time.tv_sec = _current_time.tv_sec;
-	_last_time.tv_usec = _current_time.tv_usec;
+	_last_millis = cur_millis;
 
 	int wind_num_seen = _get_num_seen(start_wind_counter,
 					  stop_wind_counter);
@@ -389,111 +664,119 @@ static yadl_result *_argent_80422_read_data(yadl_config *config)
 					  stop_rain_counter);
 	float rain_gauge = rain_num_seen * config->rain_gauge_multiplier;
 
-	_argent_80422_rain_gauge_total(&config->rain_gauge_1h,
-				       &config->num_rain_gauge_1h_samples,
-					3600000, rain_gauge, config);
-	_argent_80422_rain_gauge_total(&config->rain_gauge_6h,
-				       &config->num_rain_gauge_6h_samples,
-					21600000, rain_gauge, config);
-	_argent_80422_rain_gauge_total(&config->rain_gauge_24h,
-				       &config->num_rain_gauge_24h_samples,
-					86400000, rain_gauge, config);
+	uint64_t now_usecs = config->hw->monotonic_usecs();
 
-	yadl_result *result = malloc(sizeof(*result));
+	rain_window_add(&config->rain_1h, now_usecs, rain_gauge);
+	rain_window_add(&config->rain_6h, now_usecs, rain_gauge);
+	rain_window_add(&config->rain_24h, now_usecs, rain_gauge);
 
-	result->value = malloc(sizeof(float) * 18);
+	if (config->state != NULL)
+		_save_rain_state(config, now_usecs);
 
 	result->value[0] = wind_direction;
 	result->value[1] = wind_speed;
 
-	pthread_mutex_lock(&_wind_rain_mutex);
-
-	result->value[2] = _get_average_values(config->wind_directions_2m,
-					       NUM_WIND_2_MIN_SAMPLES);
-	result->value[3] = _get_average_values(config->wind_speeds_2m,
-					       NUM_WIND_2_MIN_SAMPLES);
-
-	int wind_gust_2m_idx = _get_wind_gust_index(config->wind_speeds_2m,
-						    NUM_WIND_2_MIN_SAMPLES);
-
-	result->value[4] = config->wind_directions_2m[wind_gust_2m_idx];
-	result->value[5] = config->wind_speeds_2m[wind_gust_2m_idx];
-
-	result->value[6] = _get_average_values(config->wind_directions_10m,
-					       NUM_WIND_10_MIN_SAMPLES);
-	result->value[7] = _get_average_values(config->wind_speeds_10m,
-					       NUM_WIND_10_MIN_SAMPLES);
-
-	int wind_gust_10m_idx = _get_wind_gust_index(config->wind_speeds_10m,
-						     NUM_WIND_10_MIN_SAMPLES);
-
-	result->value[8] = config->wind_directions_10m[wind_gust_10m_idx];
-	result->value[9] = config->wind_speeds_10m[wind_gust_10m_idx];
-
-	result->value[10] = _get_average_values(config->wind_directions_60m,
-						NUM_WIND_60_MIN_SAMPLES);
-	result->value[11] = _get_average_values(config->wind_speeds_60m,
-						NUM_WIND_60_MIN_SAMPLES);
-
-	int wind_gust_60m_idx = _get_wind_gust_index(config->wind_speeds_60m,
-						     NUM_WIND_60_MIN_SAMPLES);
-
-	result->value[12] = config->wind_directions_60m[wind_gust_60m_idx];
-	result->value[13] = config->wind_speeds_60m[wind_gust_60m_idx];
-
-	int num_rain_clicks_today = config->num_rain_clicks_today;
-
-	pthread_mutex_unlock(&_wind_rain_mutex);
-
-	result->value[14] = rain_gauge;
-	result->value[15] = list_sum(config->rain_gauge_1h);
-	result->value[16] = list_sum(config->rain_gauge_6h);
-	result->value[17] = list_sum(config->rain_gauge_24h);
-	result->value[18] = num_rain_clicks_today *
+	/*
+	 * The four values for each wind window come first, then the rain,
+	 * then the direction spread of each window.
+	 */
+	int num_windows = config->wind_windows.num_windows;
+	float *rain_values = &result->value[2 + num_windows * 4];
+	float *stddev_values = &rain_values[5];
+	int num_rain_clicks_today = _get_wind_stats(config, &result->value[2],
+						    stddev_values);
+
+	int num_unstable_total = atomic_load(&config->wind_vane_num_unstable);
+	int num_unstable = num_unstable_total -
+		config->wind_vane_last_num_unstable;
+
+	config->wind_vane_last_num_unstable = num_unstable_total;
+
+	rain_values[0] = rain_gauge;
+	rain_values[1] = rain_window_total(&config->rain_1h);
+	rain_values[2] = rain_window_total(&config->rain_6h);
+	rain_values[3] = rain_window_total(&config->rain_24h);
+	rain_values[4] = num_rain_clicks_today *
 		config->rain_gauge_multiplier;
+	stddev_values[num_windows] = num_unstable;
 
 	config->logger("current wind stats: wind_num_seen=%d, avg_wind_cps=%.1f, wind_speed=%.1f %s\n",
 			wind_num_seen, avg_wind_cps, wind_speed,
 			config->wind_speed_unit);
 
-	config->logger("2 minute wind stats: average direction=%.1f, average speed=%.1f, gust direction=%.1f, gust speed=%.1f\n",
-			result->value[2], result->value[3], result->value[4],
-			result->value[5]);
-
-	config->logger("10 minute wind stats: average direction=%.1f, average speed=%.1f, gust direction=%.1f, gust speed=%.1f\n",
-			result->value[6], result->value[7], result->value[8],
-			result->value[9]);
+	for (int i = 0; i < num_windows; i++) {
+		float *values = &result->value[2 + i * 4];
 
-	config->logger("60 minute wind stats: average direction=%.1f, average speed=%.1f, gust direction=%.1f, gust speed=%.1f\n",
-			result->value[10], result->value[11], result->value[12],
-			result->value[13]);
+		config->logger("%s wind stats: average direction=%.1f, direction stddev=%.1f, average speed=%.1f, gust direction=%.1f, gust speed=%.1f\n",
+				config->wind_windows.windows[i].name,
+				values[0], stddev_values[i], values[1],
+				values[2], values[3]);
+	}
 
 	config->logger("rain_num_seen=%d, rain_gauge: cur=%.1f, 1h=%.1f, 6h=%.1f, 24h=%.1f, since midnight=%1.f\n",
-			rain_num_seen, rain_gauge, result->value[15],
-			result->value[16], result->value[17],
-			result->value[18]);
+			rain_num_seen, rain_gauge, rain_values[1],
+			rain_values[2], rain_values[3], rain_values[4]);
 
-	result->unit = malloc(sizeof(char *) * 2);
 	result->unit[0] = config->wind_speed_unit;
 	result->unit[1] = config->rain_gauge_unit;
 
-	return result;
+	return 0;
 }
 
-static char *_argent_80422_value_header_names[] = {
-	"wind_dir_cur", "wind_speed_cur", "wind_dir_avg_2m",
-	"wind_speed_avg_2m", "wind_dir_gust_2m", "wind_speed_gust_2m",
-	"wind_dir_avg_10m", "wind_speed_avg_10m", "wind_dir_gust_10m",
-	"wind_speed_gust_10m", "wind_dir_avg_60m", "wind_speed_avg_60m",
-	"wind_dir_gust_60m", "wind_speed_gust_60m", "rain_gauge_cur",
-	"rain_gauge_1h", "rain_gauge_6h", "rain_gauge_24h", "rain_gauge_today",
+static char *_argent_80422_window_header_names[] = {
+	"wind_dir_avg", "wind_speed_avg", "wind_dir_gust", "wind_speed_gust",
 	NULL
 };
 
-static char **_argent_80422_get_value_header_names(__attribute__((__unused__))
-						   yadl_config *config)
+static char *_argent_80422_rain_header_names[] = {
+	"rain_gauge_cur", "rain_gauge_1h", "rain_gauge_6h", "rain_gauge_24h",
+	"rain_gauge_today", NULL
+};
+
+static char *_window_header_name(char *prefix, char *window_name)
+{
+	int len = strlen(prefix) + strlen(window_name) + 2;
+	char *ret = yadl_malloc(len);
+
+	snprintf(ret, len, "%s_%s", prefix, window_name);
+	return ret;
+}
+
+/* The headers depend on the --wind_windows */
+static char **_argent_80422_get_value_header_names(yadl_config *config)
 {
-	return _argent_80422_value_header_names;
+	if (config->wind_value_header_names != NULL)
+		return config->wind_value_header_names;
+
+	_init_wind_windows(config);
+
+	wind_windows *ws = &config->wind_windows;
+	char **names = yadl_calloc(2 + ws->num_windows * 5 + 5 + 1 + 1,
+				   sizeof(char *));
+	int num = 0;
+
+	names[num++] = "wind_dir_cur";
+	names[num++] = "wind_speed_cur";
+
+	for (int i = 0; i < ws->num_windows; i++) {
+		for (char **prefix = _argent_80422_window_header_names;
+		     *prefix != NULL; prefix++)
+			names[num++] = _window_header_name(*prefix,
+							   ws->windows[i].name);
+	}
+
+	for (char **name = _argent_80422_rain_header_names; *name != NULL;
+	     name++)
+		names[num++] = *name;
+
+	for (int i = 0; i < ws->num_windows; i++)
+		names[num++] = _window_header_name("wind_dir_stddev",
+						   ws->windows[i].name);
+
+	names[num++] = "wind_dir_unstable";
+
+	config->wind_value_header_names = names;
+	return names;
 }
 
 static char *_argent_80422_unit_header_names[] = {
@@ -509,5 +792,6 @@ sensor argent_80422_sensor_funcs = {
 	.init = &_argent_80422_init,
 	.get_value_header_names = &_argent_80422_get_value_header_names,
 	.get_unit_header_names = &_argent_80422_get_unit_header_names,
-	.read = _argent_80422_read_data
+	.read = _argent_80422_read_data,
+	.single_instance = 1
 };
@@ -62,7 +62,6 @@
 #include <stdint.h>
 #include <time.h>
 #include <math.h>
-#include <wiringPiI2C.h>
 #include "yadl.h"
 
 #define BME280_REGISTER_DIG_T1        0x88
@@ -95,9 +94,27 @@
 #define BME280_REGISTER_TEMPDATA      0xFA
 #define BME280_REGISTER_HUMIDDATA     0xFD
 
+#define BME280_CHIPID                 0x60
+
+/* The calibration data is in two blocks of registers */
+#define BME280_CALIB_TP_LEN           26
+#define BME280_CALIB_H_LEN            7
+
+/* The pressure, temperature and humidity registers F7 through FE */
+#define BME280_DATA_LEN               8
+
+/* Oversampling x 1 for all three measurements */
+#define BME280_OVERSAMPLING_T         1
+#define BME280_OVERSAMPLING_P         1
+#define BME280_OVERSAMPLING_H         1
+#define BME280_OSRS_X1                0x01
+
+/* Takes one measurement and then goes back to sleep */
+#define BME280_MODE_FORCED            0x01
+
 #define MEAN_SEA_LEVEL_PRESSURE       1013
 
-typedef struct {
+struct bme280_calib_data_tag {
 	uint16_t dig_T1;
 	int16_t  dig_T2;
 	int16_t  dig_T3;
@@ -118,7 +135,7 @@ typedef struct {
 	int16_t  dig_H4;
 	int16_t  dig_H5;
 	int8_t   dig_H6;
-} bme280_calib_data;
+};
 
 typedef struct {
 	uint8_t pmsb;
@@ -152,46 +169,63 @@ static int32_t bme280_get_temperature_calibration(bme280_calib_data *cal,
 	return var1 + var2;
 }
 
-static void bme280_read_calibration_data(int fd, bme280_calib_data *data)
+static uint16_t _le16(uint8_t *data)
+{
+	return data[0] | (data[1] << 8);
+}
+
+/*
+ * Reads all of the calibration registers with two block reads. They do not
+ * change so this is only done once.
+ */
+static int bme280_read_calibration_data(hw_backend *hw, int fd,
+					bme280_calib_data *data)
+{
+	uint8_t tp[BME280_CALIB_TP_LEN], h[BME280_CALIB_H_LEN];
+
+	if (hw->i2c_read_block(fd, BME280_REGISTER_DIG_T1, tp,
+			       sizeof(tp)) != sizeof(tp) ||
+	    hw->i2c_read_block(fd, BME280_REGISTER_DIG_H2, h,
+			       sizeof(h)) != sizeof(h))
+		return -1;
+
+	data->dig_T1 = _le16(&tp[BME280_REGISTER_DIG_T1 - 0x88]);
+	data->dig_T2 = (int16_t) _le16(&tp[BME280_REGISTER_DIG_T2 - 0x88]);
+	data->dig_T3 = (int16_t) _le16(&tp[BME280_REGISTER_DIG_T3 - 0x88]);
+
+	data->dig_P1 = _le16(&tp[BME280_REGISTER_DIG_P1 - 0x88]);
+	data->dig_P2 = (int16_t) _le16(&tp[BME280_REGISTER_DIG_P2 - 0x88]);
+	data->dig_P3 = (int16_t) _le16(&tp[BME280_REGISTER_DIG_P3 - 0x88]);
+	data->dig_P4 = (int16_t) _le16(&tp[BME280_REGISTER_DIG_P4 - 0x88]);
+	data->dig_P5 = (int16_t) _le16(&tp[BME280_REGISTER_DIG_P5 - 0x88]);
+	data->dig_P6 = (int16_t) _le16(&tp[BME280_REGISTER_DIG_P6 - 0x88]);
+	data->dig_P7 = (int16_t) _le16(&tp[BME280_REGISTER_DIG_P7 - 0x88]);
+	data->dig_P8 = (int16_t) _le16(&tp[BME280_REGISTER_DIG_P8 - 0x88]);
+	data->dig_P9 = (int16_t) _le16(&tp[BME280_REGISTER_DIG_P9 - 0x88]);
+
+	data->dig_H1 = tp[BME280_REGISTER_DIG_H1 - 0x88];
+	data->dig_H2 = (int16_t) _le16(&h[BME280_REGISTER_DIG_H2 - 0xE1]);
+	data->dig_H3 = h[BME280_REGISTER_DIG_H3 - 0xE1];
+
+	/* H4 and H5 are 12 bits and share the nibbles of register E5 */
+	data->dig_H4 = ((int8_t) h[BME280_REGISTER_DIG_H4 - 0xE1] << 4) |
+		(h[BME280_REGISTER_DIG_H4 + 1 - 0xE1] & 0xF);
+	data->dig_H5 = ((int8_t) h[BME280_REGISTER_DIG_H5 + 1 - 0xE1] << 4) |
+		(h[BME280_REGISTER_DIG_H5 - 0xE1] >> 4);
+	data->dig_H6 = (int8_t) h[BME280_REGISTER_DIG_H6 - 0xE1];
+
+	return 0;
+}
+
+/*
+ * The maximum time that a forced measurement takes from section 9.1 of
+ * the data sheet
+ */
+static unsigned int bme280_measurement_usecs(void)
 {
-	data->dig_T1 = (uint16_t) wiringPiI2CReadReg16(fd,
-						       BME280_REGISTER_DIG_T1);
-	data->dig_T2 = (int16_t) wiringPiI2CReadReg16(fd,
-						      BME280_REGISTER_DIG_T2);
-	data->dig_T3 = (int16_t) wiringPiI2CReadReg16(fd,
-						      BME280_REGISTER_DIG_T3);
-
-	data->dig_P1 = (uint16_t) wiringPiI2CReadReg16(fd,
-						       BME280_REGISTER_DIG_P1);
-	data->dig_P2 = (int16_t) wiringPiI2CReadReg16(fd,
-						      BME280_REGISTER_DIG_P2);
-	data->dig_P3 = (int16_t) wiringPiI2CReadReg16(fd,
-						      BME280_REGISTER_DIG_P3);
-	data->dig_P4 = (int16_t) wiringPiI2CReadReg16(fd,
-						      BME280_REGISTER_DIG_P4);
-	data->dig_P5 = (int16_t) wiringPiI2CReadReg16(fd,
-						      BME280_REGISTER_DIG_P5);
-	data->dig_P6 = (int16_t) wiringPiI2CReadReg16(fd,
-						      BME280_REGISTER_DIG_P6);
-	data->dig_P7 = (int16_t) wiringPiI2CReadReg16(fd,
-						      BME280_REGISTER_DIG_P7);
-	data->dig_P8 = (int16_t) wiringPiI2CReadReg16(fd,
-						      BME280_REGISTER_DIG_P8);
-	data->dig_P9 = (int16_t) wiringPiI2CReadReg16(fd,
-						      BME280_REGISTER_DIG_P9);
-
-	data->dig_H1 = (uint8_t) wiringPiI2CReadReg8(fd,
-						     BME280_REGISTER_DIG_H1);
-	data->dig_H2 = (int16_t) wiringPiI2CReadReg16(fd,
-						      BME280_REGISTER_DIG_H2);
-	data->dig_H3 = (uint8_t) wiringPiI2CReadReg8(fd,
-						     BME280_REGISTER_DIG_H3);
-	data->dig_H4 = (wiringPiI2CReadReg8(fd, BME280_REGISTER_DIG_H4) << 4) |
-		(wiringPiI2CReadReg8(fd, BME280_REGISTER_DIG_H4+1) & 0xF);
-	data->dig_H5 = (wiringPiI2CReadReg8(fd,
-					    BME280_REGISTER_DIG_H5+1) << 4) |
-		(wiringPiI2CReadReg8(fd, BME280_REGISTER_DIG_H5) >> 4);
-	data->dig_H6 = (int8_t) wiringPiI2CReadReg8(fd, BME280_REGISTER_DIG_H6);
+	return 1250 + 2300 * BME280_OVERSAMPLING_T +
+		2300 * BME280_OVERSAMPLING_P + 575 +
+		2300 * BME280_OVERSAMPLING_H + 575;
 }
 
 static float bme280_compensate_temperature(uint32_t t_fine)
@@ -251,20 +285,18 @@ static float bme280_compensate_humidity(uint32_t adc_H, bme280_calib_data *cal,
 	return  h / 1024.0;
 }
 
-static void bme280_get_raw_data(int fd, bme280_raw_data *raw)
+static void bme280_parse_raw_data(uint8_t *data, bme280_raw_data *raw)
 {
-	wiringPiI2CWrite(fd, 0xf7);
-
-	raw->pmsb = wiringPiI2CRead(fd);
-	raw->plsb = wiringPiI2CRead(fd);
-	raw->pxsb = wiringPiI2CRead(fd);
+	raw->pmsb = data[0];
+	raw->plsb = data[1];
+	raw->pxsb = data[2];
 
-	raw->tmsb = wiringPiI2CRead(fd);
-	raw->tlsb = wiringPiI2CRead(fd);
-	raw->txsb = wiringPiI2CRead(fd);
+	raw->tmsb = data[3];
+	raw->tlsb = data[4];
+	raw->txsb = data[5];
 
-	raw->hmsb = wiringPiI2CRead(fd);
-	raw->hlsb = wiringPiI2CRead(fd);
+	raw->hmsb = data[6];
+	raw->hlsb = data[7];
 
 	raw->temperature = 0;
 	raw->temperature = (raw->temperature | raw->tmsb) << 8;
@@ -308,52 +340,78 @@ static void _bme280_init(yadl_config *config)
 		usage();
 	}
 
-	config->fd = wiringPiI2CSetup(config->i2c_address);
+	hw_backend *hw = config->hw;
+
+	config->fd = hw->i2c_setup(config->i2c_address);
 	if (config->fd < 0) {
 		fprintf(stderr, "i2c device not found at address %x\n",
 			config->i2c_address);
 		usage();
 	}
 
+	int chip_id = hw->i2c_read_reg8(config->fd, BME280_REGISTER_CHIPID);
+
+	if (chip_id != BME280_CHIPID) {
+		fprintf(stderr, "The i2c device at address %x is not a BME280 (chip id 0x%02x)\n",
+			config->i2c_address, chip_id);
+		exit(1);
+	}
+
+	config->bme280_calib = yadl_malloc(sizeof(bme280_calib_data));
+	if (bme280_read_calibration_data(hw, config->fd,
+					 config->bme280_calib) < 0) {
+		fprintf(stderr, "bme280: Error reading the calibration data\n");
+		exit(1);
+	}
+
+	/* This is used once the measurement is started through ctrl_meas */
+	hw->i2c_write_reg8(config->fd, BME280_REGISTER_CONTROLHUMID,
+			   BME280_OSRS_X1);
 }
 
-static yadl_result *_bme280_read_data(yadl_config *config)
+static int _bme280_read_data(yadl_config *config, yadl_result *result)
 {
-	bme280_calib_data cal;
-
-	bme280_read_calibration_data(config->fd, &cal);
+	hw_backend *hw = config->hw;
+	bme280_calib_data *cal = config->bme280_calib;
+	uint8_t data[BME280_DATA_LEN];
+
+	/* Pressure and temperature oversampling x 1, forced mode */
+	if (hw->i2c_write_reg8(config->fd, BME280_REGISTER_CONTROL,
+			       (BME280_OSRS_X1 << 5) | (BME280_OSRS_X1 << 2) |
+			       BME280_MODE_FORCED) < 0) {
+		config->logger("bme280: Error starting the measurement. Retrying.\n");
+		return -1;
+	}
 
-	// humidity oversampling x 1
-	wiringPiI2CWriteReg8(config->fd, 0xf2, 0x01);
+	hw->delay_microseconds(bme280_measurement_usecs());
 
-	// pressure and temperature oversampling x 1, mode normal
-	wiringPiI2CWriteReg8(config->fd, 0xf4, 0x25);
+	if (hw->i2c_read_block(config->fd, BME280_REGISTER_PRESSUREDATA, data,
+			       sizeof(data)) != sizeof(data)) {
+		config->logger("bme280: Error reading the measurement. Retrying.\n");
+		return -1;
+	}
 
 	bme280_raw_data raw;
 
-	bme280_get_raw_data(config->fd, &raw);
+	bme280_parse_raw_data(data, &raw);
 
-	uint32_t t_fine = bme280_get_temperature_calibration(&cal,
+	uint32_t t_fine = bme280_get_temperature_calibration(cal,
 							     raw.temperature);
 	float temperature = bme280_compensate_temperature(t_fine);
-	float humidity = bme280_compensate_humidity(raw.humidity, &cal, t_fine);
-	float pressure = bme280_compensate_pressure(raw.pressure, &cal,
+	float humidity = bme280_compensate_humidity(raw.humidity, cal, t_fine);
+	float pressure = bme280_compensate_pressure(raw.pressure, cal,
 						    t_fine) / 100;
 	float altitude = bme280_get_altitude(pressure);
 
-	yadl_result *result = malloc(sizeof(*result));
-
-	result->value = malloc(sizeof(float) * 5);
 	result->value[0] = config->temperature_converter(temperature);
 	result->value[1] = humidity;
 	result->value[2] = pressure;
 	result->value[3] = pressure * 0.0295301;
 	result->value[4] = altitude;
 
-	result->unit = malloc(sizeof(char *) * 1);
 	result->unit[0] = config->temperature_unit;
 
-	return result;
+	return 0;
 }
 
 static char *_bme280_value_header_names[] = {
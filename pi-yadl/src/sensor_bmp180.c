@@ -26,7 +26,6 @@
  * SOFTWARE.
  */
 
-#include <wiringPiI2C.h>
 #include <stdint.h>
 #include <string.h>
 #include <stdbool.h>
@@ -91,6 +90,7 @@
 
 // Basic structure for the bmp180 sensor
 typedef struct {
+	hw_backend *hw;
 	int fd;
 
 	/* BMP180 oversampling mode */
@@ -138,7 +138,7 @@ static void bmp180_read_eprom(bmp180_t *bmp)
 		uint8_t reg = (uint8_t) bmp180_register_table[i][0];
 		uint8_t sign = (uint8_t) bmp180_register_table[i][1];
 
-		int32_t data = wiringPiI2CReadReg16(bmp->fd, reg) & 0xFFFF;
+		int32_t data = bmp->hw->i2c_read_reg16(bmp->fd, reg) & 0xFFFF;
 		*(bmp180_register_addr[i]) = ((data << 8) & 0xFF00) +
 			(data >> 8);
 		if (sign && (*(bmp180_register_addr[i]) > 32767))
@@ -149,12 +149,12 @@ static void bmp180_read_eprom(bmp180_t *bmp)
 // Returns the raw measured temperature value of this BMP180 sensor.
 static int32_t bmp180_read_raw_temperature(bmp180_t *bmp)
 {
-	wiringPiI2CWriteReg8(bmp->fd, BMP180_CTRL, BMP180_TEMPERATURE_READ_CMD);
+	bmp->hw->i2c_write_reg8(bmp->fd, BMP180_CTRL, BMP180_TEMPERATURE_READ_CMD);
 
-	usleep(BMP180_TEMPERATURE_READ_WAIT_US);
+	bmp->hw->delay_microseconds(BMP180_TEMPERATURE_READ_WAIT_US);
 
-	int32_t data = wiringPiI2CReadReg16(bmp->fd,
-					    BMP180_REGISTER_TEMPERATURE) & 0xFFFF;
+	int32_t data = bmp->hw->i2c_read_reg16(bmp->fd,
+					       BMP180_REGISTER_TEMPERATURE) & 0xFFFF;
 
 	data = ((data << 8) & 0xFF00) + (data >> 8);
 	return data;
@@ -187,16 +187,16 @@ static int32_t bmp180_read_raw_pressure(bmp180_t *bmp)
 		break;
 	}
 
-	wiringPiI2CWriteReg8(bmp->fd, BMP180_CTRL, cmd);
+	bmp->hw->i2c_write_reg8(bmp->fd, BMP180_CTRL, cmd);
 
-	usleep(wait);
+	bmp->hw->delay_microseconds(wait);
 
-	int32_t msb = wiringPiI2CReadReg8(bmp->fd,
-					  BMP180_REGISTER_PRESSURE) & 0xFF;
-	int32_t lsb = wiringPiI2CReadReg8(bmp->fd,
-					  BMP180_REGISTER_PRESSURE+1) & 0xFF;
-	int32_t xlsb = wiringPiI2CReadReg8(bmp->fd,
-					   BMP180_REGISTER_PRESSURE+2) & 0xFF;
+	int32_t msb = bmp->hw->i2c_read_reg8(bmp->fd,
+					     BMP180_REGISTER_PRESSURE) & 0xFF;
+	int32_t lsb = bmp->hw->i2c_read_reg8(bmp->fd,
+					     BMP180_REGISTER_PRESSURE+1) & 0xFF;
+	int32_t xlsb = bmp->hw->i2c_read_reg8(bmp->fd,
+					      BMP180_REGISTER_PRESSURE+2) & 0xFF;
 
 	return ((msb << 16) + (lsb << 8) + xlsb) >> (8 - bmp->oss);
 }
@@ -275,7 +275,7 @@ static void _bmp180_init(yadl_config *config)
 		usage();
 	}
 
-	config->fd = wiringPiI2CSetup(config->i2c_address);
+	config->fd = config->hw->i2c_setup(config->i2c_address);
 	if (config->fd < 0) {
 		fprintf(stderr, "i2c device not found at address %x\n",
 			config->i2c_address);
@@ -284,11 +284,12 @@ static void _bmp180_init(yadl_config *config)
 
 }
 
-static yadl_result *_bmp180_read_data(yadl_config *config)
+static int _bmp180_read_data(yadl_config *config, yadl_result *result)
 {
 	bmp180_t bmp;
 
 	memset(&bmp, 0, sizeof(bmp));
+	bmp.hw = config->hw;
 	bmp.fd = config->fd;
 	bmp.oss = BMP180_PRESSURE_OSS_ULTRA_HIGH_RESOLUTION;
 	bmp180_read_eprom(&bmp);
@@ -297,18 +298,14 @@ static yadl_result *_bmp180_read_data(yadl_config *config)
 	float pressure = bmp180_pressure(&bmp) / 100.0;
 	float altitude = bmp180_altitude(&bmp);
 
-	yadl_result *result = malloc(sizeof(*result));
-
-	result->value = malloc(sizeof(float) * 4);
 	result->value[0] = config->temperature_converter(temperature);
 	result->value[1] = pressure;
 	result->value[2] = pressure * 0.0295301;
 	result->value[3] = altitude;
 
-	result->unit = malloc(sizeof(char *) * 1);
 	result->unit[0] = config->temperature_unit;
 
-	return result;
+	return 0;
 }
 
 static char *_bmp180_value_header_names[] = {
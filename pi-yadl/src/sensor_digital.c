@@ -19,50 +19,254 @@
  * 02110-1301, USA.
  */
 
-#include <wiringPi.h>
 #include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include "yadl.h"
 
-static void _digital_init(__attribute__((__unused__)) yadl_config * config)
+#define DIGITAL_CHANGES_RING_SIZE	256
+
+/*
+ * State for --edge_triggered. The interrupt handler queues each change of
+ * the pin's level and wakes up the main loop, which writes a result for
+ * it. Each queued entry is the time of the change shifted left by one
+ * with the new level in the low bit.
+ *
+ * --debounce_usecs locks the handler out for a while after each change
+ * that it queues. An edge that comes in during that window is thrown away,
+ * so the handler asks the main loop to read the pin again once the window
+ * is over in case the pin did not end up where the last queued change
+ * left it.
+ */
+struct digital_edges_tag {
+	int gpio_pin;
+	hw_backend *hw;
+	int debounce_usecs;
+
+	/* Only used by the interrupt handler */
+	uint64_t last_change_usecs;
+
+	pulse_ring changes;
+
+	/* When the main loop needs to read the pin again, or 0 */
+	atomic_uint_fast64_t settle_usecs;
+
+	/* Only used by the main loop */
+	int level;
+	int has_next;
+	uint64_t next_entry;
+	uint64_t min_result_usecs;
+	uint64_t last_result_usecs;
+	uint64_t last_num_dropped;
+};
+
+static void _digital_edge_handler(void *arg)
+{
+	digital_edges *edges = arg;
+	uint64_t usecs = edges->hw->event_usecs();
+	int level = edges->hw->event_level(edges->gpio_pin);
+
+	if (usecs - edges->last_change_usecs <
+	    (uint64_t) edges->debounce_usecs) {
+		atomic_store(&edges->settle_usecs, edges->last_change_usecs +
+			     edges->debounce_usecs);
+		edges->hw->notify_event();
+		return;
+	}
+
+	/*
+	 * Full rings are counted in num_dropped, and the pin is read again
+	 * once the main loop catches up.
+	 */
+	if (pulse_ring_push(&edges->changes, (usecs << 1) | level) == 0)
+		edges->last_change_usecs = usecs;
+	else
+		atomic_store(&edges->settle_usecs, usecs);
+
+	edges->hw->notify_event();
+}
+
+/*
+ * Finds the next change from the level that was last written. Queued
+ * entries that end on the same level are bounces and are skipped. Once the
+ * queue is empty and a debounce window that threw an edge away is over,
+ * the pin is read again. Returns 0 when next_entry has the change.
+ */
+static int _digital_find_next_change(digital_edges *edges)
+{
+	uint64_t entry;
+
+	if (edges->has_next)
+		return 0;
+
+	while (pulse_ring_pop(&edges->changes, &entry) == 0) {
+		if ((int) (entry & 1) == edges->level)
+			continue;
+
+		edges->next_entry = entry;
+		edges->has_next = 1;
+		return 0;
+	}
+
+	uint64_t settle_usecs = atomic_load(&edges->settle_usecs);
+
+	if (settle_usecs == 0 || edges->hw->monotonic_usecs() < settle_usecs)
+		return -1;
+
+	atomic_compare_exchange_strong(&edges->settle_usecs, &settle_usecs, 0);
+
+	int level = edges->hw->digital_read(edges->gpio_pin);
+
+	if (level == edges->level)
+		return -1;
+
+	edges->next_entry = (settle_usecs << 1) | level;
+	edges->has_next = 1;
+	return 0;
+}
+
+static void _digital_init_edges(yadl_config *config)
+{
+	if (config->debounce_usecs < 0) {
+		fprintf(stderr, "--debounce_usecs must be >= 0\n");
+		usage();
+	} else if (config->max_changes_per_sec < 0) {
+		fprintf(stderr, "--max_changes_per_sec must be >= 0\n");
+		usage();
+	}
+
+	digital_edges *edges = yadl_calloc(1, sizeof(*edges));
+
+	edges->gpio_pin = config->gpio_pin;
+	edges->hw = config->hw;
+	edges->debounce_usecs = config->debounce_usecs;
+	edges->level = config->hw->digital_read(config->gpio_pin);
+	atomic_init(&edges->settle_usecs, 0);
+	pulse_ring_init(&edges->changes, DIGITAL_CHANGES_RING_SIZE);
+
+	if (config->max_changes_per_sec > 0)
+		edges->min_result_usecs = 1000000 /
+			config->max_changes_per_sec;
+
+	config->digital_edges = edges;
+
+	config->logger("Waiting for changes on GPIO pin %d, which is %d\n",
+			config->gpio_pin, edges->level);
+
+	hw_isr_with_arg(config->hw, config->gpio_pin, HW_EDGE_BOTH,
+			&_digital_edge_handler, edges);
+}
+
+static void _digital_init(yadl_config *config)
 {
 	if (config->gpio_pin == -1) {
 		fprintf(stderr, "You must specify the --gpio_pin argument\n");
 		usage();
 	}
 
-	pinMode(config->gpio_pin, INPUT);
+	config->hw->pin_mode(config->gpio_pin, HW_INPUT);
+
+	if (config->edge_triggered)
+		_digital_init_edges(config);
 }
 
-static yadl_result *_digital_read_data(yadl_config *config)
+static uint64_t _digital_next_edge_usecs(yadl_config *config)
 {
-	int reading = digitalRead(config->gpio_pin);
+	digital_edges *edges = config->digital_edges;
+
+	if (_digital_find_next_change(edges) < 0) {
+		uint64_t settle_usecs = atomic_load(&edges->settle_usecs);
+
+		return settle_usecs != 0 ? settle_usecs : HW_WAIT_FOREVER;
+	}
+
+	uint64_t usecs = edges->next_entry >> 1;
+
+	/* --max_changes_per_sec holds the changes back and merges them */
+	if (edges->last_result_usecs != 0 &&
+	    usecs < edges->last_result_usecs + edges->min_result_usecs)
+		usecs = edges->last_result_usecs + edges->min_result_usecs;
+
+	return usecs;
+}
+
+static int _digital_read_edge(yadl_config *config, yadl_result *result)
+{
+	digital_edges *edges = config->digital_edges;
+	hw_backend *hw = config->hw;
+	uint64_t last_entry = 0;
+	int num_changes = 0;
+
+	while (_digital_find_next_change(edges) == 0) {
+		last_entry = edges->next_entry;
+		edges->level = last_entry & 1;
+		edges->has_next = 0;
+		num_changes++;
+
+		if (edges->min_result_usecs == 0)
+			break;
+	}
+
+	uint64_t num_dropped = atomic_load(&edges->changes.num_dropped);
+
+	num_changes += num_dropped - edges->last_num_dropped;
+	edges->last_num_dropped = num_dropped;
+
+	if (num_changes == 0)
+		return -1;
+
+	uint64_t change_usecs = last_entry >> 1;
+	int level = edges->level;
+	uint64_t realtime_usecs = hw->realtime_usecs() -
+		(hw->monotonic_usecs() - change_usecs);
+
+	edges->last_result_usecs = hw->monotonic_usecs();
+
+	config->logger("GPIO pin %d changed to %d at %llu (%d changes)\n",
+			config->gpio_pin, level,
+			(unsigned long long) realtime_usecs, num_changes);
+
+	result->timestamp = realtime_usecs / 1000000;
+	result->value[0] = level;
+	result->value[1] = realtime_usecs % 1000000;
+	result->value[2] = num_changes;
+
+	return 0;
+}
+
+static int _digital_read_data(yadl_config *config, yadl_result *result)
+{
+	if (config->edge_triggered)
+		return _digital_read_edge(config, result);
+
+	int reading = config->hw->digital_read(config->gpio_pin);
 
 	config->logger("Got digital reading %d from GPIO pin %d.\n",
 			reading, config->gpio_pin);
 
-	yadl_result *result = malloc(sizeof(*result));
-
-	result->value = malloc(sizeof(float) * 1);
 	result->value[0] = reading;
 
-	result->unit = NULL;
-
-	return result;
+	return 0;
 }
 
 static char *_digital_value_header_names[] = { "pin_state", NULL };
 
-static char **_digital_get_value_header_names(__attribute__((__unused__))
-					      yadl_config *config)
+static char *_digital_edge_value_header_names[] = {
+	"pin_state", "timestamp_usecs", "num_changes", NULL
+};
+
+static char **_digital_get_value_header_names(yadl_config *config)
 {
+	if (config->edge_triggered)
+		return _digital_edge_value_header_names;
+
 	return _digital_value_header_names;
 }
 
 sensor digital_sensor_funcs = {
 	.init = &_digital_init,
 	.get_value_header_names = &_digital_get_value_header_names,
-	.read = _digital_read_data
+	.read = _digital_read_data,
+	.next_edge_usecs = &_digital_next_edge_usecs
 };
@@ -19,23 +19,67 @@
  * 02110-1301, USA.
  */
 
-#include <wiringPi.h>
-#include <errno.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <limits.h>
-#include <unistd.h>
-#include <sys/time.h>
 #include "yadl.h"
 
-static volatile int _interrupt_counter;
-static int _last_stop_counter;
-static struct timeval _last_time;
+#define COUNTER_MAX_PINS	8
 
-void _interrupt_handler(void)
+/*
+ * The edges seen on one pin. The interrupt handler is the only writer and
+ * the seqlock keeps num_edges and the edge times consistent for the reader.
+ * The rest is only used by the sensor instance that owns the pin.
+ */
+typedef struct counter_pin_tag {
+	int gpio_pin;
+	hw_backend *hw;
+
+	seqlock lock;
+	atomic_uint_fast64_t num_edges;
+	atomic_uint_fast64_t first_edge_usecs;
+	atomic_uint_fast64_t last_edge_usecs;
+
+	uint64_t last_num_edges;
+	uint64_t last_read_usecs;
+	uint64_t last_read_edge_usecs;
+	double last_counts_per_sec;
+} counter_pin;
+
+static counter_pin _counter_pins[COUNTER_MAX_PINS];
+static int _num_counter_pins;
+
+static void _count_edge(void *arg)
 {
-	_interrupt_counter++;
+	counter_pin *pin = arg;
+	uint64_t usecs = pin->hw->event_usecs();
+	uint64_t num_edges = atomic_load_explicit(&pin->num_edges,
+						  memory_order_relaxed);
+
+	seqlock_write_begin(&pin->lock);
+	if (num_edges == 0)
+		atomic_store_explicit(&pin->first_edge_usecs, usecs,
+				      memory_order_relaxed);
+	atomic_store_explicit(&pin->last_edge_usecs, usecs,
+			      memory_order_relaxed);
+	atomic_store_explicit(&pin->num_edges, num_edges + 1,
+			      memory_order_relaxed);
+	seqlock_write_end(&pin->lock);
+}
+
+static int _get_interrupt_edge(char *name)
+{
+	if (strcmp(name, "rising") == 0)
+		return HW_EDGE_RISING;
+	else if (strcmp(name, "falling") == 0)
+		return HW_EDGE_FALLING;
+	else if (strcmp(name, "both") == 0)
+		return HW_EDGE_BOTH;
+
+	fprintf(stderr, "Invalid --interrupt_edge paramter %s\n", name);
+	usage();
+	return -1;
 }
 
 static void _digital_counter_init(yadl_config *config)
@@ -45,75 +89,133 @@ static void _digital_counter_init(yadl_config *config)
 		usage();
 	}
 
-	config->logger("Using interrupt edge %s on GPIO pin %d\n",
-			config->interrupt_edge, config->gpio_pin);
-
-	if (strcmp(config->interrupt_edge, "rising") == 0)
-		wiringPiISR(config->gpio_pin, INT_EDGE_RISING,
-			    &_interrupt_handler);
-	else if (strcmp(config->interrupt_edge, "falling") == 0)
-		wiringPiISR(config->gpio_pin, INT_EDGE_FALLING,
-			    &_interrupt_handler);
-	else if (strcmp(config->interrupt_edge, "both") == 0)
-		wiringPiISR(config->gpio_pin, INT_EDGE_BOTH,
-			    &_interrupt_handler);
+	if (strcmp(config->counter_mode, "count") == 0)
+		config->counter_period_mode = 0;
+	else if (strcmp(config->counter_mode, "period") == 0)
+		config->counter_period_mode = 1;
 	else {
-		fprintf(stderr, "Invalid --interrupt_edge paramter %s\n",
-			config->interrupt_edge);
+		fprintf(stderr, "Invalid --counter_mode %s\n",
+			config->counter_mode);
 		usage();
 	}
 
-	gettimeofday(&_last_time, NULL);
+	int edge = _get_interrupt_edge(config->interrupt_edge);
 
-	/* Wait for the first sample */
-	if (config->sleep_millis_between_results > 0)
-		delay(config->sleep_millis_between_results);
-}
+	for (int i = 0; i < _num_counter_pins; i++) {
+		if (_counter_pins[i].gpio_pin == config->gpio_pin) {
+			fprintf(stderr, "GPIO pin %d is already counted by another sensor\n",
+				config->gpio_pin);
+			exit(1);
+		}
+	}
 
-static yadl_result *_digital_counter_read_data(yadl_config *config)
-{
-	int start_counter = _last_stop_counter;
-	int stop_counter = _interrupt_counter;
+	if (_num_counter_pins == COUNTER_MAX_PINS) {
+		fprintf(stderr, "Only %d counter pins are supported\n",
+			COUNTER_MAX_PINS);
+		exit(1);
+	}
 
-	_last_stop_counter = stop_counter;
+	config->counter_idx = _num_counter_pins++;
 
-	int num_seen;
-	/* Check to see if the number wrapped */
-	if (stop_counter < start_counter)
-		num_seen = (INT_MAX - start_counter) + stop_counter;
-	else
-		num_seen = stop_counter - start_counter;
+	counter_pin *pin = &_counter_pins[config->counter_idx];
 
-	config->logger("start=%d, stop=%d, num_seen=%d\n",
-			start_counter, stop_counter, num_seen);
+	/* The rest of the pin is still zeroed */
+	pin->gpio_pin = config->gpio_pin;
+	pin->hw = config->hw;
 
-	static struct timeval _current_time;
+	config->logger("Using interrupt edge %s on GPIO pin %d in %s mode\n",
+			config->interrupt_edge, config->gpio_pin,
+			config->counter_mode);
 
-	gettimeofday(&_current_time, NULL);
-	double elapsed_secs = ((_current_time.tv_sec - _last_time.tv_sec) *
-			       1000000L + _current_time.tv_usec -
-			       _last_time.tv_usec) / 1000000L;
+	hw_isr_with_arg(config->hw, config->gpio_pin, edge, &_count_edge, pin);
 
-	_last_time.tv_sec = _current_time.tv_sec;
-	_last_time.tv_usec = _current_time.tv_usec;
+	pin->last_read_usecs = config->hw->monotonic_usecs();
 
-	float counts_per_sec = num_seen / elapsed_secs;
+	/* Wait for the first sample */
+	if (config->sleep_millis_between_results > 0)
+		config->hw->delay(config->sleep_millis_between_results);
+}
 
-	config->logger("num_seen=%d, elapsed_secs=%.2f, counts_per_sec=%.2f, counter_multiplier=%.2f\n",
-			num_seen, elapsed_secs, counts_per_sec,
-			config->counter_multiplier);
+/*
+ * Uses the time between the last edge of the previous result and the last
+ * edge of this one so that a slow signal is not rounded to the number of
+ * whole edges that fit in the interval. With no new edges, the rate can be
+ * at most one edge since the last one so it decays towards 0.
+ */
+static double _get_period_counts_per_sec(counter_pin *pin, uint64_t num_edges,
+					 uint64_t first_edge_usecs,
+					 uint64_t last_edge_usecs,
+					 uint64_t now_usecs)
+{
+	uint64_t num_seen = num_edges - pin->last_num_edges;
+	double counts_per_sec = pin->last_counts_per_sec;
+
+	if (num_seen > 0 && pin->last_num_edges > 0 &&
+	    last_edge_usecs > pin->last_read_edge_usecs)
+		counts_per_sec = num_seen * 1000000.0 /
+			(last_edge_usecs - pin->last_read_edge_usecs);
+	else if (num_seen > 0 && num_edges > 1 &&
+		 last_edge_usecs > first_edge_usecs)
+		counts_per_sec = (num_edges - 1) * 1000000.0 /
+			(last_edge_usecs - first_edge_usecs);
+
+	if (num_edges > 0 && now_usecs > last_edge_usecs) {
+		double max_counts_per_sec = 1000000.0 /
+			(now_usecs - last_edge_usecs);
+
+		if (counts_per_sec > max_counts_per_sec)
+			counts_per_sec = max_counts_per_sec;
+	}
 
-	yadl_result *result = malloc(sizeof(*result));
+	return counts_per_sec;
+}
+
+static int _digital_counter_read_data(yadl_config *config, yadl_result *result)
+{
+	counter_pin *pin = &_counter_pins[config->counter_idx];
+	uint64_t num_edges, first_edge_usecs, last_edge_usecs;
+	unsigned int seq;
+
+	do {
+		seq = seqlock_read_begin(&pin->lock);
+		num_edges = atomic_load_explicit(&pin->num_edges,
+						 memory_order_relaxed);
+		first_edge_usecs = atomic_load_explicit(&pin->first_edge_usecs,
+							memory_order_relaxed);
+		last_edge_usecs = atomic_load_explicit(&pin->last_edge_usecs,
+						       memory_order_relaxed);
+	} while (seqlock_read_retry(&pin->lock, seq));
+
+	uint64_t now_usecs = config->hw->monotonic_usecs();
+	uint64_t num_seen = num_edges - pin->last_num_edges;
+	double elapsed_secs = (now_usecs - pin->last_read_usecs) / 1000000.0;
+	double counts_per_sec;
+
+	if (config->counter_period_mode)
+		counts_per_sec = _get_period_counts_per_sec(pin, num_edges,
+							    first_edge_usecs,
+							    last_edge_usecs,
+							    now_usecs);
+	else
+		counts_per_sec = elapsed_secs > 0 ? num_seen / elapsed_secs :
+			0.0;
+
+	config->logger("pin=%d, num_edges=%llu, num_seen=%llu, elapsed_secs=%.6f, counts_per_sec=%.4f, counter_multiplier=%.2f\n",
+			pin->gpio_pin, (unsigned long long) num_edges,
+			(unsigned long long) num_seen, elapsed_secs,
+			counts_per_sec, config->counter_multiplier);
+
+	pin->last_num_edges = num_edges;
+	pin->last_read_usecs = now_usecs;
+	pin->last_read_edge_usecs = last_edge_usecs;
+	pin->last_counts_per_sec = counts_per_sec;
 
-	result->value = malloc(sizeof(float) * 4);
 	result->value[0] = num_seen;
 	result->value[1] = num_seen * config->counter_multiplier;
 	result->value[2] = counts_per_sec;
 	result->value[3] = counts_per_sec * config->counter_multiplier;
 
-	result->unit = NULL;
-
-	return result;
+	return 0;
 }
 
 static char *_digital_counter_value_header_names[] = {
@@ -19,24 +19,28 @@
  * 02110-1301, USA.
  */
 
-#include <wiringPi.h>
+#include <errno.h>
 #include <math.h>
+#include <pthread.h>
+#include <sched.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
+#include <sys/mman.h>
+#include "dht_decoder.h"
 #include "yadl.h"
 
-#define BIT_ENABLED_THRESHOLD	      20
+/* The longest that the line stays in one state during the response */
 #define TIMEOUT_USECS                255
 
-static void _dht11_parse_data(int data[5], yadl_result *result)
+static void _dht11_parse_data(uint8_t data[5], yadl_result *result)
 {
 	result->value[0] = ((data[2] << 8) | data[3]) / 256.0;
 	result->value[1] = ((data[0] << 8) | data[1]) / 256.0;
 }
 
-static void _dht22_parse_data(int data[5], yadl_result *result)
+static void _dht22_parse_data(uint8_t data[5], yadl_result *result)
 {
 	result->value[0] = ((data[2] & 0x7F) * 256.0 + data[3]) / 10.0;
 	if (data[2] & 0x80)
@@ -45,22 +49,81 @@ static void _dht22_parse_data(int data[5], yadl_result *result)
 	result->value[1] = (data[0] * 256.0 + data[1]) / 10.0;
 }
 
-static int _get_usecs_pin_is_in_state(yadl_config *config, int state)
+/*
+ * Records the time of each edge on the data line until it stays in the
+ * same state for TIMEOUT_USECS. The times come from the monotonic clock
+ * instead of counting loop iterations, so the time that each digital_read()
+ * takes does not matter. Returns the number of edges.
+ */
+static int _dht_capture_edges(yadl_config *config, int *start_level,
+			      uint64_t *edge_usecs, int max_edges)
 {
-	int microsecs_in_current_state = 0;
+	hw_backend *hw = config->hw;
+	int level = hw->digital_read(config->gpio_pin);
+	uint64_t last_usecs = hw->monotonic_usecs();
+	int num_edges = 0;
+
+	*start_level = level;
+
+	while (num_edges < max_edges) {
+		int cur_level = hw->digital_read(config->gpio_pin);
+		uint64_t now_usecs = hw->monotonic_usecs();
+
+		if (cur_level != level) {
+			edge_usecs[num_edges++] = now_usecs;
+			level = cur_level;
+			last_usecs = now_usecs;
+		} else if (now_usecs - last_usecs > TIMEOUT_USECS) {
+			break;
+		}
+	}
 
-	while (digitalRead(config->gpio_pin) == state) {
-		microsecs_in_current_state++;
-		delayMicroseconds(1);
+	return num_edges;
+}
+
+/*
+ * With --realtime_priority, the transaction runs with the SCHED_FIFO
+ * policy so that it is not preempted in the middle of the response, and
+ * with the memory of the process locked since a page fault would be as
+ * bad. Returns 1 if the policy was changed and needs to be restored with
+ * _dht_leave_realtime().
+ */
+static int _dht_enter_realtime(yadl_config *config, int *saved_policy,
+			       struct sched_param *saved_param)
+{
+	if (config->realtime_priority == 0)
+		return 0;
 
-		/* check for a timeout */
-		if (microsecs_in_current_state == TIMEOUT_USECS)
-			return -1;
+	pthread_getschedparam(pthread_self(), saved_policy, saved_param);
+
+	struct sched_param param;
+
+	memset(&param, 0, sizeof(param));
+	param.sched_priority = config->realtime_priority;
+
+	int ret = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+
+	if (ret != 0) {
+		config->logger("Cannot use SCHED_FIFO priority %d: %s\n",
+			       config->realtime_priority, strerror(ret));
+		return 0;
 	}
-	return microsecs_in_current_state;
+
+	if (mlockall(MCL_CURRENT) < 0)
+		config->logger("Cannot lock the memory of the process: %s\n",
+			       strerror(errno));
+
+	return 1;
+}
+
+static void _dht_leave_realtime(int saved_policy,
+				struct sched_param *saved_param)
+{
+	pthread_setschedparam(pthread_self(), saved_policy, saved_param);
+	munlockall();
 }
 
-float _calculate_dew_point(float temperature, float humidity)
+float calculate_dew_point(float temperature, float humidity)
 {
 	/**
 	 * This uses the August-Roche-Magnus approximation to calulate the dew
@@ -79,136 +142,90 @@ float _calculate_dew_point(float temperature, float humidity)
  * See the DHT11 data sheet that is linked in the README for a good
  * description of the overall process.
  */
-static yadl_result *_dht_read_data(char *sensor_descr,
-	yadl_config *config,
-	void (*dht_parser)(int data[5], yadl_result *result))
+static int _dht_read_data(char *sensor_descr,
+	yadl_config *config, yadl_result *result,
+	void (*dht_parser)(uint8_t data[5], yadl_result *result))
 {
-	config->logger("%s: Polling sensor on GPIO pin %d. Note: usecs times shown below are approximate.\n",
+	config->logger("%s: Polling sensor on GPIO pin %d.\n",
 			sensor_descr, config->gpio_pin);
 
+	int saved_policy;
+	struct sched_param saved_param;
+	int realtime = _dht_enter_realtime(config, &saved_policy,
+					   &saved_param);
+
 	/* Signal to the DHT sensor that we want data. */
-	pinMode(config->gpio_pin, OUTPUT);
-	digitalWrite(config->gpio_pin, LOW);
-	delay(18);
+	config->hw->pin_mode(config->gpio_pin, HW_OUTPUT);
+	config->hw->digital_write(config->gpio_pin, HW_LOW);
+	config->hw->delay(18);
 
 	/* Now set pin state to high */
-	digitalWrite(config->gpio_pin, HIGH);
+	config->hw->digital_write(config->gpio_pin, HW_HIGH);
 
 	/* Read response from sensor */
-	pinMode(config->gpio_pin, INPUT);
+	config->hw->pin_mode(config->gpio_pin, HW_INPUT);
 
-	/* Wait while the pin is high */
-	if (_get_usecs_pin_is_in_state(config, 1) < 0) {
-		config->logger("%s: Sensor is not ready during phase 1 of the handshake.\n",
-			       sensor_descr);
-		return NULL;
-	}
+	/* The waveform is captured first and decoded afterwards */
+	uint64_t edge_usecs[DHT_NUM_EDGES];
+	int start_level;
+	int num_edges = _dht_capture_edges(config, &start_level, edge_usecs,
+					   DHT_NUM_EDGES);
 
-	/* Sensor signals it is ready for data by setting pin to low for 80us */
-	if (_get_usecs_pin_is_in_state(config, 0) < 0) {
-		config->logger("%s: Sensor is not ready during phase 2 of the handshake.\n",
-			       sensor_descr);
-		return NULL;
-	}
+	if (realtime)
+		_dht_leave_realtime(saved_policy, &saved_param);
 
-	/*
-	 * Sensor signals it is ready for data by setting pin to high for
-	 * 80us.
-	 */
-	if (_get_usecs_pin_is_in_state(config, 1) < 0) {
-		config->logger("%s: Sensor is not ready during phase 3 of the handshake.\n",
-			       sensor_descr);
-		return NULL;
+	if (start_level != HW_HIGH) {
+		config->logger("%s: The sensor started its response before the line was read. Retrying.\n",
+				sensor_descr);
+		return -1;
 	}
 
-	/* Now we are ready to start reading the 40 bits from the sensor */
-	int data[5] = { 0 };
-	int bit_pos = 0;
-
-	for (; bit_pos < 40; bit_pos++) {
-		/*
-		 * Get the amount of time that the pin is low and high. The
-		 * length of time that it is high determines the bit state.
-		 */
-		int usecs_low = _get_usecs_pin_is_in_state(config, 0);
+	uint8_t data[5];
+	int num_bits = dht_decode(edge_usecs, num_edges, data);
 
-		if (usecs_low < 0) {
-			config->logger("%s: Timeout reading bit position %d.\n",
-					sensor_descr, bit_pos);
-			break;
-		}
-
-		int usecs_high = _get_usecs_pin_is_in_state(config, 1);
-
-		if (usecs_high < 0) {
-			config->logger("%s: Timeout reading bit position %d.\n",
-					sensor_descr, bit_pos);
-			break;
-		}
-
-		/*
-		 * If the pin was high for 26-28 us, then the bit is 0. If the
-		 * pin was high for 70 us, then the bit is 1. Due to the
-		 * scheduling policy, and lack of realtime scheduling, the times
-		 * here are approximate.
-		 */
-		int byte_pos = bit_pos / 8;
-
-		data[byte_pos] <<= 1;
-		if (usecs_high > BIT_ENABLED_THRESHOLD)
-			data[byte_pos] |= 1;
+	if (num_bits < DHT_NUM_BITS) {
+		config->logger("%s: Only read %d bits from the sensor. Needed %d. Retrying.\n",
+				sensor_descr, num_bits, DHT_NUM_BITS);
+		return -1;
 	}
 
-	if (bit_pos < 40) {
-		config->logger("%s: Only read %d of bits from the sensor. Needed 40. Retrying.\n",
-				sensor_descr, bit_pos);
-		return NULL;
-	}
-
-	/* Wait for the sensor to go back to low power mode. */
-	_get_usecs_pin_is_in_state(config, 0);
-
 	config->logger("%s: Read data 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x from sensor\n",
 			sensor_descr, data[0], data[1], data[2], data[3],
 			data[4]);
 
 	int checksum = (data[0] + data[1] + data[2] + data[3]) & 0xFF;
 
-	if (data[4] != checksum) {
+	if (!dht_checksum_ok(data)) {
 		config->logger("%s: Computed checksum 0x%02x does not match checksum 0x%02x read from the sensor. Retrying.\n",
 				sensor_descr, checksum, data[4]);
-		return NULL;
+		return -1;
 	}
 
 	config->logger("%s: Computed checksum 0x%02x matches checksum received from sensor.\n",
-			sensor_descr, checksum, data[4]);
+			sensor_descr, checksum);
 
-	yadl_result *result = malloc(sizeof(*result));
-
-	result->value = malloc(sizeof(float) * 3);
 	dht_parser(data, result);
-	result->value[2] = _calculate_dew_point(result->value[0],
-						result->value[1]);
+	result->value[2] = calculate_dew_point(result->value[0],
+					       result->value[1]);
 	config->logger("%s: temperature=%.2fC, humidity=%.2f%%, dew_point=%.2fC\n",
 			sensor_descr, result->value[0], result->value[1],
 			result->value[2]);
 	result->value[0] = config->temperature_converter(result->value[0]);
 	result->value[2] = config->temperature_converter(result->value[2]);
 
-	result->unit = malloc(sizeof(char *) * 1);
 	result->unit[0] = config->temperature_unit;
 
-	return result;
+	return 0;
 }
 
-static yadl_result *_dht11_read_data(yadl_config *config)
+static int _dht11_read_data(yadl_config *config, yadl_result *result)
 {
-	return _dht_read_data("DHT11", config, &_dht11_parse_data);
+	return _dht_read_data("DHT11", config, result, &_dht11_parse_data);
 }
 
-static yadl_result *_dht22_read_data(yadl_config *config)
+static int _dht22_read_data(yadl_config *config, yadl_result *result)
 {
-	return _dht_read_data("DHT22", config, &_dht22_parse_data);
+	return _dht_read_data("DHT22", config, result, &_dht22_parse_data);
 }
 
 static void _dht_init(__attribute__((__unused__)) yadl_config *config)
@@ -223,6 +240,11 @@ static void _dht_init(__attribute__((__unused__)) yadl_config *config)
 			"You must specify the --temperature_unit flag\n");
 		usage();
 	}
+
+	if (config->realtime_priority < 0 || config->realtime_priority > 99) {
+		fprintf(stderr, "--realtime_priority must be between 0 and 99\n");
+		usage();
+	}
 }
 
 static char *_dht_value_header_names[] = {
@@ -0,0 +1,240 @@
+/*
+ * sensor_temperature_dht_iio.c - DHT11 / DHT22 through the kernel IIO driver.
+ *
+ * Copyright (C) 2016-2017 Brian Masney <masneyb@onstation.org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "yadl.h"
+
+/*
+ * The dht11 kernel driver handles both the DHT11 and the DHT22, and does
+ * the timing critical part of the read. It reports the temperature in
+ * millidegrees Celsius and the humidity in thousandths of a percent.
+ */
+#define IIO_DEVICES_DIR         "/sys/bus/iio/devices"
+#define IIO_DHT_DRIVER_NAME     "dht11"
+
+#define IIO_TEMPERATURE_ATTR    "in_temp_input"
+#define IIO_HUMIDITY_ATTR       "in_humidityrelative_input"
+
+static int _iio_open_attr(char *descr, char *device, char *attr)
+{
+	char path[PATH_MAX];
+
+	snprintf(path, sizeof(path), "%s/%s", device, attr);
+
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+
+	if (fd < 0) {
+		fprintf(stderr, "%s: Error opening %s: %s\n", descr, path,
+			strerror(errno));
+		exit(1);
+	}
+
+	return fd;
+}
+
+/*
+ * Each read starts over at the beginning of the attribute so that sysfs
+ * asks the driver for a new value. Returns -1 if the driver could not get
+ * a reading from the sensor and the read should be retried.
+ */
+static int _iio_read_attr(yadl_config *config, char *descr, int fd,
+			  char *attr, long *value)
+{
+	char buf[32];
+	ssize_t len = pread(fd, buf, sizeof(buf) - 1, 0);
+
+	if (len < 0 && (errno == EIO || errno == ETIMEDOUT)) {
+		config->logger("%s: The driver could not read %s: %s. Retrying.\n",
+			       descr, attr, strerror(errno));
+		return -1;
+	} else if (len < 0) {
+		fprintf(stderr, "%s: Error reading %s/%s: %s\n", descr,
+			config->iio_device, attr, strerror(errno));
+		exit(1);
+	}
+
+	buf[len] = '\0';
+	buf[strcspn(buf, "\n")] = '\0';
+
+	char *endptr;
+
+	*value = strtol(buf, &endptr, 10);
+	if (endptr == buf || *endptr != '\0') {
+		config->logger("%s: Could not parse '%s' from %s. Retrying.\n",
+			       descr, buf, attr);
+		return -1;
+	}
+
+	return 0;
+}
+
+static int _dht_iio_read_data(char *sensor_descr, yadl_config *config,
+			      yadl_result *result)
+{
+	long millidegrees, millipercent;
+
+	if (_iio_read_attr(config, sensor_descr, config->iio_temperature_fd,
+			   IIO_TEMPERATURE_ATTR, &millidegrees) < 0 ||
+	    _iio_read_attr(config, sensor_descr, config->iio_humidity_fd,
+			   IIO_HUMIDITY_ATTR, &millipercent) < 0)
+		return -1;
+
+	result->value[0] = millidegrees / 1000.0;
+	result->value[1] = millipercent / 1000.0;
+	result->value[2] = calculate_dew_point(result->value[0],
+					       result->value[1]);
+	config->logger("%s: temperature=%.2fC, humidity=%.2f%%, dew_point=%.2fC\n",
+			sensor_descr, result->value[0], result->value[1],
+			result->value[2]);
+	result->value[0] = config->temperature_converter(result->value[0]);
+	result->value[2] = config->temperature_converter(result->value[2]);
+
+	result->unit[0] = config->temperature_unit;
+
+	return 0;
+}
+
+static int _dht11_iio_read_data(yadl_config *config, yadl_result *result)
+{
+	return _dht_iio_read_data("DHT11", config, result);
+}
+
+static int _dht22_iio_read_data(yadl_config *config, yadl_result *result)
+{
+	return _dht_iio_read_data("DHT22", config, result);
+}
+
+/* Returns 1 if the IIO device's name attribute matches the DHT driver */
+static int _is_dht_iio_device(char *device)
+{
+	char path[PATH_MAX + 8], name[32];
+
+	snprintf(path, sizeof(path), "%s/name", device);
+
+	FILE *fd = fopen(path, "r");
+
+	if (fd == NULL)
+		return 0;
+
+	int found = fgets(name, sizeof(name), fd) != NULL &&
+		strncmp(name, IIO_DHT_DRIVER_NAME,
+			strlen(IIO_DHT_DRIVER_NAME)) == 0;
+
+	fclose(fd);
+	return found;
+}
+
+/* Returns the first device that the DHT driver registered, or NULL */
+static char *_find_dht_iio_device(void)
+{
+	DIR *dir = opendir(IIO_DEVICES_DIR);
+
+	if (dir == NULL)
+		return NULL;
+
+	char *found = NULL;
+	struct dirent *entry;
+
+	while (found == NULL && (entry = readdir(dir)) != NULL) {
+		if (strncmp(entry->d_name, "iio:device", 10) != 0)
+			continue;
+
+		char device[PATH_MAX];
+
+		snprintf(device, sizeof(device), "%s/%s", IIO_DEVICES_DIR,
+			 entry->d_name);
+		if (_is_dht_iio_device(device)) {
+			found = yadl_malloc(strlen(device) + 1);
+			strcpy(found, device);
+		}
+	}
+
+	closedir(dir);
+	return found;
+}
+
+static void _dht_iio_init(yadl_config *config)
+{
+	if (config->temperature_converter == NULL) {
+		fprintf(stderr,
+			"You must specify the --temperature_unit flag\n");
+		usage();
+	}
+
+	if (config->iio_device == NULL) {
+		config->iio_device = _find_dht_iio_device();
+		if (config->iio_device == NULL) {
+			fprintf(stderr, "Cannot find a %s device in %s. Is the dht11 kernel module loaded?\n",
+				IIO_DHT_DRIVER_NAME, IIO_DEVICES_DIR);
+			exit(1);
+		}
+	}
+
+	config->logger("Reading the DHT sensor from IIO device %s\n",
+		       config->iio_device);
+
+	/* The descriptors stay open so that each read is a single pread() */
+	config->iio_temperature_fd = _iio_open_attr("dht_iio",
+						    config->iio_device,
+						    IIO_TEMPERATURE_ATTR);
+	config->iio_humidity_fd = _iio_open_attr("dht_iio",
+						 config->iio_device,
+						 IIO_HUMIDITY_ATTR);
+}
+
+static char *_dht_iio_value_header_names[] = {
+	"temperature", "humidity", "dew_point", NULL
+};
+
+static char **_dht_iio_get_value_header_names(__attribute__((__unused__))
+					      yadl_config *config)
+{
+	return _dht_iio_value_header_names;
+}
+
+static char *_dht_iio_unit_header_names[] = { "temperature_unit", NULL };
+
+static char **_dht_iio_get_unit_header_names(__attribute__((__unused__))
+					     yadl_config *config)
+{
+	return _dht_iio_unit_header_names;
+}
+
+sensor dht11_iio_sensor_funcs = {
+	.init = &_dht_iio_init,
+	.get_value_header_names = &_dht_iio_get_value_header_names,
+	.get_unit_header_names = &_dht_iio_get_unit_header_names,
+	.read = &_dht11_iio_read_data
+};
+
+sensor dht22_iio_sensor_funcs = {
+	.init = &_dht_iio_init,
+	.get_value_header_names = &_dht_iio_get_value_header_names,
+	.get_unit_header_names = &_dht_iio_get_unit_header_names,
+	.read = &_dht22_iio_read_data
+};
@@ -19,10 +19,14 @@
  * 02110-1301, USA.
  */
 
+#include <dirent.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 #include "yadl.h"
 
 /* Example output from /sys/bus/w1/devices/28-031554ae2eff/w1_slave:
@@ -30,113 +34,300 @@
  * 58 01 80 80 1f ff 80 80 f8 t=21500
  */
 
-static char *_read_line(char *buf, int size, FILE *stream)
+#define DS18B20_FAMILY_PREFIX	"28-"
+
+/* What the probe reports when it lost power before the conversion ended */
+#define DS18B20_POWER_ON_MILLIDEGREES	85000
+
+/*
+ * Writing this to a bus master's therm_bulk_read starts a conversion on
+ * all of its probes at once. The next read of each w1_slave waits for that
+ * conversion instead of starting its own.
+ */
+#define W1_BULK_READ_TRIGGER	"trigger\n"
+
+struct ds18b20_probes_tag {
+	int num_probes;
+	char **slaves;
+	int *fds;
+
+	/* The therm_bulk_read of each bus master */
+	int num_bulk_fds;
+	int *bulk_fds;
+
+	char **value_header_names;
+};
+
+static int _compare_names(const void *a, const void *b)
 {
-	char *ret = fgets(buf, size, stream);
+	return strcmp(*(char **) a, *(char **) b);
+}
 
-	if (ret == NULL)
+static char *_join_path(char *dir, char *name, char *attr)
+{
+	int len = strlen(dir) + strlen(name) + strlen(attr) + 3;
+	char *ret = yadl_malloc(len);
+
+	snprintf(ret, len, "%s/%s/%s", dir, name, attr);
+	return ret;
+}
+
+/*
+ * Returns the entries in the w1 devices directory that start with prefix
+ * sorted by name so that the probes keep the same order across restarts.
+ */
+static char **_list_w1_devices(char *dir, char *prefix, int *num_names)
+{
+	DIR *d = opendir(dir);
+
+	*num_names = 0;
+	if (d == NULL)
 		return NULL;
 
-	size_t len = strlen(buf);
+	char **names = NULL;
+	struct dirent *entry;
 
-	if (buf[len - 1] == '\n') {
-		buf[len - 1] = '\0';
-		len--;
+	while ((entry = readdir(d)) != NULL) {
+		if (strncmp(entry->d_name, prefix, strlen(prefix)) != 0)
+			continue;
+
+		(*num_names)++;
+		names = yadl_realloc(names, sizeof(char *) * *num_names);
+		names[*num_names - 1] = yadl_malloc(strlen(entry->d_name) + 1);
+		strcpy(names[*num_names - 1], entry->d_name);
 	}
-	if (buf[len - 1] == '\r')
-		buf[len - 1] = '\0';
-	return ret;
+
+	closedir(d);
+
+	if (*num_names > 0)
+		qsort(names, *num_names, sizeof(char *), &_compare_names);
+
+	return names;
 }
 
-static yadl_result *_ds18b20_read_data(yadl_config *config)
+/*
+ * Uses the --w1_slave arguments, or all of the DS18B20 probes in
+ * --w1_devices_dir when none were given. This is called for both the
+ * headers and the init since the schema is built first.
+ */
+static ds18b20_probes *_ds18b20_find_probes(yadl_config *config)
 {
-	float temperature;
-	char buf[255];
-	char *pos;
-	FILE *fd;
+	if (config->ds18b20_probes != NULL)
+		return config->ds18b20_probes;
 
-	config->logger("ds18b20: Opening w1 slave %s\n", config->w1_slave);
+	ds18b20_probes *probes = yadl_calloc(1, sizeof(*probes));
 
-	fd = fopen(config->w1_slave, "r");
-	if (fd == NULL) {
-		fprintf(stderr, "ds18b20: Error opening file %s: %s\n",
-			config->w1_slave,
-			strerror(errno));
-		exit(1);
-	}
+	if (config->num_w1_slaves > 0) {
+		probes->num_probes = config->num_w1_slaves;
+		probes->slaves = config->w1_slaves;
+	} else {
+		char **names = _list_w1_devices(config->w1_devices_dir,
+						DS18B20_FAMILY_PREFIX,
+						&probes->num_probes);
 
-	if (_read_line(buf, sizeof(buf), fd) == NULL) {
-		fprintf(stderr, "ds18b20: Error reading file %s: %s\n",
-			config->w1_slave,
-			errno == 0 ? "Premature end of file" : strerror(errno));
-		fclose(fd);
-		exit(1);
+		if (probes->num_probes == 0) {
+			fprintf(stderr, "ds18b20: No %s* devices were found in %s\n",
+				DS18B20_FAMILY_PREFIX, config->w1_devices_dir);
+			exit(1);
+		}
+
+		probes->slaves = yadl_malloc(sizeof(char *) *
+					     probes->num_probes);
+		for (int i = 0; i < probes->num_probes; i++)
+			probes->slaves[i] = _join_path(config->w1_devices_dir,
+						       names[i], "w1_slave");
 	}
-	config->logger("ds18b20: Skipping first line '%s' from w1 slave %s\n",
-		       buf, config->w1_slave);
-
-	if (_read_line(buf, sizeof(buf), fd) == NULL) {
-		fprintf(stderr, "ds18b20: Error reading file %s: %s\n",
-			config->w1_slave,
-			errno == 0 ? "Premature end of file" : strerror(errno));
-		fclose(fd);
-		exit(1);
+
+	/* A single probe keeps the header that it always had */
+	probes->value_header_names = yadl_calloc(probes->num_probes + 1,
+						 sizeof(char *));
+	for (int i = 0; i < probes->num_probes; i++) {
+		if (probes->num_probes == 1) {
+			probes->value_header_names[i] = "temperature";
+			continue;
+		}
+
+		probes->value_header_names[i] = yadl_malloc(32);
+		snprintf(probes->value_header_names[i], 32, "temperature_%d",
+			 i + 1);
 	}
 
-	config->logger("ds18b20: Processing line '%s' from w1 slave %s\n", buf,
-		       config->w1_slave);
+	config->ds18b20_probes = probes;
+	return probes;
+}
+
+/*
+ * Opens the therm_bulk_read of each bus master. The probes are converted
+ * one at a time when this is not available, such as on older kernels or
+ * when not running as root.
+ */
+static void _ds18b20_open_bulk_read(yadl_config *config,
+				    ds18b20_probes *probes)
+{
+	int num_masters;
+	char **masters = _list_w1_devices(config->w1_devices_dir,
+					  "w1_bus_master", &num_masters);
 
-	fclose(fd);
+	probes->bulk_fds = yadl_malloc(sizeof(int) * (num_masters + 1));
+	for (int i = 0; i < num_masters; i++) {
+		char *path = _join_path(config->w1_devices_dir, masters[i],
+					"therm_bulk_read");
+		int fd = open(path, O_WRONLY | O_CLOEXEC);
 
-	for (pos = buf; *pos != '\0'; pos++) {
-		if (*pos == 't' && *(pos+1) == '=') {
-			pos = pos + 2;
-			break;
+		if (fd < 0) {
+			config->logger("ds18b20: Cannot open %s: %s. The probes will be converted one at a time.\n",
+				       path, strerror(errno));
+			continue;
 		}
+
+		config->logger("ds18b20: Using %s to convert all of the probes at once\n",
+			       path);
+		probes->bulk_fds[probes->num_bulk_fds++] = fd;
 	}
+}
 
-	if (*pos == '\0') {
-		fprintf(stderr,
-			"ds18b20: Could not parse line '%s' from w1 slave %s\n",
-			buf, config->w1_slave);
-		exit(1);
+/*
+ * Returns the temperature in millidegrees from the w1_slave contents, or
+ * -1 if the reading is bad.
+ */
+static int _ds18b20_parse(yadl_config *config, char *slave, char *buf,
+			  long *millidegrees)
+{
+	char *newline = strchr(buf, '\n');
+
+	if (newline == NULL) {
+		config->logger("ds18b20: Short read '%s' from w1 slave %s\n",
+			       buf, slave);
+		return -1;
 	}
 
-	temperature = strtol(pos, NULL, 10) / 1000.0;
-	config->logger("ds18b20: temperature=%.2fC, humidity=unsupported\n",
-		       temperature);
+	*newline = '\0';
+	if (newline - buf < 3 || strcmp(newline - 3, "YES") != 0) {
+		config->logger("ds18b20: Bad CRC '%s' from w1 slave %s\n",
+			       buf, slave);
+		return -1;
+	}
 
-	yadl_result *result = malloc(sizeof(*result));
+	char *pos = strstr(newline + 1, "t=");
 
-	result->value = malloc(sizeof(float) * 1);
-	result->value[0] = config->temperature_converter(temperature);
+	if (pos == NULL) {
+		config->logger("ds18b20: Could not parse '%s' from w1 slave %s\n",
+			       newline + 1, slave);
+		return -1;
+	}
 
-	result->unit = malloc(sizeof(char *) * 1);
-	result->unit[0] = config->temperature_unit;
+	*millidegrees = strtol(pos + 2, NULL, 10);
+	if (*millidegrees == DS18B20_POWER_ON_MILLIDEGREES) {
+		config->logger("ds18b20: w1 slave %s returned its power on value\n",
+			       slave);
+		return -1;
+	}
 
-	return result;
+	return 0;
 }
 
-static void _ds18b20_init(__attribute__((__unused__)) yadl_config *config)
+/* Returns -1 if the probe could not be read */
+static int _ds18b20_read_probe(yadl_config *config, ds18b20_probes *probes,
+			       int idx, float *temperature)
 {
-	if (config->w1_slave == NULL) {
-		fprintf(stderr, "You must specify the --w1_slave argument\n");
-		usage();
+	char buf[255];
+	ssize_t len = pread(probes->fds[idx], buf, sizeof(buf) - 1, 0);
+
+	if (len < 0) {
+		config->logger("ds18b20: Error reading w1 slave %s: %s\n",
+			       probes->slaves[idx], strerror(errno));
+		return -1;
 	}
+	buf[len] = '\0';
+
+	long millidegrees;
+
+	if (_ds18b20_parse(config, probes->slaves[idx], buf,
+			   &millidegrees) < 0)
+		return -1;
+
+	*temperature = millidegrees / 1000.0;
+
+	config->logger("ds18b20: %s temperature=%.2fC\n", probes->slaves[idx],
+		       *temperature);
+
+	return 0;
+}
+
+/*
+ * A probe that can't be read is read again on its own, which starts a new
+ * conversion on just that probe, so that one bad probe does not make the
+ * others convert again. The result is only retried once the probe has
+ * used up --max_retries.
+ */
+static int _ds18b20_read_data(yadl_config *config, yadl_result *result)
+{
+	ds18b20_probes *probes = config->ds18b20_probes;
 
+	for (int i = 0; i < probes->num_bulk_fds; i++) {
+		if (pwrite(probes->bulk_fds[i], W1_BULK_READ_TRIGGER,
+			   strlen(W1_BULK_READ_TRIGGER), 0) < 0)
+			config->logger("ds18b20: Error starting the bulk conversion: %s\n",
+				       strerror(errno));
+	}
+
+	for (int i = 0; i < probes->num_probes; i++) {
+		float temperature;
+		int retries = 0;
+
+		while (_ds18b20_read_probe(config, probes, i,
+					   &temperature) < 0) {
+			if (++retries >= config->max_retries) {
+				config->logger("ds18b20: Could not read %s. Retrying the result.\n",
+					       probes->value_header_names[i]);
+				return -1;
+			}
+
+			config->logger("ds18b20: Reading %s again\n",
+				       probes->value_header_names[i]);
+			if (config->sleep_millis_between_retries > 0)
+				config->hw->delay(config->sleep_millis_between_retries);
+		}
+
+		result->value[i] = config->temperature_converter(temperature);
+	}
+
+	result->unit[0] = config->temperature_unit;
+
+	return 0;
+}
+
+static void _ds18b20_init(yadl_config *config)
+{
 	if (config->temperature_converter == NULL) {
 		fprintf(stderr,
 			"You must specify the --temperature_unit flag\n");
 		usage();
 	}
-}
 
-static char *_ds18b20_value_header_names[] = { "temperature", NULL };
+	ds18b20_probes *probes = _ds18b20_find_probes(config);
+
+	/* The descriptors stay open so that each read is a single pread() */
+	probes->fds = yadl_malloc(sizeof(int) * probes->num_probes);
+	for (int i = 0; i < probes->num_probes; i++) {
+		config->logger("ds18b20: %s is %s\n",
+			       probes->value_header_names[i],
+			       probes->slaves[i]);
+
+		probes->fds[i] = open(probes->slaves[i], O_RDONLY | O_CLOEXEC);
+		if (probes->fds[i] < 0) {
+			fprintf(stderr, "ds18b20: Error opening file %s: %s\n",
+				probes->slaves[i], strerror(errno));
+			exit(1);
+		}
+	}
+
+	_ds18b20_open_bulk_read(config, probes);
+}
 
-static char **_ds18b20_get_value_header_names(__attribute__((__unused__))
-					      yadl_config *config)
+static char **_ds18b20_get_value_header_names(yadl_config *config)
 {
-	return _ds18b20_value_header_names;
+	return _ds18b20_find_probes(config)->value_header_names;
 }
 
 static char *_ds18b20_unit_header_names[] = { "temperature_unit", NULL };
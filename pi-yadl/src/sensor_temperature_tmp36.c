@@ -40,7 +40,7 @@ static void _tmp36_init(yadl_config *config)
 	config->adc->adc_init(config);
 }
 
-static yadl_result *_tmp36_read_data(yadl_config *config)
+static int _tmp36_read_data(yadl_config *config, yadl_result *result)
 {
 	config->logger("tmp36: Beginning to perform analog read. adc_millivolts=%d, adc_resolution=%d, analog_scaling_factor=%d\n",
 			config->adc_millivolts, config->adc->adc_resolution,
@@ -59,15 +59,11 @@ static yadl_result *_tmp36_read_data(yadl_config *config)
 	config->logger("tmp36: temperature=%.2fC, humidity=unsupported\n",
 		       temperature);
 
-	yadl_result *result = malloc(sizeof(*result));
-
-	result->value = malloc(sizeof(float) * 1);
 	result->value[0] = config->temperature_converter(temperature);
 
-	result->unit = malloc(sizeof(char *) * 1);
 	result->unit[0] = config->temperature_unit;
 
-	return result;
+	return 0;
 }
 
 static char *_tmp36_value_header_names[] = { "temperature", NULL };
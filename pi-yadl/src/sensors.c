@@ -20,6 +20,7 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include "yadl.h"
 
@@ -39,6 +40,10 @@ sensor *get_sensor(char *name)
 		return &dht11_sensor_funcs;
 	else if (strcmp(name, "dht22") == 0)
 		return &dht22_sensor_funcs;
+	else if (strcmp(name, "dht11_iio") == 0)
+		return &dht11_iio_sensor_funcs;
+	else if (strcmp(name, "dht22_iio") == 0)
+		return &dht22_iio_sensor_funcs;
 	else if (strcmp(name, "ds18b20") == 0)
 		return &ds18b20_sensor_funcs;
 	else if (strcmp(name, "tmp36") == 0)
@@ -52,3 +57,83 @@ sensor *get_sensor(char *name)
 	return NULL;
 }
 
+static int _count_names(char **names)
+{
+	int i = 0;
+
+	if (names == NULL)
+		return 0;
+
+	for (; names[i] != NULL; i++)
+		;
+	return i;
+}
+
+static char *_format_key(int *len, const char *format, char *name)
+{
+	*len = snprintf(NULL, 0, format, name);
+
+	char *ret = yadl_malloc(*len + 1);
+
+	snprintf(ret, *len + 1, format, name);
+	return ret;
+}
+
+/* Quotes and backslashes are the only characters that need escaping here */
+static char *_json_escape(char *name)
+{
+	char *ret = yadl_malloc(strlen(name) * 2 + 1);
+	char *pos = ret;
+
+	for (; *name != '\0'; name++) {
+		if (*name == '"' || *name == '\\')
+			*pos++ = '\\';
+		*pos++ = *name;
+	}
+	*pos = '\0';
+
+	return ret;
+}
+
+static sensor_schema_field *_new_schema_fields(char **names, int num_names)
+{
+	sensor_schema_field *fields = yadl_calloc(num_names,
+						  sizeof(*fields));
+
+	for (int i = 0; i < num_names; i++) {
+		sensor_schema_field *field = &fields[i];
+		char *escaped = _json_escape(names[i]);
+
+		field->name = names[i];
+		field->name_len = strlen(names[i]);
+		field->json_key = _format_key(&field->json_key_len,
+					      " \"%s\": ", escaped);
+		field->xml_open = _format_key(&field->xml_open_len, "<%s>",
+					      names[i]);
+		field->xml_close = _format_key(&field->xml_close_len, "</%s>",
+					       names[i]);
+
+		free(escaped);
+	}
+
+	return fields;
+}
+
+sensor_schema *new_sensor_schema(yadl_config *config)
+{
+	sensor_schema *schema = yadl_malloc(sizeof(*schema));
+	char **unit_names = NULL;
+
+	schema->value_names = config->sens->get_value_header_names(config);
+	schema->num_values = _count_names(schema->value_names);
+	schema->values = _new_schema_fields(schema->value_names,
+					    schema->num_values);
+
+	if (config->sens->get_unit_header_names != NULL)
+		unit_names = config->sens->get_unit_header_names(config);
+
+	schema->num_units = _count_names(unit_names);
+	schema->units = _new_schema_fields(unit_names, schema->num_units);
+
+	return schema;
+}
@@ -0,0 +1,102 @@
+/*
+ * seqlock.c - Lets a single writer publish data without blocking the readers.
+ *
+ * Copyright (C) 2016-2017 Brian Masney <masneyb@onstation.org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include "seqlock.h"
+
+void seqlock_write_begin(seqlock *lock)
+{
+	unsigned int seq = atomic_load_explicit(&lock->seq,
+						memory_order_relaxed);
+
+	atomic_store_explicit(&lock->seq, seq + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+}
+
+void seqlock_write_end(seqlock *lock)
+{
+	unsigned int seq = atomic_load_explicit(&lock->seq,
+						memory_order_relaxed);
+
+	atomic_store_explicit(&lock->seq, seq + 1, memory_order_release);
+}
+
+unsigned int seqlock_read_begin(seqlock *lock)
+{
+	unsigned int seq;
+
+	/* The writer only holds it for a few hundred nanoseconds */
+	while ((seq = atomic_load_explicit(&lock->seq,
+					   memory_order_acquire)) & 1)
+		;
+
+	return seq;
+}
+
+int seqlock_read_retry(seqlock *lock, unsigned int start)
+{
+	atomic_thread_fence(memory_order_acquire);
+
+	return atomic_load_explicit(&lock->seq, memory_order_relaxed) != start;
+}
+
+void seqlock_store_words(void *shared, const void *data, size_t len)
+{
+	atomic_uint *dst = shared;
+	uint32_t word;
+
+	for (size_t i = 0; i < len / sizeof(word); i++) {
+		memcpy(&word, (const char *) data + i * sizeof(word),
+		       sizeof(word));
+		atomic_store_explicit(&dst[i], word, memory_order_relaxed);
+	}
+}
+
+void seqlock_load_words(void *data, const void *shared, size_t len)
+{
+	atomic_uint *src = (atomic_uint *) shared;
+	uint32_t word;
+
+	for (size_t i = 0; i < len / sizeof(word); i++) {
+		word = atomic_load_explicit(&src[i], memory_order_relaxed);
+		memcpy((char *) data + i * sizeof(word), &word, sizeof(word));
+	}
+}
+
+void seqlock_write_copy(seqlock *lock, void *shared, const void *data,
+			size_t len)
+{
+	seqlock_write_begin(lock);
+	seqlock_store_words(shared, data, len);
+	seqlock_write_end(lock);
+}
+
+void seqlock_read_copy(seqlock *lock, void *data, const void *shared,
+		       size_t len)
+{
+	unsigned int seq;
+
+	do {
+		seq = seqlock_read_begin(lock);
+		seqlock_load_words(data, shared, len);
+	} while (seqlock_read_retry(lock, seq));
+}
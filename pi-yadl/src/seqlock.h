@@ -0,0 +1,64 @@
+/*
+ * seqlock.h - Lets a single writer publish data without blocking the readers.
+ *
+ * Copyright (C) 2016-2017 Brian Masney <masneyb@onstation.org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include <stdatomic.h>
+#include <stddef.h>
+
+/*
+ * The sequence number is odd while the writer is updating the data. A
+ * reader copies the data and then checks that the sequence number did not
+ * change, and copies it again if it did. The writer never waits on the
+ * readers. There must only be one writer.
+ */
+typedef struct seqlock_tag {
+	atomic_uint seq;
+} seqlock;
+
+void seqlock_write_begin(seqlock *lock);
+
+void seqlock_write_end(seqlock *lock);
+
+unsigned int seqlock_read_begin(seqlock *lock);
+
+/* Returns 1 when the data that was copied is torn and must be read again */
+int seqlock_read_retry(seqlock *lock, unsigned int start);
+
+/*
+ * Publishes len bytes of data to shared, and copies them back out. The
+ * copies are done one 32 bit word at a time with relaxed atomics so that
+ * a reader that runs into the writer gets a torn copy that it throws away
+ * instead of a data race. len must be a multiple of 4.
+ */
+void seqlock_write_copy(seqlock *lock, void *shared, const void *data,
+			size_t len);
+
+void seqlock_read_copy(seqlock *lock, void *data, const void *shared,
+		       size_t len);
+
+/*
+ * The word copies that the two functions above use, for data that is
+ * spread over more than one block. These must be called between
+ * seqlock_write_begin() and seqlock_write_end(), or between
+ * seqlock_read_begin() and seqlock_read_retry().
+ */
+void seqlock_store_words(void *shared, const void *data, size_t len);
+
+void seqlock_load_words(void *data, const void *shared, size_t len);
@@ -0,0 +1,233 @@
+/*
+ * state_file.c - Memory mapped file that keeps sensor state across restarts.
+ *
+ * Copyright (C) 2016-2017 Brian Masney <masneyb@onstation.org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "memory.h"
+#include "state_file.h"
+
+#define STATE_FILE_MAGIC	0x5441545344414459ULL
+
+typedef struct state_file_header_tag {
+	uint64_t magic;
+	uint32_t version;
+	uint32_t num_sections;
+	char layout[STATE_FILE_LAYOUT_LEN];
+} state_file_header;
+
+typedef struct state_slot_header_tag {
+	/* 0 when the slot has never been written */
+	uint64_t seq;
+	uint64_t saved_usecs;
+	uint64_t checksum;
+	uint64_t size;
+} state_slot_header;
+
+static size_t _slot_size(size_t section_size)
+{
+	size_t size = sizeof(state_slot_header) + section_size;
+
+	/* Keep the slot headers aligned */
+	return (size + 7) & ~(size_t) 7;
+}
+
+static state_slot_header *_slot(state_file *sf, int section, int slot)
+{
+	char *base = (char *) sf->map + sf->section_offsets[section];
+
+	return (state_slot_header *)
+		(base + slot * _slot_size(sf->section_sizes[section]));
+}
+
+/* FNV-1a */
+static uint64_t _checksum(state_slot_header *slot)
+{
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	unsigned char *data = (unsigned char *) (slot + 1);
+
+	hash ^= slot->seq;
+	hash *= 0x100000001b3ULL;
+	hash ^= slot->saved_usecs;
+	hash *= 0x100000001b3ULL;
+
+	for (uint64_t i = 0; i < slot->size; i++) {
+		hash ^= data[i];
+		hash *= 0x100000001b3ULL;
+	}
+
+	return hash;
+}
+
+static int _slot_valid(state_file *sf, int section, state_slot_header *slot)
+{
+	return slot->seq != 0 && slot->size == sf->section_sizes[section] &&
+		slot->checksum == _checksum(slot);
+}
+
+static int _header_matches(state_file_header *header, char *layout,
+			   int num_sections)
+{
+	return header->magic == STATE_FILE_MAGIC &&
+		header->version == STATE_FILE_VERSION &&
+		header->num_sections == (uint32_t) num_sections &&
+		strncmp(header->layout, layout, STATE_FILE_LAYOUT_LEN - 1) == 0;
+}
+
+state_file *state_file_open(char *filename, char *layout,
+			    size_t *section_sizes, int num_sections)
+{
+	state_file *sf = yadl_calloc(1, sizeof(*sf));
+
+	sf->filename = filename;
+	sf->num_sections = num_sections;
+	sf->section_sizes = yadl_calloc(num_sections, sizeof(size_t));
+	sf->section_offsets = yadl_calloc(num_sections, sizeof(size_t));
+
+	size_t offset = sizeof(state_file_header);
+
+	for (int i = 0; i < num_sections; i++) {
+		sf->section_sizes[i] = section_sizes[i];
+		sf->section_offsets[i] = offset;
+		offset += 2 * _slot_size(section_sizes[i]);
+	}
+	sf->map_size = offset;
+
+	int fd = open(filename, O_RDWR | O_CREAT, 0644);
+
+	if (fd < 0) {
+		fprintf(stderr, "Error opening %s: %s\n", filename,
+			strerror(errno));
+		return NULL;
+	}
+
+	struct stat st;
+
+	if (fstat(fd, &st) < 0) {
+		fprintf(stderr, "Error reading the size of %s: %s\n", filename,
+			strerror(errno));
+		close(fd);
+		return NULL;
+	}
+
+	int resize = (size_t) st.st_size != sf->map_size;
+
+	if (resize && ftruncate(fd, sf->map_size) < 0) {
+		fprintf(stderr, "Error resizing %s: %s\n", filename,
+			strerror(errno));
+		close(fd);
+		return NULL;
+	}
+
+	sf->map = mmap(NULL, sf->map_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+		       fd, 0);
+	close(fd);
+
+	if (sf->map == MAP_FAILED) {
+		fprintf(stderr, "Error mapping %s: %s\n", filename,
+			strerror(errno));
+		return NULL;
+	}
+
+	state_file_header *header = sf->map;
+
+	if (resize || !_header_matches(header, layout, num_sections)) {
+		memset(sf->map, 0, sf->map_size);
+		header->magic = STATE_FILE_MAGIC;
+		header->version = STATE_FILE_VERSION;
+		header->num_sections = num_sections;
+		strncpy(header->layout, layout, STATE_FILE_LAYOUT_LEN - 1);
+	}
+
+	return sf;
+}
+
+void *state_file_load(state_file *sf, int section, uint64_t *saved_usecs)
+{
+	state_slot_header *newest = NULL;
+
+	for (int i = 0; i < 2; i++) {
+		state_slot_header *slot = _slot(sf, section, i);
+
+		if (!_slot_valid(sf, section, slot))
+			continue;
+
+		if (newest == NULL || slot->seq > newest->seq)
+			newest = slot;
+	}
+
+	if (newest == NULL)
+		return NULL;
+
+	*saved_usecs = newest->saved_usecs;
+	return newest + 1;
+}
+
+/* The slot that was not written last */
+static state_slot_header *_next_slot(state_file *sf, int section,
+				     uint64_t *seq)
+{
+	state_slot_header *slots[2] = {
+		_slot(sf, section, 0), _slot(sf, section, 1)
+	};
+	int next = slots[0]->seq > slots[1]->seq ? 1 : 0;
+
+	*seq = slots[next ^ 1]->seq + 1;
+	return slots[next];
+}
+
+void *state_file_begin_save(state_file *sf, int section)
+{
+	uint64_t seq;
+	state_slot_header *slot = _next_slot(sf, section, &seq);
+
+	/* Mark the slot as not valid while it is being written */
+	slot->seq = 0;
+
+	return slot + 1;
+}
+
+void state_file_end_save(state_file *sf, int section, uint64_t now_usecs)
+{
+	uint64_t seq;
+	state_slot_header *slot = _next_slot(sf, section, &seq);
+
+	slot->seq = seq;
+	slot->saved_usecs = now_usecs;
+	slot->size = sf->section_sizes[section];
+	slot->checksum = _checksum(slot);
+}
+
+void state_write(char **pos, const void *data, size_t len)
+{
+	memcpy(*pos, data, len);
+	*pos += len;
+}
+
+void state_read(char **pos, void *data, size_t len)
+{
+	memcpy(data, *pos, len);
+	*pos += len;
+}
@@ -0,0 +1,75 @@
+/*
+ * state_file.h - Memory mapped file that keeps sensor state across restarts.
+ *
+ * Copyright (C) 2016-2017 Brian Masney <masneyb@onstation.org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define STATE_FILE_VERSION	1
+
+/*
+ * Describes what is stored so that a file that was written with other
+ * settings, such as different wind windows, is not loaded.
+ */
+#define STATE_FILE_LAYOUT_LEN	128
+
+/*
+ * A memory mapped file split into sections. Each section has its own
+ * writer and two slots that are written to in turn, so that a crash or a
+ * power loss in the middle of a save leaves the previous copy intact. The
+ * kernel writes the dirty pages back in the background, so saving does
+ * not wait for the SD card.
+ */
+typedef struct state_file_tag {
+	char *filename;
+	void *map;
+	size_t map_size;
+	int num_sections;
+	size_t *section_sizes;
+	size_t *section_offsets;
+} state_file;
+
+/*
+ * Opens or creates the file. Any state in the file is thrown away if it was
+ * written by another version, with another layout, or with other section
+ * sizes. Returns NULL on error.
+ */
+state_file *state_file_open(char *filename, char *layout,
+			    size_t *section_sizes, int num_sections);
+
+/*
+ * Returns the newest copy of the section whose checksum matches, or NULL if
+ * there is none. saved_usecs is set to the realtime clock when it was
+ * saved.
+ */
+void *state_file_load(state_file *sf, int section, uint64_t *saved_usecs);
+
+/*
+ * Returns where the next copy of the section should be written. It is
+ * only kept once state_file_end_save() is called.
+ */
+void *state_file_begin_save(state_file *sf, int section);
+
+void state_file_end_save(state_file *sf, int section, uint64_t now_usecs);
+
+/* Copies len bytes to or from a section and moves pos past them */
+void state_write(char **pos, const void *data, size_t len);
+
+void state_read(char **pos, void *data, size_t len);
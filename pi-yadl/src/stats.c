@@ -0,0 +1,270 @@
+/*
+ * stats.c - Latency histograms and counters for the main loop.
+ *
+ * Copyright (C) 2016-2017 Brian Masney <masneyb@onstation.org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "memory.h"
+#include "stats.h"
+
+#define HISTOGRAM_HALF_SUB_BUCKETS	(HISTOGRAM_SUB_BUCKETS / 2)
+
+/*
+ * The real time is used even with the simulated hardware backend since the
+ * point is to find out where the CPU time goes.
+ */
+uint64_t stats_now_usecs(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int _histogram_bucket(uint64_t usecs)
+{
+	if (usecs < HISTOGRAM_SUB_BUCKETS)
+		return usecs;
+	else if (usecs >> HISTOGRAM_MAX_VALUE_BITS)
+		return HISTOGRAM_NUM_BUCKETS - 1;
+
+	int msb = 63 - __builtin_clzll(usecs);
+	int shift = msb - (HISTOGRAM_SUB_BUCKET_BITS - 1);
+	int sub_bucket = (usecs >> shift) - HISTOGRAM_HALF_SUB_BUCKETS;
+
+	return HISTOGRAM_SUB_BUCKETS +
+		(msb - HISTOGRAM_SUB_BUCKET_BITS) * HISTOGRAM_HALF_SUB_BUCKETS +
+		sub_bucket;
+}
+
+/* Returns the largest value that is stored in the bucket */
+static uint64_t _histogram_bucket_value(int bucket)
+{
+	if (bucket < HISTOGRAM_SUB_BUCKETS)
+		return bucket;
+
+	int idx = bucket - HISTOGRAM_SUB_BUCKETS;
+	int msb = HISTOGRAM_SUB_BUCKET_BITS + idx / HISTOGRAM_HALF_SUB_BUCKETS;
+	int shift = msb - (HISTOGRAM_SUB_BUCKET_BITS - 1);
+	uint64_t sub_bucket = HISTOGRAM_HALF_SUB_BUCKETS +
+		idx % HISTOGRAM_HALF_SUB_BUCKETS;
+
+	return ((sub_bucket + 1) << shift) - 1;
+}
+
+void histogram_record(latency_histogram *hist, uint64_t usecs)
+{
+	hist->counts[_histogram_bucket(usecs)]++;
+
+	if (hist->count == 0 || usecs < hist->min)
+		hist->min = usecs;
+	if (usecs > hist->max)
+		hist->max = usecs;
+
+	hist->count++;
+	hist->sum += usecs;
+}
+
+uint64_t histogram_percentile(latency_histogram *hist, double percentile)
+{
+	if (hist->count == 0)
+		return 0;
+
+	double exact_target = hist->count * percentile / 100.0;
+	uint64_t target = exact_target;
+	uint64_t seen = 0;
+
+	/* Round up so that p99 of a handful of values is the largest one */
+	if (target < exact_target || target == 0)
+		target++;
+
+	for (int i = 0; i < HISTOGRAM_NUM_BUCKETS; i++) {
+		seen += hist->counts[i];
+		if (seen < target)
+			continue;
+
+		uint64_t value = _histogram_bucket_value(i);
+
+		if (value < hist->min)
+			return hist->min;
+		else if (value > hist->max)
+			return hist->max;
+		return value;
+	}
+
+	return hist->max;
+}
+
+static void _write_histogram(FILE *fd, char *name, latency_histogram *hist,
+			     char *indent, int last)
+{
+	fprintf(fd, "%s\"%s\": { \"count\": %llu, \"min\": %llu, \"mean\": %llu, \"p50\": %llu, \"p90\": %llu, \"p99\": %llu, \"p999\": %llu, \"max\": %llu }%s\n",
+		indent, name, (unsigned long long) hist->count,
+		(unsigned long long) hist->min,
+		(unsigned long long) (hist->count > 0 ?
+				      hist->sum / hist->count : 0),
+		(unsigned long long) histogram_percentile(hist, 50.0),
+		(unsigned long long) histogram_percentile(hist, 90.0),
+		(unsigned long long) histogram_percentile(hist, 99.0),
+		(unsigned long long) histogram_percentile(hist, 99.9),
+		(unsigned long long) hist->max, last ? "" : ",");
+}
+
+void output_stats_record(output_stats *out, uint64_t write_usecs,
+			 uint64_t bytes_written)
+{
+	output_counters *counters = &out->counters;
+
+	histogram_record(&counters->write, write_usecs);
+	counters->results++;
+	counters->bytes_written = bytes_written;
+
+	seqlock_write_copy(&out->lock, &out->published, counters,
+			   sizeof(*counters));
+}
+
+static void _write_output_stats(FILE *fd, output_stats *out, int last)
+{
+	output_counters counters;
+
+	seqlock_read_copy(&out->lock, &counters, &out->published,
+			  sizeof(counters));
+
+	fprintf(fd, "        { \"type\": \"%s\", \"outfile\": \"%s\", \"results\": %llu, \"bytes_written\": %llu,\n",
+		out->type, out->outfile != NULL ? out->outfile : "stdout",
+		(unsigned long long) counters.results,
+		(unsigned long long) counters.bytes_written);
+	_write_histogram(fd, "write_usecs", &counters.write, "          ", 1);
+	fprintf(fd, "        }%s\n", last ? "" : ",");
+}
+
+/* All of the latencies are in microseconds */
+void write_stats(FILE *fd, yadl_stats *stats, int num_stats,
+		 queue_stats *queue, uint64_t uptime_usecs)
+{
+	fprintf(fd, "{\n");
+	fprintf(fd, "  \"uptime_secs\": %llu,\n",
+		(unsigned long long) (uptime_usecs / 1000000));
+	fprintf(fd, "  \"timestamp\": %ld,\n", (long) time(NULL));
+	fprintf(fd, "  \"allocations\": %llu,\n",
+		(unsigned long long) yadl_num_allocations());
+
+	if (queue != NULL)
+		fprintf(fd, "  \"output_queue\": { \"size\": %d, \"depth\": %llu, \"max_depth\": %llu, \"queued\": %llu, \"dropped\": %llu, \"coalesced\": %llu },\n",
+			queue->size, (unsigned long long) queue->depth,
+			(unsigned long long) queue->max_depth,
+			(unsigned long long) queue->queued,
+			(unsigned long long) queue->dropped,
+			(unsigned long long) queue->coalesced);
+
+	fprintf(fd, "  \"instances\": [\n");
+
+	for (int i = 0; i < num_stats; i++) {
+		yadl_stats *st = &stats[i];
+
+		fprintf(fd, "    {\n");
+		fprintf(fd, "      \"name\": \"%s\",\n", st->name);
+		fprintf(fd, "      \"results\": %llu,\n",
+			(unsigned long long) st->results);
+		fprintf(fd, "      \"failed_results\": %llu,\n",
+			(unsigned long long) st->failed_results);
+		fprintf(fd, "      \"reads\": %llu,\n",
+			(unsigned long long) st->reads);
+		fprintf(fd, "      \"failed_reads\": %llu,\n",
+			(unsigned long long) st->failed_reads);
+		fprintf(fd, "      \"retries\": %llu,\n",
+			(unsigned long long) st->retries);
+		fprintf(fd, "      \"i2c_transactions\": %llu,\n",
+			(unsigned long long) st->i2c_transactions);
+		fprintf(fd, "      \"allocations\": %llu,\n",
+			(unsigned long long) st->allocations);
+		fprintf(fd, "      \"overruns\": %llu,\n",
+			(unsigned long long) st->overruns);
+		fprintf(fd, "      \"skipped_results\": %llu,\n",
+			(unsigned long long) st->skipped_results);
+
+		_write_histogram(fd, "read_usecs", &st->read, "      ", 0);
+		_write_histogram(fd, "read_with_retries_usecs",
+				 &st->read_with_retries, "      ", 0);
+		_write_histogram(fd, "filter_usecs", &st->filter, "      ", 0);
+		_write_histogram(fd, "cycle_usecs", &st->cycle, "      ", 0);
+		_write_histogram(fd, "lateness_usecs", &st->lateness, "      ",
+				 0);
+
+		fprintf(fd, "      \"outputs\": [\n");
+		for (int j = 0; j < st->num_outputs; j++)
+			_write_output_stats(fd, &st->outputs[j],
+					    j + 1 == st->num_outputs);
+		fprintf(fd, "      ]\n");
+
+		fprintf(fd, "    }%s\n", i + 1 == num_stats ? "" : ",");
+	}
+
+	fprintf(fd, "  ]\n");
+	fprintf(fd, "}\n");
+}
+
+/*
+ * The file is written to a temporary file and renamed so that readers never
+ * see a partially written file. Errors are reported but are not fatal since
+ * the stats should never take down the data logging.
+ */
+int write_stats_file(char *filename, yadl_stats *stats, int num_stats,
+		     queue_stats *queue, uint64_t uptime_usecs)
+{
+	size_t len = strlen(filename) + 5;
+	char *tmpfile = yadl_malloc(len);
+
+	snprintf(tmpfile, len, "%s.tmp", filename);
+
+	FILE *fd = fopen(tmpfile, "w");
+
+	if (fd == NULL) {
+		fprintf(stderr, "Error opening %s: %s\n", tmpfile,
+			strerror(errno));
+		free(tmpfile);
+		return -1;
+	}
+
+	write_stats(fd, stats, num_stats, queue, uptime_usecs);
+
+	if (fclose(fd) < 0) {
+		fprintf(stderr, "Error closing %s: %s\n", tmpfile,
+			strerror(errno));
+		unlink(tmpfile);
+		free(tmpfile);
+		return -1;
+	}
+
+	if (rename(tmpfile, filename) < 0) {
+		fprintf(stderr, "Error renaming %s to %s: %s\n", tmpfile,
+			filename, strerror(errno));
+		unlink(tmpfile);
+		free(tmpfile);
+		return -1;
+	}
+
+	free(tmpfile);
+	return 0;
+}
@@ -0,0 +1,141 @@
+/*
+ * stats.h - Latency histograms and counters for the main loop.
+ *
+ * Copyright (C) 2016-2017 Brian Masney <masneyb@onstation.org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include "seqlock.h"
+
+/*
+ * Latencies are stored in microseconds in an HDR style histogram. Values
+ * below HISTOGRAM_SUB_BUCKETS are exact. Above that, each power of two
+ * range is split into HISTOGRAM_SUB_BUCKETS / 2 buckets so that the
+ * relative error stays below 1 / (HISTOGRAM_SUB_BUCKETS / 2).
+ */
+#define HISTOGRAM_SUB_BUCKET_BITS	4
+#define HISTOGRAM_SUB_BUCKETS		(1 << HISTOGRAM_SUB_BUCKET_BITS)
+
+/* Values larger than this (about 19 hours) are stored in the last bucket */
+#define HISTOGRAM_MAX_VALUE_BITS	36
+#define HISTOGRAM_NUM_BUCKETS		(HISTOGRAM_SUB_BUCKETS + \
+					 (HISTOGRAM_MAX_VALUE_BITS - \
+					  HISTOGRAM_SUB_BUCKET_BITS) * \
+					 (HISTOGRAM_SUB_BUCKETS / 2))
+
+typedef struct latency_histogram_tag {
+	uint32_t counts[HISTOGRAM_NUM_BUCKETS];
+	uint64_t count;
+	uint64_t sum;
+	uint64_t min;
+	uint64_t max;
+} latency_histogram;
+
+typedef struct output_counters_tag {
+	uint64_t results;
+
+	/* Bytes passed to stdio. This is always 0 for the rrd output. */
+	uint64_t bytes_written;
+
+	latency_histogram write;
+} output_counters;
+
+typedef struct output_stats_tag {
+	char *type;
+	char *outfile;
+
+	/* Only used by the thread that writes the results */
+	output_counters counters;
+
+	/*
+	 * The copy of the counters that the stats are written from. With
+	 * --async_output, the output thread publishes it after each write
+	 * while the main loop reads it.
+	 */
+	seqlock lock;
+	output_counters published;
+} output_stats;
+
+/* Everything that is tracked for a single sensor instance */
+typedef struct yadl_stats_tag {
+	char *name;
+
+	uint64_t results;
+	uint64_t failed_results;
+	uint64_t reads;
+	uint64_t failed_reads;
+	uint64_t retries;
+
+	/* Made by the sensor's read function. See hw_i2c_transactions. */
+	uint64_t i2c_transactions;
+
+	/* Heap allocations made while producing the results */
+	uint64_t allocations;
+
+	/* See schedule.h */
+	uint64_t overruns;
+	uint64_t skipped_results;
+
+	/* How long after its deadline a result was started */
+	latency_histogram lateness;
+
+	/* A single call to the sensor's read function */
+	latency_histogram read;
+
+	/* A sample, including any failed reads and the sleeps between them */
+	latency_histogram read_with_retries;
+
+	latency_histogram filter;
+
+	/*
+	 * Reading, filtering and writing a result to all of the outputs. With
+	 * --async_output, this stops once the result is queued.
+	 */
+	latency_histogram cycle;
+
+	int num_outputs;
+	output_stats *outputs;
+} yadl_stats;
+
+/* The queue in front of the output thread when --async_output is used */
+typedef struct queue_stats_tag {
+	int size;
+	uint64_t depth;
+	uint64_t max_depth;
+	uint64_t queued;
+	uint64_t dropped;
+	uint64_t coalesced;
+} queue_stats;
+
+uint64_t stats_now_usecs(void);
+
+void histogram_record(latency_histogram *hist, uint64_t usecs);
+
+uint64_t histogram_percentile(latency_histogram *hist, double percentile);
+
+/* Called by the thread that writes the results after each write */
+void output_stats_record(output_stats *out, uint64_t write_usecs,
+			 uint64_t bytes_written);
+
+/* queue is NULL when the results are written from the main loop */
+void write_stats(FILE *fd, yadl_stats *stats, int num_stats,
+		 queue_stats *queue, uint64_t uptime_usecs);
+
+int write_stats_file(char *filename, yadl_stats *stats, int num_stats,
+		     queue_stats *queue, uint64_t uptime_usecs);
@@ -0,0 +1,71 @@
+/*
+ * trace_widths.c - Reads the pin widths of a simulated hardware trace.
+ *
+ * Copyright (C) 2016-2017 Brian Masney <masneyb@onstation.org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "trace_widths.h"
+
+int trace_load_pin_widths(char *filename, unsigned int *widths,
+			  int max_widths)
+{
+	FILE *fd = fopen(filename, "r");
+
+	if (fd == NULL) {
+		fprintf(stderr, "Error opening %s: %s\n", filename,
+			strerror(errno));
+		return -1;
+	}
+
+	char *line = NULL;
+	size_t line_size = 0;
+	int num_widths = -1;
+
+	while (num_widths < 0 && getline(&line, &line_size, fd) >= 0) {
+		char *saveptr = NULL;
+
+		line[strcspn(line, "\r\n")] = '\0';
+
+		char *type = strtok_r(line, " \t", &saveptr);
+
+		if (type == NULL || strcmp(type, "pin") != 0)
+			continue;
+
+		/* Skip the pin number and the initial level */
+		strtok_r(NULL, " \t", &saveptr);
+		strtok_r(NULL, " \t", &saveptr);
+
+		num_widths = 0;
+		for (char *tok = strtok_r(NULL, " \t", &saveptr);
+		     tok != NULL && num_widths < max_widths;
+		     tok = strtok_r(NULL, " \t", &saveptr))
+			widths[num_widths++] = strtoul(tok, NULL, 10);
+	}
+
+	free(line);
+	fclose(fd);
+
+	if (num_widths < 0)
+		fprintf(stderr, "%s: No pin entry\n", filename);
+
+	return num_widths;
+}
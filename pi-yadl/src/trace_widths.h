@@ -1,5 +1,5 @@
 /*
- * float_list.h
+ * trace_widths.h - Reads the pin widths of a simulated hardware trace.
  *
  * Copyright (C) 2016-2017 Brian Masney <masneyb@onstation.org>
  *
@@ -19,20 +19,10 @@
  * 02110-1301, USA.
  */
 
-typedef struct float_node_tag float_node;
-
-struct float_node_tag {
-	float value;
-	float_node *next;
-};
-
-int list_len(float_node *list);
-
-float list_sum(float_node *list);
-
-float_node *list_last_node(float_node *list);
-
-float_node *new_list_node(float value);
-
-void free_list(float_node *list);
-
+/*
+ * Reads the widths from the first pin entry of a trace. See hw_sim.c for
+ * the format. Returns the number of widths, or -1 if the trace can't be
+ * read.
+ */
+int trace_load_pin_widths(char *filename, unsigned int *widths,
+			  int max_widths);
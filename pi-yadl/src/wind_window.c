@@ -0,0 +1,357 @@
+/*
+ * wind_window.c - Sliding windows over the wind samples.
+ *
+ * Copyright (C) 2016-2017 Brian Masney <masneyb@onstation.org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include "memory.h"
+#include "state_file.h"
+#include "wind_window.h"
+
+static void _reset_bucket(wind_bucket *bucket)
+{
+	memset(bucket, 0, sizeof(*bucket));
+	bucket->gust_speed = -1;
+	bucket->gust_direction = -1;
+}
+
+static void _add_to_bucket(wind_bucket *bucket, float speed, float gust_speed,
+			   float direction)
+{
+	bucket->speed_sum += speed;
+	circular_add(&bucket->direction_sums, circular_position(direction));
+
+	if (gust_speed > bucket->gust_speed) {
+		bucket->gust_speed = gust_speed;
+		bucket->gust_direction = direction;
+	}
+}
+
+static void _window_init(wind_window *win, char *name, int secs)
+{
+	memset(win, 0, sizeof(*win));
+	win->name = name;
+	win->secs = secs;
+
+	if (secs <= WIND_WINDOW_MAX_RAW_SECS) {
+		win->bucket_secs = 1;
+		win->size = secs;
+	} else {
+		/* The minute in progress makes up the rest of the window */
+		win->bucket_secs = WIND_BUCKET_SECS;
+		win->size = secs / WIND_BUCKET_SECS - 1;
+	}
+
+	win->buckets = yadl_calloc(win->size, sizeof(wind_bucket));
+	win->gusts = yadl_calloc(win->size, sizeof(uint64_t));
+}
+
+/* Returns the window length in seconds, or -1 if it is not valid */
+static int _parse_window_secs(char *name)
+{
+	char *unit;
+
+	errno = 0;
+	long len = strtol(name, &unit, 10);
+
+	if (errno != 0 || unit == name || len <= 0 || strlen(unit) != 1)
+		return -1;
+
+	int multiplier;
+
+	switch (*unit) {
+	case 's':
+		multiplier = 1;
+		break;
+	case 'm':
+		multiplier = 60;
+		break;
+	case 'h':
+		multiplier = 3600;
+		break;
+	default:
+		return -1;
+	}
+
+	if (len > 7 * 86400 / multiplier)
+		return -1;
+
+	int secs = len * multiplier;
+
+	/* The longer windows are made of whole minutes */
+	if (secs > WIND_WINDOW_MAX_RAW_SECS && secs % WIND_BUCKET_SECS != 0)
+		return -1;
+
+	return secs;
+}
+
+int wind_windows_init(wind_windows *ws, char *spec)
+{
+	int max_windows = 1;
+
+	for (char *pos = spec; *pos != '\0'; pos++) {
+		if (*pos == ',')
+			max_windows++;
+	}
+
+	if (max_windows > WIND_MAX_WINDOWS)
+		return -1;
+
+	memset(ws, 0, sizeof(*ws));
+	ws->windows = yadl_calloc(max_windows, sizeof(wind_window));
+	_reset_bucket(&ws->minute);
+
+	/* The names point into the copy and are used for the headers */
+	char *names = yadl_malloc(strlen(spec) + 1);
+	char *saveptr;
+
+	strcpy(names, spec);
+	for (char *name = strtok_r(names, ",", &saveptr); name != NULL;
+	     name = strtok_r(NULL, ",", &saveptr)) {
+		int secs = _parse_window_secs(name);
+
+		if (secs < 0)
+			return -1;
+
+		for (int i = 0; i < ws->num_windows; i++) {
+			if (strcmp(ws->windows[i].name, name) == 0)
+				return -1;
+		}
+
+		_window_init(&ws->windows[ws->num_windows++], name, secs);
+	}
+
+	return ws->num_windows == 0 ? -1 : 0;
+}
+
+static uint64_t _gust_at(wind_window *win, int pos)
+{
+	return win->gusts[(win->gusts_head + pos) % win->size];
+}
+
+static void _window_resum(wind_window *win)
+{
+	win->speed_sum = 0.0;
+	memset(&win->direction_sums, 0, sizeof(win->direction_sums));
+
+	for (int i = 0; i < win->num_buckets; i++) {
+		win->speed_sum += win->buckets[i].speed_sum;
+		circular_add_sums(&win->direction_sums,
+				  &win->buckets[i].direction_sums);
+	}
+}
+
+static void _window_push(wind_window *win, wind_bucket *bucket)
+{
+	uint64_t num = win->num_pushed++;
+	int idx = num % win->size;
+	wind_bucket *slot = &win->buckets[idx];
+
+	if (win->num_buckets == win->size) {
+		win->speed_sum -= slot->speed_sum;
+		circular_remove_sums(&win->direction_sums,
+				     &slot->direction_sums);
+
+		if (win->num_gusts > 0 && _gust_at(win, 0) + win->size == num) {
+			win->gusts_head = (win->gusts_head + 1) % win->size;
+			win->num_gusts--;
+		}
+	} else {
+		win->num_buckets++;
+	}
+
+	*slot = *bucket;
+	if (idx == win->size - 1) {
+		_window_resum(win);
+	} else {
+		win->speed_sum += bucket->speed_sum;
+		circular_add_sums(&win->direction_sums,
+				  &bucket->direction_sums);
+	}
+
+	/* Older buckets with slower gusts can never be the gust again */
+	while (win->num_gusts > 0) {
+		uint64_t last = _gust_at(win, win->num_gusts - 1);
+
+		if (win->buckets[last % win->size].gust_speed >=
+		    bucket->gust_speed)
+			break;
+
+		win->num_gusts--;
+	}
+
+	win->gusts[(win->gusts_head + win->num_gusts) % win->size] = num;
+	win->num_gusts++;
+}
+
+void wind_windows_push(wind_windows *ws, float speed, float gust_speed,
+		       float direction)
+{
+	wind_bucket sample;
+
+	_reset_bucket(&sample);
+	_add_to_bucket(&sample, speed, gust_speed, direction);
+	_add_to_bucket(&ws->minute, speed, gust_speed, direction);
+
+	int minute_done = ws->minute.direction_sums.count == WIND_BUCKET_SECS;
+
+	for (int i = 0; i < ws->num_windows; i++) {
+		wind_window *win = &ws->windows[i];
+
+		if (win->bucket_secs == 1)
+			_window_push(win, &sample);
+		else if (minute_done)
+			_window_push(win, &ws->minute);
+	}
+
+	if (minute_done)
+		_reset_bucket(&ws->minute);
+}
+
+void wind_windows_values(wind_windows *ws, int idx, float *values,
+			 float *direction_stddev)
+{
+	wind_window *win = &ws->windows[idx];
+	double speed_sum = win->speed_sum;
+	circular_sums direction_sums = win->direction_sums;
+	float gust_speed = -1;
+	float gust_direction = -1;
+
+	if (win->num_gusts > 0) {
+		wind_bucket *gust = &win->buckets[_gust_at(win, 0) % win->size];
+
+		gust_speed = gust->gust_speed;
+		gust_direction = gust->gust_direction;
+	}
+
+	if (win->bucket_secs != 1) {
+		speed_sum += ws->minute.speed_sum;
+		circular_add_sums(&direction_sums, &ws->minute.direction_sums);
+
+		if (ws->minute.gust_speed > gust_speed) {
+			gust_speed = ws->minute.gust_speed;
+			gust_direction = ws->minute.gust_direction;
+		}
+	}
+
+	values[0] = circular_mean(&direction_sums);
+	values[1] = speed_sum / direction_sums.count;
+	values[2] = gust_direction;
+	values[3] = gust_speed;
+	*direction_stddev = circular_stddev(&direction_sums);
+}
+
+size_t wind_windows_state_size(wind_windows *ws)
+{
+	size_t size = sizeof(ws->minute);
+
+	for (int i = 0; i < ws->num_windows; i++) {
+		wind_window *win = &ws->windows[i];
+
+		size += sizeof(win->num_buckets) + sizeof(win->num_pushed) +
+			sizeof(win->speed_sum) + sizeof(win->direction_sums) +
+			sizeof(win->gusts_head) + sizeof(win->num_gusts) +
+			win->size * (sizeof(wind_bucket) + sizeof(uint64_t));
+	}
+
+	return size;
+}
+
+void wind_windows_save(wind_windows *ws, char **pos)
+{
+	state_write(pos, &ws->minute, sizeof(ws->minute));
+
+	for (int i = 0; i < ws->num_windows; i++) {
+		wind_window *win = &ws->windows[i];
+
+		state_write(pos, &win->num_buckets, sizeof(win->num_buckets));
+		state_write(pos, &win->num_pushed, sizeof(win->num_pushed));
+		state_write(pos, &win->speed_sum, sizeof(win->speed_sum));
+		state_write(pos, &win->direction_sums,
+			    sizeof(win->direction_sums));
+		state_write(pos, &win->gusts_head, sizeof(win->gusts_head));
+		state_write(pos, &win->num_gusts, sizeof(win->num_gusts));
+		state_write(pos, win->buckets, win->size * sizeof(wind_bucket));
+		state_write(pos, win->gusts, win->size * sizeof(uint64_t));
+	}
+}
+
+/*
+ * Pushes the empty buckets for the seconds when no samples were taken so
+ * that the samples from before are evicted as they would have been.
+ */
+static void _windows_skip(wind_windows *ws, uint64_t secs)
+{
+	wind_bucket empty;
+	uint64_t minute_left = WIND_BUCKET_SECS -
+		ws->minute.direction_sums.count;
+	uint64_t num_minutes = 0;
+
+	_reset_bucket(&empty);
+	if (secs >= minute_left)
+		num_minutes = 1 + (secs - minute_left) / WIND_BUCKET_SECS;
+
+	for (int i = 0; i < ws->num_windows; i++) {
+		wind_window *win = &ws->windows[i];
+		uint64_t num_empty;
+
+		if (win->bucket_secs == 1) {
+			num_empty = secs;
+		} else if (num_minutes > 0) {
+			/* The minute that was in progress ends first */
+			_window_push(win, &ws->minute);
+			num_empty = num_minutes - 1;
+		} else {
+			continue;
+		}
+
+		/* Once the window is full of empty buckets more change nothing */
+		if (num_empty > (uint64_t) win->size)
+			num_empty = win->size;
+
+		for (uint64_t j = 0; j < num_empty; j++)
+			_window_push(win, &empty);
+	}
+
+	if (num_minutes > 0)
+		_reset_bucket(&ws->minute);
+}
+
+void wind_windows_load(wind_windows *ws, char **pos, uint64_t age_usecs)
+{
+	state_read(pos, &ws->minute, sizeof(ws->minute));
+
+	for (int i = 0; i < ws->num_windows; i++) {
+		wind_window *win = &ws->windows[i];
+
+		state_read(pos, &win->num_buckets, sizeof(win->num_buckets));
+		state_read(pos, &win->num_pushed, sizeof(win->num_pushed));
+		state_read(pos, &win->speed_sum, sizeof(win->speed_sum));
+		state_read(pos, &win->direction_sums,
+			   sizeof(win->direction_sums));
+		state_read(pos, &win->gusts_head, sizeof(win->gusts_head));
+		state_read(pos, &win->num_gusts, sizeof(win->num_gusts));
+		state_read(pos, win->buckets, win->size * sizeof(wind_bucket));
+		state_read(pos, win->gusts, win->size * sizeof(uint64_t));
+	}
+
+	_windows_skip(ws, age_usecs / 1000000);
+}
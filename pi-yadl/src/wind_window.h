@@ -0,0 +1,128 @@
+/*
+ * wind_window.h - Sliding windows over the wind samples.
+ *
+ * Copyright (C) 2016-2017 Brian Masney <masneyb@onstation.org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include "circular.h"
+
+/* The windows used when --wind_windows is not given */
+#define DEFAULT_WIND_WINDOWS		"2m,10m,60m"
+
+/*
+ * Windows up to this long keep every one second sample. Longer windows
+ * keep one bucket per minute so that their memory and the cost of a
+ * sample stay bounded as they get longer.
+ */
+#define WIND_WINDOW_MAX_RAW_SECS	600
+#define WIND_BUCKET_SECS		60
+
+/* Each window adds 5 values to the argent_80422 results */
+#define WIND_MAX_WINDOWS		8
+
+/* The wind samples that were combined into one bucket */
+typedef struct wind_bucket_tag {
+	double speed_sum;
+	circular_sums direction_sums;
+
+	/* The oldest sample wins when there is a tie */
+	float gust_speed;
+	float gust_direction;
+} wind_bucket;
+
+/*
+ * A sliding window over the last size buckets. The sums and the gust
+ * candidates are updated as each bucket is added and the oldest one is
+ * evicted, so reading the averages and the gust is O(1). Adding and
+ * removing doubles leaves a little rounding error behind each time, so
+ * the sums are added up again from the buckets each time the ring wraps
+ * around to keep it from building up.
+ */
+typedef struct wind_window_tag {
+	/* The name used in the value headers, such as 2m */
+	char *name;
+	int secs;
+
+	/* Either 1 or WIND_BUCKET_SECS */
+	int bucket_secs;
+
+	int size;
+	int num_buckets;
+	uint64_t num_pushed;
+
+	/* Indexed by the bucket number modulo size */
+	wind_bucket *buckets;
+
+	double speed_sum;
+	circular_sums direction_sums;
+
+	/*
+	 * Bucket numbers of the gust candidates, oldest first. The gust
+	 * speeds never increase from the front to the back, so the front is
+	 * the gust.
+	 */
+	uint64_t *gusts;
+	int gusts_head;
+	int num_gusts;
+} wind_window;
+
+/*
+ * All of the windows fed from the one second wind samples. The minute
+ * windows hold whole minutes and the minute that is in progress is added
+ * in when they are read, so they cover between one minute less than their
+ * length and their full length.
+ */
+typedef struct wind_windows_tag {
+	int num_windows;
+	wind_window *windows;
+
+	wind_bucket minute;
+} wind_windows;
+
+/*
+ * Parses a comma separated list of window lengths such as 3s,2m,10m,60m,24h.
+ * Returns -1 if the list is not valid or has more than WIND_MAX_WINDOWS.
+ */
+int wind_windows_init(wind_windows *ws, char *spec);
+
+/*
+ * gust_speed is the highest 3 second running mean of the speed during the
+ * sample. The gust of a window is the highest of them.
+ */
+void wind_windows_push(wind_windows *ws, float speed, float gust_speed,
+		       float direction);
+
+/*
+ * Fills in the average direction, average speed, gust direction and gust
+ * speed of a window. The gust speed and direction are -1 when the window
+ * is empty.
+ */
+void wind_windows_values(wind_windows *ws, int idx, float *values,
+			 float *direction_stddev);
+
+size_t wind_windows_state_size(wind_windows *ws);
+
+void wind_windows_save(wind_windows *ws, char **pos);
+
+/*
+ * age_usecs is how long ago the state was saved. The windows are aged by
+ * that much as if no samples were taken in the meantime.
+ */
+void wind_windows_load(wind_windows *ws, char **pos, uint64_t age_usecs);
@@ -0,0 +1,903 @@
+/*
+ * yadl-bench.c - Microbenchmarks for the sample processing pipeline.
+ *
+ * Copyright (C) 2016-2017 Brian Masney <masneyb@onstation.org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include <errno.h>
+#include <getopt.h>
+#include <limits.h>
+#include <rrd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "dht_decoder.h"
+#include "gpio_events.h"
+#include "rrd_common.h"
+#include "trace_widths.h"
+#include "yadl.h"
+
+/* Aim for roughly this many samples to be processed per measurement */
+#define SAMPLES_PER_MEASUREMENT 20000000
+
+#define NUM_OUTPUT_RECORDS	100000
+#define NUM_SINGLE_JSON_RECORDS	2000
+#define NUM_ARGENT_READS	20000
+#define NUM_LOGGER_CALLS	200000
+#define NUM_GPIO_EVENTS		1000000
+#define NUM_DHT_DECODES		1000000
+
+/* Fits in the pipe so that writing the mock edges never blocks */
+#define GPIO_EVENTS_PER_WRITE	1024
+
+/* The wind windows for the argent benchmark and how long to fill them */
+#define BENCH_WIND_WINDOWS	"3s,2m,10m,60m,24h"
+#define BENCH_WIND_SECS		3600
+
+/* Matches the step that the rrd_common.c help text suggests */
+#define RRD_STEP_SECS		30
+
+static int _sample_counts[] = { 1000, 100000, 1000000 };
+
+static char *_filter_names[] = {
+	"median", "median_approx", "mean", "mode", "sum", "min", "max",
+	"range", NULL
+};
+
+static char *_outputter_names[] = {
+	"json", "single_json", "yaml", "csv", "xml", NULL
+};
+
+typedef struct bench_result_tag {
+	char *benchmark;
+	char *name;
+	char config[64];
+	int iterations;
+	double nsecs_per_op;
+
+	/* These are -1 when they are not measured */
+	double syscalls_per_op;
+	double bytes_per_op;
+	double allocations_per_op;
+} bench_result;
+
+typedef struct bench_options_tag {
+	char *format;
+	FILE *fd;
+	char *tmpdir;
+	int rrd_updates;
+	int num_results;
+} bench_options;
+
+void usage(void)
+{
+	printf("usage: yadl-bench [ --format <text|csv|json> ]\n");
+	printf("\t\t[ --outfile <path to results. Uses stdout if not specified.> ]\n");
+	printf("\t\t[ --tmpdir <directory for the scratch files. Defaults to /tmp.> ]\n");
+	printf("\t\t[ --rrd_updates <number of timed RRD updates. Defaults to 3.> ]\n");
+	printf("\n");
+	printf("Note: Each RRD update is followed by a one second pause since RRD only\n");
+	printf("accepts a single update per second.\n");
+	exit(1);
+}
+
+static double _now_nsecs(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000.0 + ts.tv_nsec;
+}
+
+/*
+ * Returns the number of read and write system calls that this process has
+ * made so far, or -1 if /proc/self/io is not available.
+ */
+static long long _get_num_syscalls(void)
+{
+	FILE *fd = fopen("/proc/self/io", "r");
+
+	if (fd == NULL)
+		return -1;
+
+	char line[64];
+	long long value, total = 0;
+	int num_found = 0;
+
+	while (fgets(line, sizeof(line), fd) != NULL) {
+		if (sscanf(line, "syscr: %lld", &value) == 1 ||
+		    sscanf(line, "syscw: %lld", &value) == 1) {
+			total += value;
+			num_found++;
+		}
+	}
+
+	fclose(fd);
+
+	return num_found == 2 ? total : -1;
+}
+
+static double _get_syscalls_per_op(long long start, long long stop,
+				   int iterations)
+{
+	if (start < 0 || stop < 0)
+		return -1;
+
+	/* Don't count the read of /proc/self/io by _get_num_syscalls() */
+	return (double) (stop - start - 1) / iterations;
+}
+
+static double _get_bytes_per_op(char *filename, int iterations)
+{
+	struct stat st;
+
+	if (stat(filename, &st) == -1)
+		return -1;
+
+	return (double) st.st_size / iterations;
+}
+
+static void _write_result(bench_options *opts, bench_result *res,
+			  int result_number)
+{
+	double ops_per_sec = 1000000000.0 / res->nsecs_per_op;
+
+	if (strcmp(opts->format, "csv") == 0) {
+		if (result_number == 0)
+			fprintf(opts->fd, "benchmark,name,config,iterations,nsecs_per_op,ops_per_sec,syscalls_per_op,bytes_per_op,allocations_per_op\n");
+
+		fprintf(opts->fd, "%s,%s,%s,%d,%.1f,%.1f,%.2f,%.1f,%.2f\n",
+			res->benchmark, res->name, res->config,
+			res->iterations, res->nsecs_per_op, ops_per_sec,
+			res->syscalls_per_op, res->bytes_per_op,
+			res->allocations_per_op);
+	} else if (strcmp(opts->format, "json") == 0) {
+		fprintf(opts->fd, "%s {", result_number == 0 ? "" : ",\n");
+		fprintf(opts->fd, " \"benchmark\": \"%s\",", res->benchmark);
+		fprintf(opts->fd, " \"name\": \"%s\",", res->name);
+		fprintf(opts->fd, " \"config\": \"%s\",", res->config);
+		fprintf(opts->fd, " \"iterations\": %d,", res->iterations);
+		fprintf(opts->fd, " \"nsecs_per_op\": %.1f,",
+			res->nsecs_per_op);
+		fprintf(opts->fd, " \"ops_per_sec\": %.1f,", ops_per_sec);
+		fprintf(opts->fd, " \"syscalls_per_op\": %.2f,",
+			res->syscalls_per_op);
+		fprintf(opts->fd, " \"bytes_per_op\": %.1f,",
+			res->bytes_per_op);
+		fprintf(opts->fd, " \"allocations_per_op\": %.2f }",
+			res->allocations_per_op);
+	} else {
+		fprintf(opts->fd, "%-8s %-22s %-40s %14.1f nsecs/op %12.1f ops/sec",
+			res->benchmark, res->name, res->config,
+			res->nsecs_per_op, ops_per_sec);
+		if (res->syscalls_per_op >= 0)
+			fprintf(opts->fd, " %8.2f syscalls/op",
+				res->syscalls_per_op);
+		if (res->bytes_per_op >= 0)
+			fprintf(opts->fd, " %8.1f bytes/op",
+				res->bytes_per_op);
+		if (res->allocations_per_op >= 0)
+			fprintf(opts->fd, " %8.2f allocations/op",
+				res->allocations_per_op);
+		fprintf(opts->fd, "\n");
+	}
+
+	/* Allow watching the progress of the slower benchmarks */
+	fflush(opts->fd);
+}
+
+static void _init_result(bench_result *res, char *benchmark, char *name,
+			 int iterations)
+{
+	memset(res, 0, sizeof(*res));
+	res->benchmark = benchmark;
+	res->name = name;
+	res->iterations = iterations;
+	res->syscalls_per_op = -1;
+	res->bytes_per_op = -1;
+	res->allocations_per_op = -1;
+}
+
+/*
+ * Noisy readings from a 10-bit ADC. This is similar to the data that is
+ * averaged when reading an analog channel with a large number of samples.
+ */
+static float *_generate_readings(int num_samples)
+{
+	float *readings = malloc(sizeof(float) * num_samples);
+
+	srand(1);
+	for (int i = 0; i < num_samples; i++)
+		readings[i] = 500 + (rand() % 49) - 24;
+
+	return readings;
+}
+
+/*
+ * Measures the per result cost of storing or streaming the samples and
+ * running them through the filter, which is what _perform_all_readings()
+ * does once the sensor returns each sample.
+ */
+static void _bench_filter(bench_result *res, char *filter_name,
+			  int num_samples, int trim)
+{
+	filter *filter_func = get_filter(filter_name);
+	int buffered = filter_needs_samples(filter_func, trim);
+	float *readings = _generate_readings(num_samples);
+	float *samples = malloc(sizeof(float) * num_samples);
+	int iterations = SAMPLES_PER_MEASUREMENT / num_samples;
+	filter_state state;
+	volatile float result;
+
+	double start = _now_nsecs();
+
+	for (int iter = 0; iter < iterations; iter++) {
+		if (!buffered) {
+			filter_func->init(&state);
+			for (int i = 0; i < num_samples; i++)
+				filter_func->push(&state, readings[i]);
+
+			result = filter_func->finalize(&state);
+			continue;
+		}
+
+		for (int i = 0; i < num_samples; i++)
+			samples[i] = readings[i];
+
+		result = filter_samples(filter_func, samples, num_samples,
+					trim);
+	}
+
+	double elapsed = _now_nsecs() - start;
+
+	(void) result;
+
+	_init_result(res, "filter", filter_name, iterations);
+	snprintf(res->config, sizeof(res->config),
+		 "samples=%d trimmed=%d %s", num_samples, trim,
+		 buffered ? "buffered" : "streamed");
+	res->nsecs_per_op = elapsed / iterations;
+
+	free(samples);
+	free(readings);
+}
+
+static void _run_filter_benchmarks(bench_options *opts)
+{
+	int num_sample_counts = sizeof(_sample_counts) / sizeof(int);
+	bench_result res;
+
+	for (int i = 0; i < num_sample_counts; i++) {
+		for (int j = 0; _filter_names[j] != NULL; j++) {
+			_bench_filter(&res, _filter_names[j],
+				      _sample_counts[i], 0);
+			_write_result(opts, &res, opts->num_results++);
+
+			_bench_filter(&res, _filter_names[j],
+				      _sample_counts[i],
+				      _sample_counts[i] / 5);
+			_write_result(opts, &res, opts->num_results++);
+		}
+	}
+}
+
+static void _logger_noop(__attribute__((__unused__)) const char *format, ...)
+{
+	/* NOOP */
+}
+
+/*
+ * The outputters are benchmarked with the argent_80422 sensor since it has
+ * the most values and also has units. The sensor is not initialized since
+ * only the header names are needed.
+ */
+static void _init_output_config(yadl_config *config, int num_results)
+{
+	memset(config, 0, sizeof(*config));
+	config->sens = &argent_80422_sensor_funcs;
+	config->logger = &_logger_noop;
+	config->num_results = num_results;
+	config->wind_speed_unit = "mph";
+	config->rain_gauge_unit = "in";
+	config->schema = new_sensor_schema(config);
+}
+
+static yadl_result *_new_output_result(yadl_config *config)
+{
+	int num_values = config->schema->num_values;
+	yadl_result *result = malloc(sizeof(*result));
+
+	result->value = malloc(sizeof(float) * num_values);
+	for (int i = 0; i < num_values; i++)
+		result->value[i] = 10.0 + i * 1.25;
+
+	result->unit = malloc(sizeof(char *) * 2);
+	result->unit[0] = config->wind_speed_unit;
+	result->unit[1] = config->rain_gauge_unit;
+	result->timestamp = time(NULL);
+
+	return result;
+}
+
+static void _free_output_result(yadl_result *result)
+{
+	free(result->value);
+	free(result->unit);
+	free(result);
+}
+
+/*
+ * The file is opened, written and closed inside the timed region so that the
+ * cost of flushing the stdio buffers is included.
+ */
+static void _bench_outputter(bench_result *res, bench_options *opts,
+			     char *name)
+{
+	int iterations = strcmp(name, "single_json") == 0 ?
+		NUM_SINGLE_JSON_RECORDS : NUM_OUTPUT_RECORDS;
+	outputter *out = get_outputter(name);
+	char outfile[PATH_MAX];
+	yadl_config config;
+
+	snprintf(outfile, sizeof(outfile), "%s/yadl-bench-output.%s",
+		 opts->tmpdir, name);
+
+	_init_output_config(&config, iterations);
+	yadl_result *result = _new_output_result(&config);
+
+	long long start_syscalls = _get_num_syscalls();
+	double start = _now_nsecs();
+
+	output_metadata *meta = out->open(&config, outfile);
+
+	if (out->write_header != NULL)
+		out->write_header(meta, &config);
+
+	for (int i = 0; i < iterations; i++)
+		out->write_result(meta, i, result, &config);
+
+	if (out->write_footer != NULL)
+		out->write_footer(meta);
+
+	if (out->close != NULL)
+		out->close(meta, &config);
+
+	double elapsed = _now_nsecs() - start;
+	long long stop_syscalls = _get_num_syscalls();
+
+	_init_result(res, "output", name, iterations);
+	snprintf(res->config, sizeof(res->config), "values=%d",
+		 config.schema->num_values);
+	res->nsecs_per_op = elapsed / iterations;
+	res->syscalls_per_op = _get_syscalls_per_op(start_syscalls,
+						    stop_syscalls, iterations);
+
+	/* single_json only keeps the last result */
+	res->bytes_per_op = _get_bytes_per_op(outfile,
+					      strcmp(name, "single_json") == 0 ?
+					      1 : iterations);
+
+	/* _close_fd() does not free the metadata when writing to a file */
+	free(meta);
+	_free_output_result(result);
+	unlink(outfile);
+}
+
+static void _run_outputter_benchmarks(bench_options *opts)
+{
+	bench_result res;
+
+	for (int i = 0; _outputter_names[i] != NULL; i++) {
+		_bench_outputter(&res, opts, _outputter_names[i]);
+		_write_result(opts, &res, opts->num_results++);
+	}
+}
+
+static void _create_bench_rrd_database(char *rrd_database, char **names)
+{
+	int num_values = 0;
+
+	for (; names[num_values] != NULL; num_values++)
+		;
+
+	const char **args = malloc(sizeof(char *) * (num_values + 1));
+	char (*ds)[64] = malloc(sizeof(*ds) * num_values);
+
+	for (int i = 0; i < num_values; i++) {
+		snprintf(ds[i], sizeof(ds[i]), "DS:%s:GAUGE:600:U:U",
+			 names[i]);
+		args[i] = ds[i];
+	}
+	args[num_values] = "RRA:MAX:0.5:1:120";
+
+	unlink(rrd_database);
+
+	rrd_clear_error();
+	if (rrd_create_r(rrd_database, RRD_STEP_SECS, time(NULL) - 10,
+			 num_values + 1, args) != 0) {
+		fprintf(stderr, "Error creating RRD database %s: %s\n",
+			rrd_database, rrd_get_error());
+		exit(1);
+	}
+
+	free(ds);
+	free(args);
+}
+
+/*
+ * RRD rejects more than one update per second for the same database so only
+ * the update itself is timed. via_outputter includes the outputter
+ * indirection that yadl uses on top of write_to_rrd_database().
+ */
+static void _bench_rrd(bench_result *res, bench_options *opts,
+		       int via_outputter)
+{
+	char outfile[PATH_MAX];
+	yadl_config config;
+	double elapsed = 0.0;
+	long long syscalls = 0;
+
+	snprintf(outfile, sizeof(outfile), "%s/yadl-bench.rrd", opts->tmpdir);
+
+	_init_output_config(&config, opts->rrd_updates);
+	yadl_result *result = _new_output_result(&config);
+	char **names = config.schema->value_names;
+	outputter *out = get_outputter("rrd");
+
+	_create_bench_rrd_database(outfile, names);
+
+	output_metadata *meta = out->open(&config, outfile);
+
+	for (int i = 0; i < opts->rrd_updates; i++) {
+		sleep(1);
+
+		long long start_syscalls = _get_num_syscalls();
+		double start = _now_nsecs();
+
+		if (via_outputter)
+			out->write_result(meta, i, result, &config);
+		else
+			write_to_rrd_database(config.logger, outfile, names,
+					      result->value);
+
+		elapsed += _now_nsecs() - start;
+
+		long long stop_syscalls = _get_num_syscalls();
+
+		if (start_syscalls < 0 || stop_syscalls < 0 || syscalls < 0)
+			syscalls = -1;
+		else
+			syscalls += stop_syscalls - start_syscalls - 1;
+	}
+
+	out->close(meta, &config);
+
+	_init_result(res, "rrd", via_outputter ?
+		     "outputter" : "write_to_rrd_database", opts->rrd_updates);
+	snprintf(res->config, sizeof(res->config), "values=%d",
+		 config.schema->num_values);
+	res->nsecs_per_op = elapsed / opts->rrd_updates;
+	res->syscalls_per_op = syscalls < 0 ?
+		-1 : (double) syscalls / opts->rrd_updates;
+
+	_free_output_result(result);
+	unlink(outfile);
+}
+
+static void _run_rrd_benchmarks(bench_options *opts)
+{
+	bench_result res;
+
+	if (opts->rrd_updates <= 0)
+		return;
+
+	_bench_rrd(&res, opts, 0);
+	_write_result(opts, &res, opts->num_results++);
+
+	_bench_rrd(&res, opts, 1);
+	_write_result(opts, &res, opts->num_results++);
+}
+
+/*
+ * Steady wind on pin 1, a rain click every 10 minutes on pin 2 and the
+ * wind vane moving between three positions.
+ */
+static void _write_argent_trace(char *trace_file)
+{
+	FILE *fd = fopen(trace_file, "w");
+
+	if (fd == NULL) {
+		fprintf(stderr, "Error opening %s: %s\n", trace_file,
+			strerror(errno));
+		exit(1);
+	}
+
+	fprintf(fd, "pulses 1 every 250000\n");
+	fprintf(fd, "pulses 2 every 600000000\n");
+	fprintf(fd, "adc 0 90 442 769\n");
+
+	if (fclose(fd) < 0) {
+		fprintf(stderr, "Error closing %s: %s\n", trace_file,
+			strerror(errno));
+		exit(1);
+	}
+}
+
+/*
+ * Runs the argent_80422 sensor on the simulated hardware backend until the
+ * wind windows and 24 hour rain totals are full and then measures the cost
+ * of computing the window statistics in each read.
+ */
+static void _run_argent_benchmarks(bench_options *opts)
+{
+	static yadl_config config;
+	char trace_file[PATH_MAX];
+	bench_result res;
+
+	snprintf(trace_file, sizeof(trace_file), "%s/yadl-bench-argent.trace",
+		 opts->tmpdir);
+	_write_argent_trace(trace_file);
+
+	memset(&config, 0, sizeof(config));
+	config.hw = &sim_hw_backend;
+	config.sens = &argent_80422_sensor_funcs;
+	config.logger = &_logger_noop;
+	config.wind_speed_pin = 1;
+	config.rain_gauge_pin = 2;
+	config.adc = get_adc("mcp3004");
+	config.spi_channel = 0;
+	config.analog_channel = 0;
+	config.adc_millivolts = 5100;
+	config.wind_speed_unit = "mph";
+	config.rain_gauge_unit = "in";
+	config.sleep_millis_between_results = 30000;
+	config.wind_windows_spec = BENCH_WIND_WINDOWS;
+	config.schema = new_sensor_schema(&config);
+
+	hw_options hw_opts;
+
+	memset(&hw_opts, 0, sizeof(hw_opts));
+	hw_opts.trace_file = trace_file;
+
+	if (config.hw->setup(&hw_opts) < 0) {
+		fprintf(stderr, "Error setting up the simulated hardware\n");
+		exit(1);
+	}
+
+	unlink(trace_file);
+
+	config.sens->init(&config);
+
+	/*
+	 * Fill the 60 minute wind window. The 24 hour one is filled along
+	 * with the rain totals.
+	 */
+	config.hw->delay(BENCH_WIND_SECS * 1000);
+
+	/* Fill the 24 hour rain totals */
+	int num_rain_samples = 86400000 / config.sleep_millis_between_results;
+
+	yadl_result *result = _new_output_result(&config);
+
+	for (int i = 0; i < num_rain_samples; i++) {
+		config.hw->delay(config.sleep_millis_between_results);
+		config.sens->read(&config, result);
+	}
+
+	/*
+	 * Move the simulated clock forward to the next result outside of the
+	 * timing so that each read starts a new rain bucket.
+	 */
+	uint64_t start_allocations = yadl_num_allocations();
+	double elapsed = 0.0;
+
+	for (int i = 0; i < NUM_ARGENT_READS; i++) {
+		config.hw->delay(config.sleep_millis_between_results);
+
+		double start = _now_nsecs();
+
+		config.sens->read(&config, result);
+		elapsed += _now_nsecs() - start;
+	}
+
+	uint64_t allocations = yadl_num_allocations() - start_allocations;
+
+	_free_output_result(result);
+
+	_init_result(&res, "argent", "read_data", NUM_ARGENT_READS);
+	snprintf(res.config, sizeof(res.config),
+		 "wind_windows=%s rain_samples=%d", BENCH_WIND_WINDOWS,
+		 config.rain_24h.size);
+	res.nsecs_per_op = elapsed / NUM_ARGENT_READS;
+	res.allocations_per_op = (double) allocations / NUM_ARGENT_READS;
+	_write_result(opts, &res, opts->num_results++);
+}
+
+static void _bench_logger(bench_result *res, bench_options *opts,
+			  int debug)
+{
+	char logfile[PATH_MAX];
+
+	snprintf(logfile, sizeof(logfile), "%s/yadl-bench.log", opts->tmpdir);
+
+	logger log = get_logger(debug, debug ? logfile : NULL);
+
+	long long start_syscalls = _get_num_syscalls();
+	double start = _now_nsecs();
+
+	for (int i = 0; i < NUM_LOGGER_CALLS; i++)
+		log("Reading #%d: %s=%.2f\n", i, "temperature", 21.5);
+
+	double elapsed = _now_nsecs() - start;
+	long long stop_syscalls = _get_num_syscalls();
+
+	if (debug)
+		close_logger(logfile);
+
+	_init_result(res, "logger", debug ? "logfile" : "noop",
+		     NUM_LOGGER_CALLS);
+	snprintf(res->config, sizeof(res->config), "debug=%d", debug);
+	res->nsecs_per_op = elapsed / NUM_LOGGER_CALLS;
+	res->syscalls_per_op = _get_syscalls_per_op(start_syscalls,
+						    stop_syscalls,
+						    NUM_LOGGER_CALLS);
+	if (debug) {
+		res->bytes_per_op = _get_bytes_per_op(logfile,
+						      NUM_LOGGER_CALLS);
+		unlink(logfile);
+	}
+}
+
+static void _run_logger_benchmarks(bench_options *opts)
+{
+	bench_result res;
+
+	_bench_logger(&res, opts, 0);
+	_write_result(opts, &res, opts->num_results++);
+
+	_bench_logger(&res, opts, 1);
+	_write_result(opts, &res, opts->num_results++);
+}
+
+static uint64_t _num_gpio_edges;
+
+static void _gpio_edge_handler(void)
+{
+	_num_gpio_edges++;
+}
+
+/*
+ * Hands mock edges through the GPIO event loop to find the cost of
+ * dispatching each edge. Only the reads and the handler calls are timed.
+ */
+static void _run_gpio_event_benchmarks(bench_options *opts)
+{
+	static uint64_t usecs[GPIO_EVENTS_PER_WRITE];
+	static gpio_events events;
+	bench_result res;
+
+	if (gpio_events_init(&events) < 0)
+		exit(1);
+
+	int source = gpio_events_add_mock(&events, &_gpio_edge_handler);
+
+	if (source < 0)
+		exit(1);
+
+	double elapsed = 0.0;
+
+	for (int i = 0; i < NUM_GPIO_EVENTS; i += GPIO_EVENTS_PER_WRITE) {
+		for (int j = 0; j < GPIO_EVENTS_PER_WRITE; j++)
+			usecs[j] = (uint64_t) (i + j) * 1000;
+
+		if (gpio_events_mock_edges(&events, source, usecs,
+					   GPIO_EVENTS_PER_WRITE) < 0) {
+			fprintf(stderr, "Error writing the mock GPIO edges: %s\n",
+				strerror(errno));
+			exit(1);
+		}
+
+		double start = _now_nsecs();
+		uint64_t stop_edges = _num_gpio_edges + GPIO_EVENTS_PER_WRITE;
+
+		while (_num_gpio_edges < stop_edges) {
+			if (gpio_events_dispatch(&events, -1) < 0) {
+				fprintf(stderr, "Error reading the mock GPIO edges: %s\n",
+					strerror(errno));
+				exit(1);
+			}
+		}
+
+		elapsed += _now_nsecs() - start;
+	}
+
+	_init_result(&res, "gpio", "dispatch", _num_gpio_edges);
+	snprintf(res.config, sizeof(res.config), "batch_size=%d",
+		 GPIO_EVENTS_BATCH_SIZE);
+	res.nsecs_per_op = elapsed / _num_gpio_edges;
+	res.syscalls_per_op = (double) atomic_load(&events.num_reads) /
+		_num_gpio_edges;
+	_write_result(opts, &res, opts->num_results++);
+}
+
+/*
+ * The DHT traces have the 30us before the response starts and then the
+ * width after each edge
+ */
+#define DHT_TRACE_WIDTHS	(DHT_NUM_EDGES + 1)
+
+typedef struct dht_waveform_tag {
+	char *name;
+	char *filename;
+	uint8_t data[5];
+} dht_waveform;
+
+static dht_waveform _dht_waveforms[] = {
+	{ "dht11", "examples/traces/dht11.trace",
+	  { 0x26, 0x00, 0x16, 0x00, 0x3c } },
+	{ "dht22", "examples/traces/dht22.trace",
+	  { 0x02, 0x29, 0x00, 0xc9, 0xf4 } },
+	{ NULL }
+};
+
+/*
+ * Decodes the recorded DHT waveforms. This also checks the decoder since
+ * the run stops if the bytes do not match what the sensor sent.
+ */
+static void _run_dht_benchmarks(bench_options *opts)
+{
+	unsigned int widths[DHT_TRACE_WIDTHS];
+	uint64_t edge_usecs[DHT_NUM_EDGES];
+	uint8_t data[5];
+	bench_result res;
+
+	for (dht_waveform *wave = _dht_waveforms; wave->name != NULL;
+	     wave++) {
+		if (trace_load_pin_widths(wave->filename, widths,
+					  DHT_TRACE_WIDTHS) !=
+		    DHT_TRACE_WIDTHS) {
+			fprintf(stderr, "%s: Expected %d widths in %s\n",
+				wave->name, DHT_TRACE_WIDTHS, wave->filename);
+			exit(1);
+		}
+
+		edge_usecs[0] = widths[0];
+		for (int i = 1; i < DHT_NUM_EDGES; i++)
+			edge_usecs[i] = edge_usecs[i - 1] + widths[i];
+
+		int num_bits = 0;
+		double start = _now_nsecs();
+
+		for (int i = 0; i < NUM_DHT_DECODES; i++)
+			num_bits += dht_decode(edge_usecs, DHT_NUM_EDGES,
+					       data);
+
+		double elapsed = _now_nsecs() - start;
+
+		if (num_bits != NUM_DHT_DECODES * DHT_NUM_BITS ||
+		    memcmp(data, wave->data, sizeof(data)) != 0 ||
+		    !dht_checksum_ok(data)) {
+			fprintf(stderr, "%s: Decoded 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x from the recorded waveform\n",
+				wave->name, data[0], data[1], data[2],
+				data[3], data[4]);
+			exit(1);
+		}
+
+		_init_result(&res, "dht", wave->name, NUM_DHT_DECODES);
+		snprintf(res.config, sizeof(res.config), "num_edges=%d",
+			 DHT_NUM_EDGES);
+		res.nsecs_per_op = elapsed / NUM_DHT_DECODES;
+		_write_result(opts, &res, opts->num_results++);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	static struct option long_options[] = {
+		{"format", required_argument, 0, 0 },
+		{"outfile", required_argument, 0, 0 },
+		{"tmpdir", required_argument, 0, 0 },
+		{"rrd_updates", required_argument, 0, 0 },
+		{0, 0, 0, 0 }
+	};
+
+	bench_options opts;
+	char *outfile = NULL;
+
+	opts.format = "text";
+	opts.fd = stdout;
+	opts.tmpdir = "/tmp";
+	opts.rrd_updates = 3;
+	opts.num_results = 0;
+
+	while (1) {
+		int option_index = 0;
+		int c = getopt_long_only(argc, argv, "", long_options,
+					 &option_index);
+
+		if (c == -1)
+			break;
+		else if (c != 0)
+			usage();
+
+		switch (option_index) {
+		case 0:
+			opts.format = optarg;
+			break;
+		case 1:
+			outfile = optarg;
+			break;
+		case 2:
+			opts.tmpdir = optarg;
+			break;
+		case 3:
+			opts.rrd_updates = strtol(optarg, NULL, 10);
+			break;
+		default:
+			usage();
+		}
+	}
+
+	if (optind < argc)
+		usage();
+
+	if (strcmp(opts.format, "text") != 0 &&
+	    strcmp(opts.format, "csv") != 0 &&
+	    strcmp(opts.format, "json") != 0) {
+		fprintf(stderr, "Invalid --format %s\n", opts.format);
+		usage();
+	}
+
+	if (outfile != NULL) {
+		opts.fd = fopen(outfile, "w");
+		if (opts.fd == NULL) {
+			fprintf(stderr, "Error opening %s: %s\n", outfile,
+				strerror(errno));
+			exit(1);
+		}
+	}
+
+	if (strcmp(opts.format, "json") == 0)
+		fprintf(opts.fd, "{ \"result\": [\n");
+
+	_run_filter_benchmarks(&opts);
+	_run_outputter_benchmarks(&opts);
+	_run_rrd_benchmarks(&opts);
+	_run_logger_benchmarks(&opts);
+	_run_gpio_event_benchmarks(&opts);
+	_run_dht_benchmarks(&opts);
+
+	/* This is last since the wind thread keeps running afterwards */
+	_run_argent_benchmarks(&opts);
+
+	if (strcmp(opts.format, "json") == 0)
+		fprintf(opts.fd, "\n] }\n");
+
+	if (outfile != NULL && fclose(opts.fd) < 0) {
+		fprintf(stderr, "Error closing %s: %s\n", outfile,
+			strerror(errno));
+		exit(1);
+	}
+
+	/* The simulated wind thread never exits */
+	exit(0);
+}
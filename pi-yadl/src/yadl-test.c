@@ -0,0 +1,259 @@
+/*
+ * yadl-test.c - Checks the decoders against the recorded traces and the
+ *                GPIO event loop against the mock event sources.
+ *
+ * Copyright (C) 2016-2017 Brian Masney <masneyb@onstation.org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "dht_decoder.h"
+#include "gpio_events.h"
+#include "trace_widths.h"
+
+/*
+ * The DHT traces have the 30us before the response starts and then the
+ * width after each edge
+ */
+#define DHT_TRACE_WIDTHS	(DHT_NUM_EDGES + 1)
+
+/* The index of the high width of a bit in a DHT trace */
+#define DHT_BIT_HIGH_WIDTH(bit)	(4 + (bit) * 2)
+
+typedef struct dht_trace_tag {
+	char *filename;
+	uint8_t data[5];
+} dht_trace;
+
+static dht_trace _dht_traces[] = {
+	{ "examples/traces/dht11.trace", { 0x26, 0x00, 0x16, 0x00, 0x3c } },
+	{ "examples/traces/dht22.trace", { 0x02, 0x29, 0x00, 0xc9, 0xf4 } },
+	{ NULL }
+};
+
+static int _num_failed;
+
+static void _check(int ok, char *name, char *what)
+{
+	printf("%s: %s: %s\n", ok ? "PASS" : "FAIL", name, what);
+	if (!ok)
+		_num_failed++;
+}
+
+/*
+ * Converts the widths into the times of the edges that the DHT driver
+ * captures, starting with the falling edge at the start of the response.
+ * The edge at skip_edge is left out when it is not -1.
+ */
+static int _dht_edges(unsigned int *widths, int num_widths,
+		      uint64_t *edge_usecs, int skip_edge)
+{
+	uint64_t usecs = 0;
+	int num_edges = 0;
+
+	for (int i = 0; i < num_widths && num_edges < DHT_NUM_EDGES; i++) {
+		usecs += widths[i];
+		if (i != skip_edge)
+			edge_usecs[num_edges++] = usecs;
+	}
+
+	return num_edges;
+}
+
+static void _test_dht_trace(dht_trace *trace)
+{
+	unsigned int widths[DHT_TRACE_WIDTHS];
+	uint64_t edge_usecs[DHT_NUM_EDGES];
+	uint8_t data[5];
+	char *name = trace->filename;
+
+	int num_widths = trace_load_pin_widths(trace->filename, widths,
+					       DHT_TRACE_WIDTHS);
+
+	_check(num_widths == DHT_TRACE_WIDTHS, name, "has a width per edge");
+	if (num_widths != DHT_TRACE_WIDTHS)
+		return;
+
+	int num_edges = _dht_edges(widths, num_widths, edge_usecs, -1);
+	int num_bits = dht_decode(edge_usecs, num_edges, data);
+
+	_check(num_bits == DHT_NUM_BITS, name, "decodes every bit");
+	_check(memcmp(data, trace->data, sizeof(data)) == 0, name,
+	       "decodes the bytes that the sensor sent");
+	_check(dht_checksum_ok(data), name, "has a valid checksum");
+
+	/* Turn the first bit of the humidity into the other value */
+	unsigned int saved = widths[DHT_BIT_HIGH_WIDTH(0)];
+
+	widths[DHT_BIT_HIGH_WIDTH(0)] = saved > DHT_BIT_ONE_USECS ? 27 : 70;
+	num_edges = _dht_edges(widths, num_widths, edge_usecs, -1);
+	num_bits = dht_decode(edge_usecs, num_edges, data);
+	widths[DHT_BIT_HIGH_WIDTH(0)] = saved;
+
+	_check(num_bits == DHT_NUM_BITS && !dht_checksum_ok(data), name,
+	       "fails the checksum when a bit is flipped");
+
+	/* The response stops partway through the third byte */
+	num_edges = _dht_edges(widths, num_widths, edge_usecs, -1) - 30;
+	num_bits = dht_decode(edge_usecs, num_edges, data);
+
+	_check(num_bits == DHT_NUM_BITS - 15, name,
+	       "only decodes the bits of a truncated waveform");
+
+	/*
+	 * Lose the rising edge in the middle of the tenth bit. Only the
+	 * edges up to the end of the last bit are captured.
+	 */
+	int missing_edge = DHT_BIT_HIGH_WIDTH(9) - 1;
+
+	num_edges = _dht_edges(widths, DHT_NUM_EDGES, edge_usecs,
+			       missing_edge);
+	num_bits = dht_decode(edge_usecs, num_edges, data);
+
+	_check(num_bits == DHT_NUM_BITS - 1, name,
+	       "does not decode every bit when an edge is missing");
+
+	/*
+	 * The edge where the sensor releases the line at the end fills
+	 * the gap, so every bit is decoded but the checksum catches it.
+	 */
+	num_edges = _dht_edges(widths, num_widths, edge_usecs, missing_edge);
+	num_bits = dht_decode(edge_usecs, num_edges, data);
+
+	_check(num_bits == DHT_NUM_BITS && !dht_checksum_ok(data), name,
+	       "fails the checksum when the release edge fills the gap");
+}
+
+/*
+ * The first source gets more edges than are read at once, with a gap in
+ * the sequence numbers in the second batch.
+ */
+#define GPIO_TEST_EDGES_BEFORE_GAP	20
+#define GPIO_TEST_DROPPED		3
+#define GPIO_TEST_EDGES_AFTER_GAP	5
+#define GPIO_TEST_EDGES_PER_SOURCE	\
+	(GPIO_TEST_EDGES_BEFORE_GAP + GPIO_TEST_EDGES_AFTER_GAP)
+
+typedef struct gpio_test_source_tag {
+	uint64_t usecs[GPIO_TEST_EDGES_PER_SOURCE];
+	int num_handled;
+	int in_order;
+	int levels_ok;
+} gpio_test_source;
+
+static gpio_test_source _gpio_test_sources[2];
+
+static void _gpio_test_handle(gpio_test_source *src)
+{
+	if (src->num_handled >= GPIO_TEST_EDGES_PER_SOURCE ||
+	    gpio_events_usecs() != src->usecs[src->num_handled])
+		src->in_order = 0;
+	if (gpio_events_level() != 1)
+		src->levels_ok = 0;
+	src->num_handled++;
+}
+
+static void _gpio_test_handler0(void)
+{
+	_gpio_test_handle(&_gpio_test_sources[0]);
+}
+
+static void _gpio_test_handler1(void)
+{
+	_gpio_test_handle(&_gpio_test_sources[1]);
+}
+
+static void _test_gpio_events(void)
+{
+	static gpio_events events;
+	void (*handlers[])(void) = { &_gpio_test_handler0,
+				     &_gpio_test_handler1 };
+	char *name = "gpio_events";
+	int num_sources = sizeof(handlers) / sizeof(handlers[0]);
+	int sources[2];
+
+	if (gpio_events_init(&events) < 0) {
+		_check(0, name, "creates the event loop");
+		return;
+	}
+
+	for (int i = 0; i < num_sources; i++) {
+		gpio_test_source *src = &_gpio_test_sources[i];
+
+		sources[i] = gpio_events_add_mock(&events, handlers[i]);
+		if (sources[i] < 0) {
+			_check(0, name, "adds a mock source");
+			return;
+		}
+
+		for (int j = 0; j < GPIO_TEST_EDGES_PER_SOURCE; j++)
+			src->usecs[j] = 1000000 * (i + 1) + j * 100;
+		src->num_handled = 0;
+		src->in_order = 1;
+		src->levels_ok = 1;
+	}
+
+	gpio_test_source *src0 = &_gpio_test_sources[0];
+	gpio_test_source *src1 = &_gpio_test_sources[1];
+
+	gpio_events_mock_edges(&events, sources[0], src0->usecs,
+			       GPIO_TEST_EDGES_BEFORE_GAP);
+	gpio_events_mock_drop(&events, sources[0], GPIO_TEST_DROPPED);
+	gpio_events_mock_edges(&events, sources[0],
+			       &src0->usecs[GPIO_TEST_EDGES_BEFORE_GAP],
+			       GPIO_TEST_EDGES_AFTER_GAP);
+	gpio_events_mock_edges(&events, sources[1], src1->usecs,
+			       GPIO_TEST_EDGES_PER_SOURCE);
+
+	int num_handled = 0;
+	int ret;
+
+	while (num_handled < GPIO_TEST_EDGES_PER_SOURCE * num_sources &&
+	       (ret = gpio_events_dispatch(&events, 1000)) > 0)
+		num_handled += ret;
+
+	_check(num_handled == GPIO_TEST_EDGES_PER_SOURCE * num_sources, name,
+	       "calls a handler for each edge");
+	_check(src0->num_handled == GPIO_TEST_EDGES_PER_SOURCE &&
+	       src1->num_handled == GPIO_TEST_EDGES_PER_SOURCE, name,
+	       "calls the handler of the source that the edge came from");
+	_check(src0->in_order && src1->in_order, name,
+	       "calls the handlers in order with the time of each edge");
+	_check(src0->levels_ok && src1->levels_ok, name,
+	       "reports the level after a rising edge");
+	_check(atomic_load(&events.num_dropped) == GPIO_TEST_DROPPED, name,
+	       "counts the gap in the sequence numbers as dropped");
+	_check(atomic_load(&events.num_events) ==
+	       (uint64_t) GPIO_TEST_EDGES_PER_SOURCE * num_sources, name,
+	       "counts the events that were handled");
+}
+
+int main(void)
+{
+	for (dht_trace *trace = _dht_traces; trace->filename != NULL; trace++)
+		_test_dht_trace(trace);
+
+	_test_gpio_events();
+
+	if (_num_failed > 0) {
+		printf("%d checks failed\n", _num_failed);
+		return 1;
+	}
+
+	return 0;
+}
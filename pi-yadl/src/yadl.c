@@ -19,7 +19,6 @@
  * 02110-1301, USA.
  */
 
-#include <wiringPi.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
@@ -27,9 +26,14 @@
 #include <errno.h>
 #include <getopt.h>
 #include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
 #include <unistd.h>
 #include <sys/types.h>
 #include "yadl.h"
+#include "output_queue.h"
+#include "schedule.h"
 
 #define DEFAULT_SLEEP_MILLIS_BETWEEN_RETRIES 500
 #define DEFAULT_SLEEP_MILLIS_BETWEEN_SAMPLES 0
@@ -40,21 +44,28 @@
 #define DEFAULT_REMOVE_N_SAMPLES_FROM_ENDS  0
 #define DEFAULT_COUNTER_MULTIPLIER          1.0
 #define DEFAULT_INTERRUPT_EDGE              "rising"
+#define DEFAULT_COUNTER_MODE                "count"
+#define DEFAULT_W1_DEVICES_DIR              "/sys/bus/w1/devices"
 #define DEFAULT_ADC_MILLIVOLTS              3300
 #define DEFAULT_ADC_MULTIPLIER              1.0
 #define DEFAULT_ANALOG_SCALING_FACTOR       500
+#define DEFAULT_STATS_INTERVAL_SECS         60
+#define DEFAULT_OUTPUT_QUEUE_SIZE           64
+#define DEFAULT_STATE_MAX_AGE_SECS          900
 
 void usage(void)
 {
-	printf("usage: yadl --sensor <digital|counter|analog|dht11|dht22|ds18b20|tmp36|bmp180|bme280|argent_80422>\n");
+	printf("usage: yadl --sensor <digital|counter|analog|dht11|dht22|dht11_iio|dht22_iio|ds18b20|tmp36|bmp180|bme280|argent_80422>\n");
 	printf("\t--output <json|yaml|csv|xml|rrd|single_json> [ --output <...> ]\n");
 	printf("\t[ --outfile <optional output filename. Defaults to stdout> [ --outfile <...> ] ]\n");
 	printf("\t[ --only_log_value_changes ]\n");
 	printf("\t[ --num_results <# results returned (default %d). Set to -1 to poll indefinitely.> ]\n", DEFAULT_NUM_RESULTS);
 	printf("\t[ --sleep_millis_between_results <milliseconds (default %d)> ]\n", DEFAULT_SLEEP_MILLIS_BETWEEN_RESULTS);
+	printf("\t[ --align_results ]\n");
+	printf("\t[ --missed_results <skip|catch_up (default skip)> ]\n");
 	printf("\t[ --num_samples_per_result <# samples (default %d). See --filter for aggregation.> ]\n", DEFAULT_NUM_SAMPLES_PER_RESULT);
 	printf("\t[ --sleep_millis_between_samples <milliseconds (default %d)> ]\n", DEFAULT_SLEEP_MILLIS_BETWEEN_SAMPLES);
-	printf("\t[ --filter <median|mean|mode|sum|min|max|range (default median)> ]\n");
+	printf("\t[ --filter <median|median_approx|mean|mode|sum|min|max|range (default median)> ]\n");
 	printf("\t[ --remove_n_samples_from_ends <# samples (default %d)> ]\n",
 	       DEFAULT_REMOVE_N_SAMPLES_FROM_ENDS);
 	printf("\t[ --max_retries <# retries (default %d)> ]\n",
@@ -63,17 +74,81 @@ void usage(void)
 	printf("\t[ --debug ]\n");
 	printf("\t[ --logfile <path to debug logs. Uses stderr if not specified.> ]\n");
 	printf("\t[ --daemon ]\n");
+	printf("\t[ --name <label for this sensor in the logs (default sensor type)> ]\n");
+	printf("\t[ --instances_file <file with the arguments for one sensor per line> ]\n");
+	printf("\t[ --hw_backend <wiringpi|gpiochip|sim (default wiringpi)> ]\n");
+	printf("\t[ --hw_trace <trace file to replay with --hw_backend sim> ]\n");
+	printf("\t[ --gpio_chip <device for --hw_backend gpiochip (default %s)> ]\n",
+	       DEFAULT_GPIO_CHIP);
+	printf("\t[ --gpio_debounce_usecs <kernel debounce for --hw_backend gpiochip (default 0)> ]\n");
+	printf("\t[ --stats_file <path to the latency and error stats. Rewritten periodically.> ]\n");
+	printf("\t[ --stats_interval_secs <seconds between stats file updates (default %d)> ]\n",
+	       DEFAULT_STATS_INTERVAL_SECS);
+	printf("\t[ --async_output ]\n");
+	printf("\t[ --output_queue_size <results waiting for --async_output (default %d)> ]\n",
+	       DEFAULT_OUTPUT_QUEUE_SIZE);
+	printf("\t[ --output_backpressure <block|drop_oldest|coalesce (default block)> ]\n");
+	printf("\n");
+	printf("\tWith --instances_file, a single process reads all of the sensors listed\n");
+	printf("\tin the file, each on its own schedule with its own filter and outputs.\n");
+	printf("\tOnly --debug, --logfile, --daemon, --hw_backend, --hw_trace,\n");
+	printf("\t--gpio_chip, --gpio_debounce_usecs, the --stats options and the\n");
+	printf("\toutput queue options may be given on the command line.\n");
+	printf("\tUse --num_results -1 on each line to read the sensors forever.\n");
+	printf("\n");
+	printf("\tThe stats file has the counters and latency histograms for reading,\n");
+	printf("\tfiltering and writing each sensor's results. Send SIGUSR1 to write it\n");
+	printf("\timmediately. The stats are written to stderr on SIGUSR1 when there\n");
+	printf("\tis no --stats_file. i2c_transactions counts the I2C transactions\n");
+	printf("\tthat each sensor's reads made on the bus.\n");
+	printf("\n");
+	printf("\tThe results start every --sleep_millis_between_results milliseconds\n");
+	printf("\tno matter how long reading the sensor takes. --align_results starts\n");
+	printf("\tthem on a multiple of that interval on the wall clock, such as :00 and\n");
+	printf("\t:30 past the minute for 30000. When a result takes longer than the\n");
+	printf("\tinterval, skip waits for the next deadline and catch_up takes the\n");
+	printf("\tmissed results back to back. Both are counted in the stats.\n");
+	printf("\n");
+	printf("\tWith --async_output, the results are written by a separate thread so\n");
+	printf("\tthat slow outputs do not delay the readings. When the queue is full,\n");
+	printf("\tblock waits for the output thread, drop_oldest discards the oldest\n");
+	printf("\tqueued result and coalesce also only writes the latest queued result\n");
+	printf("\tfor each sensor.\n");
+	printf("\n");
+	printf("\tThe gpiochip backend reads the interrupt pins as line events from the\n");
+	printf("\tGPIO character device instead of with wiringPiISR(). The kernel\n");
+	printf("\ttimestamps each edge so the pulses are timed without the scheduling\n");
+	printf("\tdelay, and one thread handles the edges of all of the pins.\n");
 	printf("\n");
 	printf("Sensor Specific Options\n");
 	printf("\n");
 	printf("* digital - Reads from a digital pin\n");
 	printf("\t--gpio_pin <wiringPi pin #. See http://wiringpi.com/pins/>\n");
+	printf("\t[ --edge_triggered ]\n");
+	printf("\t[ --debounce_usecs <ignore changes this soon after the last one (default 0)> ]\n");
+	printf("\t[ --max_changes_per_sec <results per second with --edge_triggered (default unlimited)> ]\n");
+	printf("\n");
+	printf("\tWith --edge_triggered, the pin is not polled. A result is written each\n");
+	printf("\ttime its level changes, and nothing runs while it stays the same. The\n");
+	printf("\ttimestamp and timestamp_usecs are when the change happened. When the\n");
+	printf("\tchanges come faster than --max_changes_per_sec, the waiting changes\n");
+	printf("\tare merged into one result with the latest level, and num_changes\n");
+	printf("\thas the number of changes that it covers. There is one result per\n");
+	printf("\tchange for --num_results, and --sleep_millis_between_results is not\n");
+	printf("\tused.\n");
 	printf("\n");
 	printf("* counter - Counts the number of times the digital pin state changes.\n");
 	printf("\t--gpio_pin <wiringPi pin #. See http://wiringpi.com/pins/>\n");
 	printf("\t[ --counter_multiplier <multiplier to convert the requests per second to some other value. (default %.1f)> ]\n", DEFAULT_COUNTER_MULTIPLIER);
 	printf("\t[ --interrupt_edge <rising|falling|both (default %s)> ]\n",
 	       DEFAULT_INTERRUPT_EDGE);
+	printf("\t[ --counter_mode <count|period (default %s)> ]\n",
+	       DEFAULT_COUNTER_MODE);
+	printf("\n");
+	printf("\tcount divides the edges by the time between results. period uses\n");
+	printf("\tthe time between the edges instead, which is more accurate for slow\n");
+	printf("\tsignals that only have a few edges per result. Each counter in an\n");
+	printf("\t--instances_file can count a different pin, up to 8 pins.\n");
 	printf("\n");
 	printf("* analog\n");
 	printf("\t--adc <see ADC options below>\n");
@@ -81,11 +156,37 @@ void usage(void)
 	printf("* dht11 / dht22 - Temperature and Humidity sensors\n");
 	printf("\t--gpio_pin <wiringPi pin #. See http://wiringpi.com/pins/>\n");
 	printf("\t--temperature_unit <celsius|fahrenheit|kelvin|rankine>\n");
+	printf("\t[ --realtime_priority <SCHED_FIFO priority 1-99 for each read (default off)> ]\n");
+	printf("\n");
+	printf("\tThe time of each edge of the response is recorded and the bits are\n");
+	printf("\tdecoded from how long the line was high. --realtime_priority keeps\n");
+	printf("\tother processes from running in the middle of a read and locks the\n");
+	printf("\tprocess's memory for the read. It needs to run as root.\n");
+	printf("\n");
+	printf("* dht11_iio / dht22_iio - DHT11 / DHT22 through the dht11 kernel driver\n");
+	printf("\t--temperature_unit <celsius|fahrenheit|kelvin|rankine>\n");
+	printf("\t[ --iio_device <IIO device. Defaults to the first %s/iio:device* from the dht11 driver> ]\n",
+	       "/sys/bus/iio/devices");
+	printf("\n");
+	printf("\tThe kernel does the timing critical part of the read so this does\n");
+	printf("\tnot need to run as root. You need 'dtoverlay=dht11,gpiopin=<BCM pin #>'\n");
+	printf("\tin your /boot/config.txt. Failed reads are retried up to --max_retries\n");
+	printf("\ttimes.\n");
 	printf("\n");
 	printf("* ds18b20 - Temperature sensor that uses the Dallas 1-Wire protocol.\n");
-	printf("\t--w1_slave <w1 slave device. See /sys/bus/w1/devices/28-*/w1_slave>\n");
+	printf("\t[ --w1_slave <w1 slave device. See /sys/bus/w1/devices/28-*/w1_slave> ]\n");
+	printf("\t[ --w1_devices_dir <w1 devices directory (default %s)> ]\n",
+	       DEFAULT_W1_DEVICES_DIR);
 	printf("\t--temperature_unit <celsius|fahrenheit|kelvin|rankine>\n");
 	printf("\n");
+	printf("\t--w1_slave can be repeated to read several probes. All of the 28-*\n");
+	printf("\tprobes in --w1_devices_dir are read when it is not specified. With\n");
+	printf("\tmore than one probe, the values are named temperature_1 through\n");
+	printf("\ttemperature_N in that order. The conversion is started on all of the\n");
+	printf("\tprobes at once through each bus master's therm_bulk_read. A probe\n");
+	printf("\tthat can't be read is read again on its own up to --max_retries\n");
+	printf("\ttimes before the whole result is retried.\n");
+	printf("\n");
 	printf("\tYou need to have the w1-gpio and w1-therm kernel modules loaded.\n");
 	printf("\tYou'll also need to have 'dtoverlay=w1-gpio' in your /boot/config.txt\n");
 	printf("\tand reboot if it was not already present.\n");
@@ -110,6 +211,31 @@ void usage(void)
 	printf("\t--rain_gauage_pin <wiringPi pin #.>\n");
 	printf("\t--rain_gauage_unit <in|mm>\n");
 	printf("\t--adc <see ADC options below. This is for the wind vane.>\n");
+	printf("\t[ --wind_vane_calibration <file with the measured millivolts for each direction> ]\n");
+	printf("\t[ --wind_windows <comma separated window lengths (default %s)> ]\n",
+	       DEFAULT_WIND_WINDOWS);
+	printf("\t[ --state_file <path to the saved wind and rain history> ]\n");
+	printf("\t[ --state_max_age_secs <seconds (default %d)> ]\n",
+	       DEFAULT_STATE_MAX_AGE_SECS);
+	printf("\n");
+	printf("\tThe wind vane voltages default to the resistor values in the data\n");
+	printf("\tsheet with a 10K pull up resistor at 5V. Each line of the calibration\n");
+	printf("\tfile has the direction in degrees and the millivolts that the ADC sees,\n");
+	printf("\tsuch as '315 4330'. Readings that fall between two directions are\n");
+	printf("\tcounted in wind_dir_unstable and the last stable direction is used.\n");
+	printf("\n");
+	printf("\tThe average, gust and direction spread are logged for each of the\n");
+	printf("\t--wind_windows, such as 3s,2m,10m,60m,24h. Windows up to 10 minutes\n");
+	printf("\tuse every one second sample. Longer windows must be whole minutes\n");
+	printf("\tand are kept as one minute summaries. Up to %d windows can be given.\n",
+	       WIND_MAX_WINDOWS);
+	printf("\tEach window has its own values, so an existing RRD database needs\n");
+	printf("\tto be created again with the new values when the windows change.\n");
+	printf("\n");
+	printf("\tThe wind windows, rain totals and rain since midnight are kept in\n");
+	printf("\tthe memory mapped --state_file and are loaded again at startup if\n");
+	printf("\tthey were saved within the last --state_max_age_secs. The file is\n");
+	printf("\tstarted over when the --wind_windows or the result interval change.\n");
 	printf("\n");
 	printf("ADC Options and Supported Types\n");
 	printf("\t[ --adc_millivolts <value (default %d)> ]\n",
@@ -150,6 +276,10 @@ void usage(void)
 	printf("  3,1465685846,96.0,309.0\n");
 	printf("  4,1465685848,96.0,309.0\n");
 	printf("\n");
+	printf("* Read all of the sensors listed in a file from a single process. See\n");
+	printf("  examples/multiple_sensors.txt for an example file.\n");
+	printf("  $ sudo yadl --instances_file /etc/yadl-sensors.conf --daemon\n");
+	printf("\n");
 	printf("* See the files in the examples/ directory for more examples.\n");
 	printf("\n");
 	printf("* See systemd/pi-yadl-gatherer.service for an example writing the data to\n");
@@ -159,37 +289,33 @@ void usage(void)
 	exit(1);
 }
 
-int get_num_values(yadl_config *config)
+/* The sample is read into config->sample */
+static int _perform_reading(yadl_config *config)
 {
-	char **header_names = config->sens->get_value_header_names(config);
-	int i = 0;
+	yadl_stats *stats = config->stats;
+	uint64_t start_usecs = stats_now_usecs();
+	uint64_t start_i2c_transactions = hw_i2c_transactions;
 
-	for (; header_names[i] != NULL; i++)
-		;
-	return i;
-}
+	int success = 0;
 
-static void _free_result(yadl_result *result)
-{
-	free(result->value);
-	if (result->unit != NULL)
-		free(result->unit);
-	free(result);
-}
+	for (int i = 0; i < config->max_retries; i++) {
+		if (i > 0) {
+			stats->retries++;
+			if (config->sleep_millis_between_retries > 0)
+				config->hw->delay(config->sleep_millis_between_retries);
+		}
 
-static yadl_result *_perform_reading(yadl_config *config)
-{
-	yadl_result *result;
+		uint64_t read_start_usecs = stats_now_usecs();
 
-	int success = 0;
+		int ret = config->sens->read(config, &config->sample);
 
-	for (int i = 0; i < config->max_retries; i++) {
-		if (i > 0 && config->sleep_millis_between_retries > 0)
-			delay(config->sleep_millis_between_retries);
+		histogram_record(&stats->read,
+				 stats_now_usecs() - read_start_usecs);
+		stats->reads++;
 
-		result = config->sens->read(config);
-		if (result == NULL) {
+		if (ret < 0) {
 			/* bad reading */
+			stats->failed_reads++;
 			continue;
 		}
 
@@ -197,135 +323,112 @@ static yadl_result *_perform_reading(yadl_config *config)
 		break;
 	}
 
+	histogram_record(&stats->read_with_retries,
+			 stats_now_usecs() - start_usecs);
+	stats->i2c_transactions += hw_i2c_transactions -
+		start_i2c_transactions;
+
 	if (!success) {
 		fprintf(stderr, "Error: Reached maximum retries.\n");
-		exit(1);
+		return -1;
 	}
 
-	return result;
-}
-
-static float_node *_add_sample_to_sorted_list(float value, float_node *list)
-{
-	float_node *newnode = malloc(sizeof(*newnode));
-
-	newnode->value = value;
-	newnode->next = NULL;
-
-	if (list == NULL)
-		return newnode;
-
-	/* Add to head of list */
-	if (list->value > value) {
-		newnode->next = list;
-		return newnode;
-	}
-
-	float_node *lastnode = list;
-
-	/* Add to middle of list */
-	for (float_node *cur = list->next; cur != NULL; cur = cur->next) {
-		if (cur->value > value) {
-			newnode->next = cur;
-			lastnode->next = newnode;
-			return list;
-		}
-		lastnode = cur;
-	}
-
-	/* Add to end of list */
-	lastnode->next = newnode;
-	return list;
+	return 0;
 }
 
-static void _dump_list(char *description, float_node *list, yadl_config *config)
+static void _dump_values(char *description, float *values, int len,
+			 yadl_config *config)
 {
-	config->logger("%s: Sorted values are:", description);
-	for (float_node *val = list; val != NULL; val = val->next)
-		config->logger(" %.2f", val->value);
+	config->logger("%s: Values are:", description);
+	for (int i = 0; i < len; i++)
+		config->logger(" %.2f", values[i]);
 	config->logger("\n");
 }
 
-static float_node *_remove_outliers(float_node *list, yadl_config *config)
+/*
+ * The returned result is allocated from config->cycle_arena and is only
+ * valid until the next call.
+ */
+static yadl_result *_perform_all_readings(yadl_config *config)
 {
-	if (config->remove_n_samples_from_ends <= 0)
-		return list;
-
-	float_node *last_node_on_head_of_list = NULL;
-	float_node *cur = list;
+	sensor_schema *schema = config->schema;
+	int num_values = schema->num_values;
+	int num_units = schema->num_units;
+	yadl_result *sample = &config->sample;
 
-	for (int i = 0;
-	     i < config->num_samples_per_result - config->remove_n_samples_from_ends - 1;
-	     i++) {
-		if (i == (config->remove_n_samples_from_ends - 1))
-			last_node_on_head_of_list = cur;
-		cur = cur->next;
-	}
+	arena_reset(&config->cycle_arena);
 
-	/* Chop off the end of the list */
-	free_list(cur->next);
-	cur->next = NULL;
+	yadl_result *result = arena_alloc(&config->cycle_arena,
+					  sizeof(*result));
 
-	/* Chop off the head of the list */
-	float_node *new_head_of_list = last_node_on_head_of_list->next;
+	result->value = arena_alloc(&config->cycle_arena,
+				    sizeof(float) * num_values);
+	result->unit = num_units == 0 ? NULL :
+		arena_alloc(&config->cycle_arena, sizeof(char *) * num_units);
 
-	last_node_on_head_of_list->next = NULL;
-	free_list(list);
-
-	return new_head_of_list;
-}
-
-static yadl_result *_perform_all_readings(yadl_config *config)
-{
-	float_node **value_list;
-
-	char **header_names = config->sens->get_value_header_names(config);
-	int num_values = get_num_values(config);
-
-	value_list = calloc(num_values, sizeof(float *));
+	if (config->samples == NULL) {
+		for (int num = 0; num < num_values; num++)
+			config->filter_func->init(&config->filter_states[num]);
+	}
 
-	char **unit_values = NULL;
+	sample->timestamp = 0;
 
 	for (int i = 0; i < config->num_samples_per_result; i++) {
 		if (i > 0 && config->sleep_millis_between_samples > 0)
-			delay(config->sleep_millis_between_samples);
+			config->hw->delay(config->sleep_millis_between_samples);
 
-		yadl_result *sample = _perform_reading(config);
+		if (_perform_reading(config) < 0)
+			return NULL;
 
 		/* Save the units for the returned result */
-		if (i == 0 && sample->unit != NULL) {
-			unit_values = sample->unit;
-			sample->unit = NULL;
+		if (i == 0) {
+			for (int num = 0; num < num_units; num++)
+				result->unit[num] = sample->unit[num];
 		}
 
 		config->logger("Sample #%d", i);
 		for (int num = 0; num < num_values; num++) {
-			config->logger(", %s=%.2f", header_names[num],
+			config->logger(", %s=%.2f", schema->values[num].name,
 				       sample->value[num]);
-			value_list[num] = _add_sample_to_sorted_list(sample->value[num],
-								     value_list[num]);
+
+			if (config->samples == NULL)
+				config->filter_func->push(&config->filter_states[num],
+							  sample->value[num]);
+			else
+				config->samples[num * config->num_samples_per_result + i] =
+					sample->value[num];
 		}
 		config->logger("\n");
-
-		_free_result(sample);
 	}
 
+	uint64_t filter_start_usecs = stats_now_usecs();
+
 	for (int num = 0; num < num_values; num++) {
-		_dump_list(header_names[num], value_list[num], config);
-		value_list[num] = _remove_outliers(value_list[num], config);
-		_dump_list("Values(after removing outliers)", value_list[num],
-			   config);
-	}
+		if (config->samples == NULL) {
+			result->value[num] = config->filter_func->finalize(&config->filter_states[num]);
+			continue;
+		}
 
-	yadl_result *result = malloc(sizeof(*result));
+		float *values = &config->samples[num * config->num_samples_per_result];
 
-	result->unit = unit_values;
-	result->value = malloc(sizeof(float) * num_values);
-	for (int num = 0; num < num_values; num++) {
-		result->value[num] = config->filter_func(value_list[num]);
-		free_list(value_list[num]);
+		_dump_values(schema->values[num].name, values,
+			     config->num_samples_per_result, config);
+
+		result->value[num] = filter_samples(config->filter_func, values,
+						    config->num_samples_per_result,
+						    config->remove_n_samples_from_ends);
 	}
-	free(value_list);
+
+	histogram_record(&config->stats->filter,
+			 stats_now_usecs() - filter_start_usecs);
+
+	/*
+	 * Sensors that know when the reading was taken fill this in. The
+	 * backend's clock is used so that the simulated backend's results
+	 * are stamped with the simulated time.
+	 */
+	result->timestamp = sample->timestamp != 0 ? sample->timestamp :
+		(long) (config->hw->realtime_usecs() / 1000000);
 
 	return result;
 }
@@ -371,13 +474,87 @@ static void _daemonize(yadl_config *config)
 	close(2);
 }
 
-int main(int argc, char **argv)
+typedef struct yadl_instance_tag {
+	yadl_config config;
+	char *name;
+	char *sensor_name;
+	char *adc_name;
+	char *filter_name;
+	char *temperature_unit;
+
+	char **output_types;
+	int num_output_types;
+	char **output_filenames;
+	int num_output_filenames;
+
+	outputter **output_funcs;
+	output_metadata **output_metadatas;
+
+	int reading_number;
+	int align_results;
+	schedule_missed_policy missed_policy;
+	char *missed_results;
+	schedule sched;
+} yadl_instance;
+
+/* Options that apply to the whole process instead of a single sensor */
+typedef struct yadl_options_tag {
+	int debug;
+	int daemon;
+	char *logfile;
+	char *instances_file;
+	char *hw_backend_name;
+	hw_options hw_opts;
+	char *stats_file;
+	int stats_interval_secs;
+	int async_output;
+	int output_queue_size;
+	char *output_backpressure;
+} yadl_options;
+
+static void _init_instance(yadl_instance *inst)
+{
+	memset(inst, 0, sizeof(*inst));
+	inst->config.gpio_pin = -1;
+	inst->config.spi_channel = -1;
+	inst->config.i2c_address = -1;
+	inst->config.max_retries = DEFAULT_MAX_RETRIES;
+	inst->config.sleep_millis_between_retries = DEFAULT_SLEEP_MILLIS_BETWEEN_RETRIES;
+	inst->config.sleep_millis_between_samples = DEFAULT_SLEEP_MILLIS_BETWEEN_SAMPLES;
+	inst->config.sleep_millis_between_results = DEFAULT_SLEEP_MILLIS_BETWEEN_RESULTS;
+	inst->config.analog_channel = -1;
+	inst->config.num_results = DEFAULT_NUM_RESULTS;
+	inst->config.num_samples_per_result = DEFAULT_NUM_SAMPLES_PER_RESULT;
+	inst->config.remove_n_samples_from_ends = DEFAULT_REMOVE_N_SAMPLES_FROM_ENDS;
+	inst->config.only_log_value_changes = 0;
+	inst->config.counter_multiplier = DEFAULT_COUNTER_MULTIPLIER;
+	inst->config.interrupt_edge = DEFAULT_INTERRUPT_EDGE;
+	inst->config.counter_mode = DEFAULT_COUNTER_MODE;
+	inst->config.w1_devices_dir = DEFAULT_W1_DEVICES_DIR;
+	inst->config.adc_millivolts = DEFAULT_ADC_MILLIVOLTS; /* Raspberry Pi GPIO pins are 3.3V */
+	inst->config.adc_multiplier = DEFAULT_ADC_MULTIPLIER;
+	inst->config.analog_scaling_factor = DEFAULT_ANALOG_SCALING_FACTOR;
+	inst->config.wind_speed_pin = -1;
+	inst->config.rain_gauge_pin = -1;
+	inst->config.state_max_age_secs = DEFAULT_STATE_MAX_AGE_SECS;
+}
+
+/* getopt returns this for the options that apply to the whole process */
+#define PROCESS_WIDE_OPTION	1
+
+/*
+ * Parses the arguments for a single sensor instance. opts is NULL when the
+ * arguments come from a line in the --instances_file since the process wide
+ * options are only allowed on the command line.
+ */
+static void _parse_args(int argc, char **argv, yadl_instance *inst,
+			yadl_options *opts)
 {
 	static struct option long_options[] = {
 		{"gpio_pin", required_argument, 0, 0 },
 		{"output", required_argument, 0, 0 },
 		{"sensor", required_argument, 0, 0 },
-		{"debug", no_argument, 0, 0 },
+		{"debug", no_argument, 0, PROCESS_WIDE_OPTION },
 		{"outfile", required_argument, 0, 0 },
 		{"spi_channel", required_argument, 0, 0 },
 		{"adc", required_argument, 0, 0 },
@@ -393,8 +570,8 @@ int main(int argc, char **argv)
 		{"i2c_address", required_argument, 0, 0 },
 		{"only_log_value_changes", no_argument, 0, 0 },
 		{"counter_multiplier", required_argument, 0, 0 },
-		{"logfile", required_argument, 0, 0 },
-		{"daemon", no_argument, 0, 0 },
+		{"logfile", required_argument, 0, PROCESS_WIDE_OPTION },
+		{"daemon", no_argument, 0, PROCESS_WIDE_OPTION },
 		{"interrupt_edge", required_argument, 0, 0 },
 		{"adc_millivolts", required_argument, 0, 0 },
 		{"temperature_unit", required_argument, 0, 0 },
@@ -405,152 +582,226 @@ int main(int argc, char **argv)
 		{"wind_speed_unit", required_argument, 0, 0 },
 		{"rain_gauge_unit", required_argument, 0, 0 },
 		{"adc_multiplier", required_argument, 0, 0 },
+		{"instances_file", required_argument, 0, PROCESS_WIDE_OPTION },
+		{"name", required_argument, 0, 0 },
+		{"hw_backend", required_argument, 0, PROCESS_WIDE_OPTION },
+		{"hw_trace", required_argument, 0, PROCESS_WIDE_OPTION },
+		{"stats_file", required_argument, 0, PROCESS_WIDE_OPTION },
+		{"stats_interval_secs", required_argument, 0, PROCESS_WIDE_OPTION },
+		{"async_output", no_argument, 0, PROCESS_WIDE_OPTION },
+		{"output_queue_size", required_argument, 0, PROCESS_WIDE_OPTION },
+		{"output_backpressure", required_argument, 0, PROCESS_WIDE_OPTION },
+		{"align_results", no_argument, 0, 0 },
+		{"missed_results", required_argument, 0, 0 },
+		{"wind_vane_calibration", required_argument, 0, 0 },
+		{"wind_windows", required_argument, 0, 0 },
+		{"state_file", required_argument, 0, 0 },
+		{"state_max_age_secs", required_argument, 0, 0 },
+		{"gpio_chip", required_argument, 0, PROCESS_WIDE_OPTION },
+		{"gpio_debounce_usecs", required_argument, 0, PROCESS_WIDE_OPTION },
+		{"counter_mode", required_argument, 0, 0 },
+		{"edge_triggered", no_argument, 0, 0 },
+		{"debounce_usecs", required_argument, 0, 0 },
+		{"max_changes_per_sec", required_argument, 0, 0 },
+		{"realtime_priority", required_argument, 0, 0 },
+		{"iio_device", required_argument, 0, 0 },
+		{"w1_devices_dir", required_argument, 0, 0 },
 		{0, 0, 0, 0 }
 	};
 
-	char *sensor_name = NULL, *adc_name = NULL;
-	char *filter_name = NULL, *logfile = NULL;
-	char *temperature_unit = NULL;
-	yadl_config config;
-
-	char **output_types = NULL;
-	int num_output_types = 0;
-	char **output_filenames = NULL;
-	int num_output_filenames = 0;
-
-	outputter **output_funcs = NULL;
+	yadl_config *config = &inst->config;
+	int opt = 0, long_index = 0;
 
-	int opt = 0, long_index = 0, debug = 0, daemon = 0;
-
-	if (argc <= 1)
-		usage();
-
-	memset(&config, 0, sizeof(config));
-	config.gpio_pin = -1;
-	config.spi_channel = -1;
-	config.i2c_address = -1;
-	config.max_retries = DEFAULT_MAX_RETRIES;
-	config.sleep_millis_between_retries = DEFAULT_SLEEP_MILLIS_BETWEEN_RETRIES;
-	config.sleep_millis_between_samples = DEFAULT_SLEEP_MILLIS_BETWEEN_SAMPLES;
-	config.analog_channel = -1;
-	config.num_results = DEFAULT_NUM_RESULTS;
-	config.num_samples_per_result = DEFAULT_NUM_SAMPLES_PER_RESULT;
-	config.remove_n_samples_from_ends = DEFAULT_REMOVE_N_SAMPLES_FROM_ENDS;
-	config.sleep_millis_between_samples = DEFAULT_SLEEP_MILLIS_BETWEEN_SAMPLES;
-	config.only_log_value_changes = 0;
-	config.counter_multiplier = DEFAULT_COUNTER_MULTIPLIER;
-	config.interrupt_edge = DEFAULT_INTERRUPT_EDGE;
-	config.adc_millivolts = DEFAULT_ADC_MILLIVOLTS; /* Raspberry Pi GPIO pins are 3.3V */
-	config.adc_multiplier = DEFAULT_ADC_MULTIPLIER;
-	config.analog_scaling_factor = DEFAULT_ANALOG_SCALING_FACTOR;
-	config.wind_speed_pin = -1;
-	config.rain_gauge_pin = -1;
+	/* Reinitialize getopt since it is called once for each instance */
+	optind = 0;
 
 	while ((opt = getopt_long(argc, argv, "", long_options,
 				  &long_index)) != -1) {
-		if (opt != 0)
+		if (opt != 0 && opt != PROCESS_WIDE_OPTION)
+			usage();
+
+		if (opts == NULL && opt == PROCESS_WIDE_OPTION) {
+			fprintf(stderr, "--%s is only allowed on the command line\n",
+				long_options[long_index].name);
 			usage();
+		}
 
 		errno = 0;
 		switch (long_index) {
 		case 0:
-			config.gpio_pin = strtol(optarg, NULL, 10);
+			config->gpio_pin = strtol(optarg, NULL, 10);
 			break;
 		case 1:
-			num_output_types++;
-			output_types = realloc(output_types,
-					       sizeof(char *) * num_output_types);
-			output_types[num_output_types - 1] = optarg;
+			inst->num_output_types++;
+			inst->output_types = yadl_realloc(inst->output_types,
+						     sizeof(char *) * inst->num_output_types);
+			inst->output_types[inst->num_output_types - 1] = optarg;
 			break;
 		case 2:
-			sensor_name = optarg;
+			inst->sensor_name = optarg;
 			break;
 		case 3:
-			debug = 1;
+			opts->debug = 1;
 			break;
 		case 4:
-			num_output_filenames++;
-			output_filenames = realloc(output_filenames,
-						   sizeof(char *) * num_output_filenames);
-			output_filenames[num_output_filenames - 1] = optarg;
+			inst->num_output_filenames++;
+			inst->output_filenames = yadl_realloc(inst->output_filenames,
+							 sizeof(char *) * inst->num_output_filenames);
+			inst->output_filenames[inst->num_output_filenames - 1] = optarg;
 			break;
 		case 5:
-			config.spi_channel = strtol(optarg, NULL, 10);
+			config->spi_channel = strtol(optarg, NULL, 10);
 			break;
 		case 6:
-			adc_name = optarg;
+			inst->adc_name = optarg;
 			break;
 		case 7:
-			config.max_retries = strtol(optarg, NULL, 10);
+			config->max_retries = strtol(optarg, NULL, 10);
 			break;
 		case 8:
-			config.sleep_millis_between_retries = strtol(optarg, NULL, 10);
+			config->sleep_millis_between_retries = strtol(optarg, NULL, 10);
 			break;
 		case 9:
-			config.num_samples_per_result = strtol(optarg, NULL, 10);
+			config->num_samples_per_result = strtol(optarg, NULL, 10);
 			break;
 		case 10:
-			config.analog_channel = strtol(optarg, NULL, 10);
+			config->analog_channel = strtol(optarg, NULL, 10);
 			break;
 		case 11:
-			config.sleep_millis_between_samples = strtol(optarg, NULL, 10);
+			config->sleep_millis_between_samples = strtol(optarg, NULL, 10);
 			break;
 		case 12:
-			filter_name = optarg;
+			inst->filter_name = optarg;
 			break;
 		case 13:
-			config.remove_n_samples_from_ends = strtol(optarg, NULL, 10);
+			config->remove_n_samples_from_ends = strtol(optarg, NULL, 10);
 			break;
 		case 14:
-			config.num_results = strtol(optarg, NULL, 10);
+			config->num_results = strtol(optarg, NULL, 10);
 			break;
 		case 15:
-			config.sleep_millis_between_results = strtol(optarg, NULL, 10);
+			config->sleep_millis_between_results = strtol(optarg, NULL, 10);
 			break;
 		case 16:
-			config.i2c_address = strtol(optarg, NULL, 16);
+			config->i2c_address = strtol(optarg, NULL, 16);
 			break;
 		case 17:
-			config.only_log_value_changes = 1;
+			config->only_log_value_changes = 1;
 			break;
 		case 18:
-			config.counter_multiplier = strtof(optarg, NULL);
+			config->counter_multiplier = strtof(optarg, NULL);
 			break;
 		case 19:
-			logfile = optarg;
+			opts->logfile = optarg;
 			break;
 		case 20:
-			daemon = 1;
+			opts->daemon = 1;
 			break;
 		case 21:
-			config.interrupt_edge = optarg;
+			config->interrupt_edge = optarg;
 			break;
 		case 22:
-			config.adc_millivolts = strtol(optarg, NULL, 10);
+			config->adc_millivolts = strtol(optarg, NULL, 10);
 			break;
 		case 23:
-			temperature_unit = optarg;
+			inst->temperature_unit = optarg;
 			break;
 		case 24:
-			config.w1_slave = optarg;
+			config->num_w1_slaves++;
+			config->w1_slaves = yadl_realloc(config->w1_slaves,
+							 sizeof(char *) * config->num_w1_slaves);
+			config->w1_slaves[config->num_w1_slaves - 1] = optarg;
 			break;
 		case 25:
-			config.analog_scaling_factor = strtol(optarg, NULL, 10);
+			config->analog_scaling_factor = strtol(optarg, NULL, 10);
 			break;
 		case 26:
-			config.wind_speed_pin = strtol(optarg, NULL, 10);
+			config->wind_speed_pin = strtol(optarg, NULL, 10);
 			break;
 		case 27:
-			config.rain_gauge_pin = strtol(optarg, NULL, 10);
+			config->rain_gauge_pin = strtol(optarg, NULL, 10);
 			break;
 		case 28:
-			config.wind_speed_unit = optarg;
+			config->wind_speed_unit = optarg;
 			break;
 		case 29:
-			config.rain_gauge_unit = optarg;
+			config->rain_gauge_unit = optarg;
 			break;
 		case 30:
-			config.adc_multiplier = strtof(optarg, NULL);
+			config->adc_multiplier = strtof(optarg, NULL);
+			break;
+		case 31:
+			opts->instances_file = optarg;
+			break;
+		case 32:
+			inst->name = optarg;
+			break;
+		case 33:
+			opts->hw_backend_name = optarg;
+			break;
+		case 34:
+			opts->hw_opts.trace_file = optarg;
+			break;
+		case 35:
+			opts->stats_file = optarg;
+			break;
+		case 36:
+			opts->stats_interval_secs = strtol(optarg, NULL, 10);
+			break;
+		case 37:
+			opts->async_output = 1;
+			break;
+		case 38:
+			opts->output_queue_size = strtol(optarg, NULL, 10);
+			break;
+		case 39:
+			opts->output_backpressure = optarg;
+			break;
+		case 40:
+			inst->align_results = 1;
+			break;
+		case 41:
+			inst->missed_results = optarg;
+			break;
+		case 42:
+			config->wind_vane_calibration = optarg;
+			break;
+		case 43:
+			config->wind_windows_spec = optarg;
+			break;
+		case 44:
+			config->state_filename = optarg;
+			break;
+		case 45:
+			config->state_max_age_secs = strtol(optarg, NULL, 10);
+			break;
+		case 46:
+			opts->hw_opts.gpio_chip = optarg;
+			break;
+		case 47:
+			opts->hw_opts.gpio_debounce_usecs = strtol(optarg, NULL,
+								   10);
+			break;
+		case 48:
+			config->counter_mode = optarg;
+			break;
+		case 49:
+			config->edge_triggered = 1;
+			break;
+		case 50:
+			config->debounce_usecs = strtol(optarg, NULL, 10);
+			break;
+		case 51:
+			config->max_changes_per_sec = strtof(optarg, NULL);
+			break;
+		case 52:
+			config->realtime_priority = strtol(optarg, NULL, 10);
+			break;
+		case 53:
+			config->iio_device = optarg;
+			break;
+		case 54:
+			config->w1_devices_dir = optarg;
 			break;
 		default:
 			usage();
@@ -560,117 +811,642 @@ int main(int argc, char **argv)
 			usage();
 	}
 
-	if (config.num_samples_per_result <= 0) {
+	if (optind < argc) {
+		fprintf(stderr, "Unexpected argument '%s'\n", argv[optind]);
+		usage();
+	}
+}
+
+static void _validate_instance(yadl_instance *inst, yadl_options *opts,
+			       logger log)
+{
+	yadl_config *config = &inst->config;
+
+	if (config->num_samples_per_result <= 0) {
 		fprintf(stderr, "--num_samples_per_result must be > 0\n");
 		usage();
-	} else if (config.remove_n_samples_from_ends < 0) {
+	} else if (config->remove_n_samples_from_ends < 0) {
 		fprintf(stderr, "--remove_n_samples_from_ends must be >= 0\n");
 		usage();
-	} else if (config.num_samples_per_result <= (config.remove_n_samples_from_ends * 2)) {
+	} else if (config->num_samples_per_result <= (config->remove_n_samples_from_ends * 2)) {
 		fprintf(stderr, "--remove_n_samples_from_ends * 2 must be less than --num_samples_per_result\n");
 		usage();
-	} else if (daemon && debug && logfile == NULL) {
-		fprintf(stderr, "You must specify the --logfile argument with --daemon\n");
-		usage();
-	} else if (daemon && num_output_filenames == 0) {
+	} else if (opts->daemon && inst->num_output_filenames == 0) {
 		fprintf(stderr, "You must specify the --outfile argument with --daemon\n");
 		usage();
 	}
 
-	config.logger = get_logger(debug, logfile);
+	config->logger = log;
 
-	config.sens = get_sensor(sensor_name);
-	if (config.sens == NULL) {
+	config->sens = get_sensor(inst->sensor_name);
+	if (config->sens == NULL) {
 		fprintf(stderr, "You must specify the --sensor argument\n");
 		usage();
 	}
 
-	if (num_output_types == 0) {
+	if (config->edge_triggered && config->sens->next_edge_usecs == NULL) {
+		fprintf(stderr, "--edge_triggered is only supported by the digital sensor\n");
+		usage();
+	} else if (config->edge_triggered &&
+		   config->num_samples_per_result != 1) {
+		fprintf(stderr, "--edge_triggered needs one sample per result\n");
+		usage();
+	}
+
+	if (inst->name == NULL)
+		inst->name = inst->sensor_name;
+
+	if (inst->num_output_types == 0) {
 		fprintf(stderr, "You must specify at least one --output argument\n");
 		usage();
-	} else if (num_output_types == 1 && num_output_filenames == 0) {
+	} else if (inst->num_output_types == 1 && inst->num_output_filenames == 0) {
 		// Send output to stdout if no filename was specified
-		num_output_filenames++;
-		output_filenames = realloc(output_filenames,
-					   sizeof(char *) * num_output_filenames);
-		output_filenames[num_output_filenames - 1] = NULL;
-	} else if (num_output_types != num_output_filenames) {
+		inst->num_output_filenames++;
+		inst->output_filenames = yadl_realloc(inst->output_filenames,
+						 sizeof(char *) * inst->num_output_filenames);
+		inst->output_filenames[inst->num_output_filenames - 1] = NULL;
+	} else if (inst->num_output_types != inst->num_output_filenames) {
 		fprintf(stderr, "You must specify the same number of --output and --outfile arguments\n");
 		usage();
 	}
 
-	output_funcs = malloc(sizeof(outputter *) * num_output_types);
-	for (int output_idx = 0; output_idx < num_output_types; output_idx++) {
-		output_funcs[output_idx] = get_outputter(output_types[output_idx]);
-		if (output_funcs[output_idx] == NULL)
+	inst->output_funcs = yadl_malloc(sizeof(outputter *) * inst->num_output_types);
+	for (int output_idx = 0; output_idx < inst->num_output_types; output_idx++) {
+		inst->output_funcs[output_idx] = get_outputter(inst->output_types[output_idx]);
+		if (inst->output_funcs[output_idx] == NULL)
 			usage();
 	}
 
-	config.filter_func = get_filter(filter_name);
-	if (config.filter_func == NULL)
+	config->filter_func = get_filter(inst->filter_name);
+	if (config->filter_func == NULL)
 		usage();
 
-	populate_temperature_converter(&config, temperature_unit);
-
-	config.adc = get_adc(adc_name);
+	populate_temperature_converter(config, inst->temperature_unit);
 
-	config.logger("num_results=%d; sleep_millis_between_samples=%d; num_samples_per_result=%d; sleep_millis_between_samples=%d\n",
-			config.num_results, config.sleep_millis_between_samples,
-			config.num_samples_per_result,
-			config.sleep_millis_between_samples);
-	config.logger("max_retries=%d; sleep_millis_between_retries=%d\n",
-			config.max_retries, config.sleep_millis_between_retries);
+	config->adc = get_adc(inst->adc_name);
 
-	int num_values = get_num_values(&config);
+	if (get_schedule_missed_policy(inst->missed_results,
+				       &inst->missed_policy) < 0)
+		usage();
+}
 
-	config.last_values = malloc(sizeof(float) * num_values);
+/*
+ * Reads one sensor per line from the instances file. Each line contains the
+ * same arguments that would be passed on the command line for that sensor.
+ * Blank lines and lines starting with # are ignored, and a line ending with
+ * a backslash is continued on the next line.
+ */
+static yadl_instance *_load_instances_file(char *filename, int *num_instances)
+{
+	FILE *fd = fopen(filename, "r");
 
-	if (wiringPiSetup() == -1)
+	if (fd == NULL) {
+		fprintf(stderr, "Error opening %s: %s\n", filename,
+			strerror(errno));
 		exit(1);
+	}
+
+	yadl_instance *instances = NULL;
+	char *line = NULL, *args = NULL;
+	size_t line_size = 0, args_len = 0;
+	int line_number = 0;
 
-	if (daemon)
-		_daemonize(&config);
+	*num_instances = 0;
 
-	if (config.sens->init != NULL)
-		config.sens->init(&config);
+	while (getline(&line, &line_size, fd) >= 0) {
+		line_number++;
 
-	output_metadata **output_metadatas = malloc(sizeof(output_metadata *) * num_output_types);
+		size_t len = strcspn(line, "\r\n");
+		int continued = len > 0 && line[len - 1] == '\\';
+
+		if (continued)
+			len--;
+
+		args = yadl_realloc(args, args_len + len + 2);
+		memcpy(args + args_len, line, len);
+		args_len += len;
+		args[args_len++] = ' ';
+		args[args_len] = '\0';
+
+		if (continued)
+			continue;
 
-	for (int output_idx = 0; output_idx < num_output_types; output_idx++) {
-		output_metadatas[output_idx] = output_funcs[output_idx]->open(&config,
-									      output_filenames[output_idx]);
+		/* The arguments need to stay around since the config points to them */
+		int argc = 1;
+		char **argv = yadl_malloc(sizeof(char *) * 2);
+		char *saveptr = NULL;
 
-		if (output_funcs[output_idx]->write_header != NULL)
-			output_funcs[output_idx]->write_header(output_metadatas[output_idx],
-							       &config);
+		argv[0] = "yadl";
+		for (char *tok = strtok_r(args, " \t", &saveptr); tok != NULL;
+		     tok = strtok_r(NULL, " \t", &saveptr)) {
+			if (argc == 1 && tok[0] == '#')
+				break;
+
+			argc++;
+			argv = yadl_realloc(argv, sizeof(char *) * (argc + 1));
+			argv[argc - 1] = tok;
+		}
+		argv[argc] = NULL;
+
+		if (argc == 1) {
+			free(argv);
+			args_len = 0;
+			continue;
+		}
+
+		(*num_instances)++;
+		instances = yadl_realloc(instances,
+				    sizeof(yadl_instance) * *num_instances);
+
+		yadl_instance *inst = &instances[*num_instances - 1];
+
+		_init_instance(inst);
+		_parse_args(argc, argv, inst, NULL);
+
+		args = NULL;
+		args_len = 0;
 	}
 
-	for (int i = 0; i < config.num_results || config.num_results < 0; i++) {
-		if (i > 0 && config.sleep_millis_between_results > 0)
-			delay(config.sleep_millis_between_results);
+	free(line);
+	free(args);
+	fclose(fd);
 
-		yadl_result *result = _perform_all_readings(&config);
+	if (*num_instances == 0) {
+		fprintf(stderr, "No sensors were found in %s\n", filename);
+		exit(1);
+	}
 
-		for (int output_idx = 0; output_idx < num_output_types;
-		     output_idx++) {
-			output_funcs[output_idx]->write_result(output_metadatas[output_idx],
-							       i, result,
-							       &config);
+	return instances;
+}
+
+/* Some sensors keep their state in globals and can only be used once */
+static void _check_single_instance_sensors(yadl_instance *instances,
+					   int num_instances)
+{
+	for (int i = 0; i < num_instances; i++) {
+		if (!instances[i].config.sens->single_instance)
+			continue;
+
+		for (int j = i + 1; j < num_instances; j++) {
+			if (instances[i].config.sens == instances[j].config.sens) {
+				fprintf(stderr, "Only one %s sensor is supported per process\n",
+					instances[i].sensor_name);
+				exit(1);
+			}
 		}
+	}
+}
 
-		_free_result(result);
+static void _setup_instance(yadl_instance *inst)
+{
+	yadl_config *config = &inst->config;
+
+	config->logger("%s: num_results=%d; sleep_millis_between_results=%d; num_samples_per_result=%d; sleep_millis_between_samples=%d\n",
+			inst->name, config->num_results,
+			config->sleep_millis_between_results,
+			config->num_samples_per_result,
+			config->sleep_millis_between_samples);
+	config->logger("%s: max_retries=%d; sleep_millis_between_retries=%d\n",
+			inst->name, config->max_retries,
+			config->sleep_millis_between_retries);
+
+	config->schema = new_sensor_schema(config);
+
+	int num_values = config->schema->num_values;
+	int num_units = config->schema->num_units;
+
+	config->sample.value = yadl_calloc(num_values, sizeof(float));
+	config->sample.unit = num_units == 0 ? NULL :
+		yadl_calloc(num_units, sizeof(char *));
+
+	/* Room for the result, its values and units, and the alignment */
+	arena_init(&config->cycle_arena,
+		   sizeof(yadl_result) + sizeof(float) * num_values +
+		   sizeof(char *) * num_units + 3 * _Alignof(max_align_t));
+
+	config->last_values = yadl_malloc(sizeof(float) * num_values);
+	if (filter_needs_samples(config->filter_func,
+				 config->remove_n_samples_from_ends)) {
+		config->samples = yadl_malloc(sizeof(float) * num_values *
+					      config->num_samples_per_result);
+	} else {
+		config->filter_states = yadl_malloc(sizeof(filter_state) * num_values);
+	}
+
+	if (config->sens->init != NULL)
+		config->sens->init(config);
+
+	yadl_stats *stats = config->stats;
+
+	stats->name = inst->name;
+	stats->num_outputs = inst->num_output_types;
+	stats->outputs = yadl_calloc(inst->num_output_types, sizeof(output_stats));
+	for (int output_idx = 0; output_idx < inst->num_output_types; output_idx++) {
+		stats->outputs[output_idx].type = inst->output_types[output_idx];
+		stats->outputs[output_idx].outfile = inst->output_filenames[output_idx];
 	}
 
-	for (int output_idx = 0; output_idx < num_output_types; output_idx++) {
-		if (output_funcs[output_idx]->write_footer != NULL)
-			output_funcs[output_idx]->write_footer(output_metadatas[output_idx]);
+	inst->output_metadatas = yadl_malloc(sizeof(output_metadata *) * inst->num_output_types);
+
+	for (int output_idx = 0; output_idx < inst->num_output_types; output_idx++) {
+		inst->output_metadatas[output_idx] = inst->output_funcs[output_idx]->open(config,
+											  inst->output_filenames[output_idx]);
+
+		if (inst->output_funcs[output_idx]->write_header != NULL)
+			inst->output_funcs[output_idx]->write_header(inst->output_metadatas[output_idx],
+								     config);
+	}
+}
+
+static int _instance_is_done(yadl_instance *inst)
+{
+	return inst->config.num_results >= 0 &&
+		inst->reading_number >= inst->config.num_results;
+}
+
+static void _write_instance_outputs(yadl_instance *inst, int reading_number,
+				    yadl_result *result)
+{
+	yadl_stats *stats = inst->config.stats;
+
+	for (int output_idx = 0; output_idx < inst->num_output_types;
+	     output_idx++) {
+		output_stats *out_stats = &stats->outputs[output_idx];
+		uint64_t output_start_usecs = stats_now_usecs();
+
+		inst->output_funcs[output_idx]->write_result(inst->output_metadatas[output_idx],
+							     reading_number,
+							     result,
+							     &inst->config);
+
+		output_stats_record(out_stats,
+				    stats_now_usecs() - output_start_usecs,
+				    inst->output_metadatas[output_idx]->bytes_written);
+	}
+}
 
-		if (output_funcs[output_idx]->close != NULL)
-			output_funcs[output_idx]->close(output_metadatas[output_idx], &config);
+/* queue is NULL when the outputs are written from the main loop */
+static int _write_instance_result(yadl_instance *inst, output_queue *queue)
+{
+	yadl_stats *stats = inst->config.stats;
+	uint64_t start_usecs = stats_now_usecs();
+	uint64_t start_allocations = yadl_num_allocations();
+	yadl_result *result = _perform_all_readings(&inst->config);
+
+	if (result == NULL) {
+		fprintf(stderr, "%s: Error: Unable to read result #%d\n",
+			inst->name, inst->reading_number);
+		stats->failed_results++;
+		stats->allocations += yadl_num_allocations() - start_allocations;
+		inst->reading_number++;
+		return -1;
 	}
 
-	close_logger(logfile);
+	if (queue != NULL)
+		output_queue_push(queue, inst, inst->reading_number, result,
+				  inst->config.schema->num_values,
+				  inst->config.schema->num_units);
+	else
+		_write_instance_outputs(inst, inst->reading_number, result);
+
+	inst->reading_number++;
+
+	stats->results++;
+	stats->allocations += yadl_num_allocations() - start_allocations;
+	histogram_record(&stats->cycle, stats_now_usecs() - start_usecs);
 
 	return 0;
 }
 
+static void _close_instance(yadl_instance *inst)
+{
+	for (int output_idx = 0; output_idx < inst->num_output_types; output_idx++) {
+		if (inst->output_funcs[output_idx]->write_footer != NULL)
+			inst->output_funcs[output_idx]->write_footer(inst->output_metadatas[output_idx]);
+
+		if (inst->output_funcs[output_idx]->close != NULL)
+			inst->output_funcs[output_idx]->close(inst->output_metadatas[output_idx],
+							      &inst->config);
+	}
+}
+
+static volatile sig_atomic_t _stats_requested;
+
+static void _stats_signal_handler(__attribute__((__unused__)) int signum)
+{
+	_stats_requested = 1;
+}
+
+/*
+ * SA_RESTART is not used so that the main loop wakes up from its sleep
+ * and writes the stats right away.
+ */
+static void _install_stats_signal_handler(void)
+{
+	struct sigaction sa;
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = &_stats_signal_handler;
+	sigemptyset(&sa.sa_mask);
+
+	if (sigaction(SIGUSR1, &sa, NULL) < 0) {
+		fprintf(stderr, "Error installing the SIGUSR1 handler: %s\n",
+			strerror(errno));
+		exit(1);
+	}
+}
+
+/*
+ * The output thread updates the output stats while they are written out
+ * here. write_stats() copies each one under its seqlock.
+ */
+static void _write_stats(yadl_options *opts, yadl_stats *stats,
+			 int num_instances, output_queue *queue,
+			 uint64_t start_usecs)
+{
+	uint64_t uptime_usecs = stats_now_usecs() - start_usecs;
+	queue_stats qstats, *qstats_ptr = NULL;
+
+	if (queue != NULL) {
+		qstats.size = queue->size;
+		qstats.depth = output_queue_depth(queue);
+		qstats.max_depth = atomic_load(&queue->max_depth);
+		qstats.queued = atomic_load(&queue->num_queued);
+		qstats.dropped = atomic_load(&queue->num_dropped);
+		qstats.coalesced = atomic_load(&queue->num_coalesced);
+		qstats_ptr = &qstats;
+	}
+
+	if (opts->stats_file != NULL)
+		write_stats_file(opts->stats_file, stats, num_instances,
+				 qstats_ptr, uptime_usecs);
+	else
+		write_stats(stderr, stats, num_instances, qstats_ptr,
+			    uptime_usecs);
+}
+
+/*
+ * Writes the queued results to the outputs so that a slow output, such as
+ * an RRD database on an SD card, does not delay the next reading.
+ */
+static void *_output_thread(void *arg)
+{
+	output_queue *queue = arg;
+	output_entry entry;
+
+	init_output_entry(queue, &entry);
+
+	while (output_queue_pop(queue, &entry) == 0)
+		_write_instance_outputs(entry.owner, entry.reading_number,
+					&entry.result);
+
+	free(entry.result.value);
+	free(entry.result.unit);
+
+	return NULL;
+}
+
+static output_queue *_start_output_thread(yadl_instance *instances,
+					  int num_instances,
+					  yadl_options *opts,
+					  pthread_t *tid)
+{
+	output_queue_policy policy;
+	int max_values = 0, max_units = 0;
+
+	if (get_output_queue_policy(opts->output_backpressure, &policy) < 0)
+		usage();
+
+	for (int i = 0; i < num_instances; i++) {
+		sensor_schema *schema = instances[i].config.schema;
+
+		if (schema->num_values > max_values)
+			max_values = schema->num_values;
+		if (schema->num_units > max_units)
+			max_units = schema->num_units;
+	}
+
+	output_queue *queue = new_output_queue(opts->output_queue_size,
+					       max_values, max_units, policy);
+
+	/*
+	 * Keep SIGUSR1 on the main thread so that it interrupts the sleep
+	 * in the main loop. The new thread inherits the blocked signal.
+	 */
+	sigset_t mask, old_mask;
+
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGUSR1);
+	pthread_sigmask(SIG_BLOCK, &mask, &old_mask);
+
+	int ret = pthread_create(tid, NULL, &_output_thread, queue);
+
+	pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
+
+	if (ret != 0) {
+		fprintf(stderr, "Error creating the output thread: %s\n",
+			strerror(ret));
+		exit(1);
+	}
+
+	return queue;
+}
+
+/* Waits for the output thread to write everything that is queued */
+static void _stop_output_thread(output_queue *queue, pthread_t *tid)
+{
+	if (queue == NULL)
+		return;
+
+	output_queue_close(queue);
+	pthread_join(*tid, NULL);
+}
+
+/* --edge_triggered instances are due once an edge is waiting */
+static uint64_t _instance_due_usecs(yadl_instance *inst)
+{
+	if (inst->config.edge_triggered)
+		return inst->config.sens->next_edge_usecs(&inst->config);
+
+	return inst->sched.next_usecs;
+}
+
+/*
+ * Runs each sensor instance on its own schedule until all of them have
+ * returned the requested number of results. The instances all start at
+ * the same time, or on the same wall clock boundary with --align_results,
+ * so that sensors with the same interval are read together.
+ * When running a single sensor, a failed reading terminates the program.
+ */
+static void _run_instances(hw_backend *hw, yadl_instance *instances,
+			   int num_instances, yadl_options *opts,
+			   yadl_stats *stats, output_queue *queue,
+			   pthread_t *output_tid)
+{
+	uint64_t start_usecs = stats_now_usecs();
+	uint64_t stats_interval_usecs = opts->stats_interval_secs * 1000000ULL;
+	uint64_t next_stats_usecs = hw->monotonic_usecs() + stats_interval_usecs;
+
+	for (int i = 0; i < num_instances; i++)
+		schedule_start(&instances[i].sched, hw,
+			       instances[i].config.sleep_millis_between_results,
+			       instances[i].align_results,
+			       instances[i].missed_policy);
+
+	while (1) {
+		if (_stats_requested ||
+		    (opts->stats_file != NULL &&
+		     hw->monotonic_usecs() >= next_stats_usecs)) {
+			_stats_requested = 0;
+			_write_stats(opts, stats, num_instances, queue,
+				     start_usecs);
+			next_stats_usecs = hw->monotonic_usecs() +
+				stats_interval_usecs;
+		}
+
+		yadl_instance *next = NULL;
+		uint64_t next_usecs = HW_WAIT_FOREVER;
+
+		for (int i = 0; i < num_instances; i++) {
+			if (_instance_is_done(&instances[i]))
+				continue;
+
+			uint64_t due_usecs = _instance_due_usecs(&instances[i]);
+
+			if (next == NULL || due_usecs < next_usecs) {
+				next = &instances[i];
+				next_usecs = due_usecs;
+			}
+		}
+
+		if (next == NULL)
+			break;
+
+		uint64_t wakeup_usecs = next_usecs;
+
+		if (opts->stats_file != NULL && next_stats_usecs < wakeup_usecs)
+			wakeup_usecs = next_stats_usecs;
+
+		/*
+		 * Recheck everything after sleeping since the sleep may have
+		 * been for the stats, cut short by an edge or interrupted by
+		 * a signal.
+		 */
+		uint64_t now_usecs = hw->monotonic_usecs();
+
+		if (now_usecs < wakeup_usecs) {
+			hw->wait_event(wakeup_usecs);
+			continue;
+		}
+
+		if (now_usecs < next_usecs)
+			continue;
+
+		yadl_stats *inst_stats = next->config.stats;
+
+		histogram_record(&inst_stats->lateness, now_usecs - next_usecs);
+
+		if (_write_instance_result(next, queue) < 0 &&
+		    num_instances == 1) {
+			_stop_output_thread(queue, output_tid);
+			exit(1);
+		}
+
+		if (next->config.edge_triggered)
+			continue;
+
+		schedule_advance(&next->sched, hw->monotonic_usecs());
+		inst_stats->overruns = next->sched.overruns;
+		inst_stats->skipped_results = next->sched.skipped;
+	}
+
+	_stop_output_thread(queue, output_tid);
+
+	if (opts->stats_file != NULL)
+		_write_stats(opts, stats, num_instances, queue, start_usecs);
+}
+
+int main(int argc, char **argv)
+{
+	yadl_options opts;
+	yadl_instance *instances;
+	int num_instances;
+
+	if (argc <= 1)
+		usage();
+
+	memset(&opts, 0, sizeof(opts));
+	opts.stats_interval_secs = DEFAULT_STATS_INTERVAL_SECS;
+	opts.output_queue_size = DEFAULT_OUTPUT_QUEUE_SIZE;
+
+	instances = yadl_malloc(sizeof(yadl_instance));
+	_init_instance(&instances[0]);
+	_parse_args(argc, argv, &instances[0], &opts);
+
+	if (opts.daemon && opts.debug && opts.logfile == NULL) {
+		fprintf(stderr, "You must specify the --logfile argument with --daemon\n");
+		usage();
+	} else if (opts.stats_interval_secs <= 0) {
+		fprintf(stderr, "--stats_interval_secs must be > 0\n");
+		usage();
+	} else if (opts.output_queue_size <= 0) {
+		fprintf(stderr, "--output_queue_size must be > 0\n");
+		usage();
+	} else if (opts.hw_opts.gpio_debounce_usecs < 0) {
+		fprintf(stderr, "--gpio_debounce_usecs must be >= 0\n");
+		usage();
+	}
+
+	if (opts.instances_file != NULL) {
+		if (instances[0].sensor_name != NULL) {
+			fprintf(stderr, "The sensor arguments must be in the --instances_file\n");
+			usage();
+		}
+
+		free(instances);
+		instances = _load_instances_file(opts.instances_file,
+						 &num_instances);
+	} else {
+		num_instances = 1;
+	}
+
+	logger log = get_logger(opts.debug, opts.logfile);
+	hw_backend *hw = get_hw_backend(opts.hw_backend_name);
+	yadl_stats *stats = yadl_calloc(num_instances, sizeof(yadl_stats));
+
+	for (int i = 0; i < num_instances; i++) {
+		_validate_instance(&instances[i], &opts, log);
+		instances[i].config.hw = hw;
+		instances[i].config.stats = &stats[i];
+	}
+
+	_check_single_instance_sensors(instances, num_instances);
+
+	if (hw->setup(&opts.hw_opts) == -1)
+		exit(1);
+
+	if (opts.daemon)
+		_daemonize(&instances[0].config);
+
+	for (int i = 0; i < num_instances; i++)
+		_setup_instance(&instances[i]);
+
+	_install_stats_signal_handler();
+
+	output_queue *queue = NULL;
+	pthread_t output_tid;
+
+	if (opts.async_output)
+		queue = _start_output_thread(instances, num_instances, &opts,
+					     &output_tid);
+
+	_run_instances(hw, instances, num_instances, &opts, stats, queue,
+		       &output_tid);
+
+	for (int i = 0; i < num_instances; i++)
+		_close_instance(&instances[i]);
+
+	close_logger(opts.logfile);
+
+	return 0;
+}
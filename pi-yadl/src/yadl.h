@@ -19,17 +19,36 @@
  * 02110-1301, USA.
  */
 
+#include <stdatomic.h>
 #include <stdio.h>
-#include "float_list.h"
+#include "anemometer.h"
+#include "hw.h"
 #include "loggers.h"
+#include "memory.h"
+#include "rain_window.h"
+#include "state_file.h"
+#include "stats.h"
+#include "wind_window.h"
 
 typedef struct yadl_result_tag {
 	float *value;
 	char **unit;
+
+	/* Seconds since the epoch when the result was read */
+	long timestamp;
 } yadl_result;
 
 typedef struct yadl_config_tag yadl_config;
 
+/* Private to the digital sensor */
+typedef struct digital_edges_tag digital_edges;
+
+/* Private to the ds18b20 sensor */
+typedef struct ds18b20_probes_tag ds18b20_probes;
+
+/* Private to the bme280 sensor */
+typedef struct bme280_calib_data_tag bme280_calib_data;
+
 typedef struct adc_converter_tag {
 	void (*adc_init)(yadl_config *config);
 	int (*adc_read)(yadl_config *config);
@@ -39,6 +58,10 @@ typedef struct adc_converter_tag {
 typedef struct output_metadata_tag {
 	FILE *fd;
 	char *outfile;
+	uint64_t bytes_written;
+
+	/* The number of results that the outputter has written so far */
+	int num_results_written;
 } output_metadata;
 
 typedef struct outputter_tag {
@@ -52,20 +75,106 @@ typedef struct outputter_tag {
 
 typedef struct sensor_tag {
 	void (*init)(yadl_config *config);
-	yadl_result * (*read)(yadl_config *config);
+
+	/*
+	 * Fills in the result that is allocated by the caller. value and unit
+	 * have room for the number of values and units in the sensor's
+	 * schema. Returns -1 if the reading was bad and should be retried.
+	 */
+	int (*read)(yadl_config *config, yadl_result *result);
+
 	char ** (*get_value_header_names)(yadl_config *config);
 	char ** (*get_unit_header_names)(yadl_config *config);
+
+	/*
+	 * Set for the sensors that support --edge_triggered. Returns the
+	 * monotonic_usecs() when the next result can be written, or
+	 * HW_WAIT_FOREVER when no edge is waiting.
+	 */
+	uint64_t (*next_edge_usecs)(yadl_config *config);
+
+	/* Set when the sensor keeps its state in globals (e.g. interrupt handlers) */
+	int single_instance;
 } sensor;
 
-typedef float (*filter)(float_node *list);
+/* A value or unit name with the keys that the outputters write for it */
+typedef struct sensor_schema_field_tag {
+	char *name;
+	int name_len;
+
+	/* ' "name": ' with the name escaped */
+	char *json_key;
+	int json_key_len;
+
+	/* '<name>' and '</name>' */
+	char *xml_open;
+	int xml_open_len;
+	char *xml_close;
+	int xml_close_len;
+} sensor_schema_field;
+
+/*
+ * The layout of the sensor's results. This is built once when the sensor
+ * instance is set up so that nothing needs to walk the header names for
+ * each result.
+ */
+typedef struct sensor_schema_tag {
+	int num_values;
+	sensor_schema_field *values;
+
+	/* NULL terminated list of the value names for the RRD database */
+	char **value_names;
+
+	int num_units;
+	sensor_schema_field *units;
+} sensor_schema;
+
+#define P2_NUM_MARKERS 5
+
+/* Running state for the filters that can process one sample at a time */
+typedef struct filter_state_tag {
+	int count;
+	double sum;
+	float min;
+	float max;
+
+	/* Markers for the P-squared median estimator */
+	float p2_heights[P2_NUM_MARKERS];
+	int p2_positions[P2_NUM_MARKERS];
+	float p2_desired[P2_NUM_MARKERS];
+} filter_state;
+
+typedef struct filter_tag {
+	/*
+	 * Streaming interface that uses constant memory. push is NULL for
+	 * the filters that need to see all of the samples at once.
+	 */
+	void (*init)(filter_state *state);
+	void (*push)(filter_state *state, float sample);
+	float (*finalize)(filter_state *state);
+
+	/* Used when all of the samples for a result are buffered */
+	float (*reduce)(float *values, int len);
+} filter;
 
 typedef float (*temperature_unit_converter)(float input);
 
-#define NUM_WIND_2_MIN_SAMPLES   120
-#define NUM_WIND_10_MIN_SAMPLES  600
-#define NUM_WIND_60_MIN_SAMPLES 3600
+#define WIND_VANE_UNSTABLE      0x80
+
+#define RAIN_MIN_BUCKET_MILLIS  1000
+
+typedef struct wind_stats_tag {
+	/*
+	 * The average direction, average speed, gust direction and gust
+	 * speed of each wind window
+	 */
+	float *window_values;
+	float *direction_stddev;
+	int num_rain_clicks_today;
+} wind_stats;
 
 struct yadl_config_tag {
+	hw_backend *hw;
 	sensor *sens;
 	int gpio_pin;
 	logger logger;
@@ -77,19 +186,58 @@ struct yadl_config_tag {
 	int sleep_millis_between_results;
 	int sleep_millis_between_samples;
 	int max_retries;
-	filter filter_func;
+	filter *filter_func;
+	filter_state *filter_states;
 	int num_results;
 	int num_samples_per_result;
 	int remove_n_samples_from_ends;
+
+	/*
+	 * Storage for the samples of a single result when the filter needs to
+	 * see all of the samples. The samples for each value are stored
+	 * contiguously and this is allocated once at startup. This is NULL
+	 * when the samples are streamed into filter_states instead.
+	 */
+	float *samples;
+
 	int only_log_value_changes;
 	float *last_values;
 	float counter_multiplier;
 	char *interrupt_edge;
+
+	/* count or period, and the pin that this counter instance owns */
+	char *counter_mode;
+	int counter_period_mode;
+	int counter_idx;
+
+	/*
+	 * Write a result for each change of the digital sensor's pin instead
+	 * of on a schedule
+	 */
+	int edge_triggered;
+	int debounce_usecs;
+	float max_changes_per_sec;
+	digital_edges *digital_edges;
+
 	int adc_millivolts;
 	float adc_multiplier;
 	char *temperature_unit;
 	temperature_unit_converter temperature_converter;
-	char *w1_slave;
+
+	/* The ds18b20 probes from --w1_slave, or found in w1_devices_dir */
+	char **w1_slaves;
+	int num_w1_slaves;
+	char *w1_devices_dir;
+	ds18b20_probes *ds18b20_probes;
+
+	/* SCHED_FIFO priority for the DHT transaction, or 0 to not use it */
+	int realtime_priority;
+
+	/* The IIO device of the dht11 kernel driver and its open attributes */
+	char *iio_device;
+	int iio_temperature_fd;
+	int iio_humidity_fd;
+
 	int analog_scaling_factor;
 	int wind_speed_pin;
 	int rain_gauge_pin;
@@ -100,14 +248,19 @@ struct yadl_config_tag {
 	char *rain_gauge_unit;
 	float rain_gauge_multiplier;
 
-	float_node *rain_gauge_1h;
-	int num_rain_gauge_1h_samples;
-
-	float_node *rain_gauge_6h;
-	int num_rain_gauge_6h_samples;
+	/*
+	 * The wind vane position for each ADC code. WIND_VANE_UNSTABLE is set
+	 * when the code is between two positions.
+	 */
+	char *wind_vane_calibration;
+	uint8_t *wind_vane_lut;
+	atomic_int wind_vane_last_position;
+	atomic_int wind_vane_num_unstable;
+	int wind_vane_last_num_unstable;
 
-	float_node *rain_gauge_24h;
-	int num_rain_gauge_24h_samples;
+	rain_window rain_1h;
+	rain_window rain_6h;
+	rain_window rain_24h;
 
 	/**
 	 * Keep track of the amount of rain that was seen since midnight
@@ -116,59 +269,92 @@ struct yadl_config_tag {
 	int current_hour;
 	int num_rain_clicks_today;
 
-	/* Ring buffers for the historical wind data */
-	float wind_directions_2m[NUM_WIND_2_MIN_SAMPLES];
-	float wind_speeds_2m[NUM_WIND_2_MIN_SAMPLES];
-	int wind_2m_idx;
+	/* The anemometer pulses that the wind thread samples once a second */
+	anemometer anemometer;
 
-	float wind_directions_10m[NUM_WIND_10_MIN_SAMPLES];
-	float wind_speeds_10m[NUM_WIND_10_MIN_SAMPLES];
-	int wind_10m_idx;
+	/* The historical wind data from --wind_windows */
+	char *wind_windows_spec;
+	wind_windows wind_windows;
+	char **wind_value_header_names;
 
-	float wind_directions_60m[NUM_WIND_60_MIN_SAMPLES];
-	float wind_speeds_60m[NUM_WIND_60_MIN_SAMPLES];
-	int wind_60m_idx;
+	/*
+	 * The wind windows and the rain since midnight are only touched by
+	 * the wind thread. It publishes the statistics that a result needs
+	 * here once a second.
+	 */
+	seqlock wind_stats_lock;
+	wind_stats wind_stats;
+	wind_stats wind_stats_next;
+
+	/* Keeps the wind and rain history across restarts */
+	char *state_filename;
+	int state_max_age_secs;
+	state_file *state;
 
 	int fd;
+
+	/* Read from the bme280 once at startup */
+	bme280_calib_data *bme280_calib;
+
+	/* Preallocated slot that each sample is read into */
+	yadl_result sample;
+
+	/* Scratch memory for a single result that is reset each cycle */
+	arena cycle_arena;
+
+	sensor_schema *schema;
+
+	yadl_stats *stats;
 };
 
-filter get_filter(char *name);
+filter *get_filter(char *name);
+
+int filter_needs_samples(filter *filter_func, int remove_n_samples_from_ends);
+
+float filter_samples(filter *filter_func, float *values, int len,
+		     int remove_n_samples_from_ends);
 
 outputter *get_outputter(char *name);
 
-sensor bmp180_sensor_funcs;
+extern sensor bmp180_sensor_funcs;
+
+extern sensor bme280_sensor_funcs;
 
-sensor bme280_sensor_funcs;
+extern sensor analog_sensor_funcs;
 
-sensor analog_sensor_funcs;
+extern sensor argent_80422_sensor_funcs;
 
-sensor argent_80422_sensor_funcs;
+extern sensor digital_sensor_funcs;
 
-sensor digital_sensor_funcs;
+extern sensor digital_counter_sensor_funcs;
 
-sensor digital_counter_sensor_funcs;
+extern sensor dht11_sensor_funcs;
 
-sensor dht11_sensor_funcs;
+extern sensor dht22_sensor_funcs;
 
-sensor dht22_sensor_funcs;
+extern sensor dht11_iio_sensor_funcs;
 
-sensor ds18b20_sensor_funcs;
+extern sensor dht22_iio_sensor_funcs;
 
-sensor tmp36_sensor_funcs;
+extern sensor ds18b20_sensor_funcs;
+
+extern sensor tmp36_sensor_funcs;
 
 sensor *get_sensor(char *name);
 
-adc_converter mcp3002_funcs;
+extern adc_converter mcp3002_funcs;
 
-adc_converter mcp3004_funcs;
+extern adc_converter mcp3004_funcs;
 
-adc_converter pcf8591_funcs;
+extern adc_converter pcf8591_funcs;
 
 adc_converter *get_adc(char *name);
 
 void usage(void);
 
-int get_num_values(yadl_config *config);
+sensor_schema *new_sensor_schema(yadl_config *config);
 
 void populate_temperature_converter(yadl_config *config, char *name);
 
+float calculate_dew_point(float temperature, float humidity);
+